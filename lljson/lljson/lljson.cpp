@@ -1,8 +1,27 @@
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <stdexcept>
 #include "lljson.h"
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LLJSON_X86
+#include <tmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define LLJSON_TARGET_SSSE3
+#else
+#include <cpuid.h>
+#define LLJSON_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LLJSON_SSE2
+#endif
+#endif
+
 
 #include <iostream>
 
@@ -10,255 +29,1041 @@ namespace ll {
 
 namespace json {
 
-class JsonParser {
-public:
-	JsonParser(const std::string &_str);
-	JsonParser(const char *_str);
-	Json parse();
-private:
-	Json::State _parse_state = Json::PARSE_OK;
-	const std::string &_parse_string;
-	// index of parse string
-	size_t _i = 0;
-
-	Json parseValue();
-	Json parseNull();
-	Json parseBoolean();
-	Json parseNumber();
-	Json parseString();
-	Json parseArray();
-	Json parseObject();
-
-	std::string parseRawString();
-	char nextToken();
-	void consumeWhitespace();
-	void encode_utf8(long l, std::string &res);
-};
-
-
-class JsonStringify {
-public:
-	JsonStringify(const Json &_j);
-	std::string stringify();
-private:
-	const Json &_json;
-	std::string stringifyString(const std::string &_s);
-
-};
-
-
 //========================aux function=========================================
 static inline bool inRange(long x, long lower, long upper) {
 	return (lower <= x && x <= upper);
 }
 
-//========================JsonParser===========================================
-JsonParser::JsonParser(const std::string & _str)
-	:_parse_string(_str)
+// 64-bit FNV-1a, stable across platforms and runs
+static inline uint64_t hashBytes(const char *p, size_t n) {
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; i < n; i++) {
+		h ^= static_cast<unsigned char>(p[i]);
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+static inline uint64_t hashCombine(uint64_t seed, uint64_t v) {
+	seed ^= v + 0x9E3779B97F4A7C15ULL + (seed << 6) + (seed >> 2);
+	return seed;
+}
+
+// Hash of a NUMBER Json, shared by packed arrays
+static inline uint64_t hashNumber(double n) {
+	n = (n == 0.0 ? 0.0 : n); // -0 == 0
+	uint64_t bits;
+	memcpy(&bits, &n, sizeof bits);
+	return hashCombine(hashCombine(0, static_cast<uint64_t>(Json::NUMBER) + 1), bits);
+}
+
+//========================UTF-8 validation=====================================
+static bool validateUtf8Scalar(const unsigned char *s, size_t n)
 {
+	size_t i = 0;
+	while (i < n) {
+		unsigned char c = s[i];
+		if (c < 0x80) {
+			i++;
+			continue;
+		}
+		// allowed range of the 2nd byte excludes overlongs, surrogates and > U+10FFFF
+		size_t len;
+		unsigned char lo = 0x80, hi = 0xBF;
+		if (inRange(c, 0xC2, 0xDF)) {
+			len = 2;
+		}
+		else if (inRange(c, 0xE0, 0xEF)) {
+			len = 3;
+			if (c == 0xE0) lo = 0xA0;
+			if (c == 0xED) hi = 0x9F;
+		}
+		else if (inRange(c, 0xF0, 0xF4)) {
+			len = 4;
+			if (c == 0xF0) lo = 0x90;
+			if (c == 0xF4) hi = 0x8F;
+		}
+		else {
+			return false;
+		}
+		if (n - i < len || s[i + 1] < lo || s[i + 1] > hi) return false;
+		for (size_t k = 2; k < len; k++) {
+			if ((s[i + k] & 0xC0) != 0x80) return false;
+		}
+		i += len;
+	}
+	return true;
+}
+
+#ifdef LLJSON_X86
+// Lookup-table validator of Keiser & Lemire, "Validating UTF-8 In Less
+// Than One Instruction Per Byte". Every (previous byte, byte) pair is
+// classified by three 16-entry nibble tables, an error is any bit
+// set in all three, plus a check that 3rd/4th bytes are continuations.
+LLJSON_TARGET_SSSE3 static inline __m128i utf8BlockErrors(__m128i in, __m128i prev)
+{
+	const uint8_t TOO_SHORT = 1 << 0;
+	const uint8_t TOO_LONG = 1 << 1;
+	const uint8_t OVERLONG_3 = 1 << 2;
+	const uint8_t TOO_LARGE = 1 << 3;
+	const uint8_t SURROGATE = 1 << 4;
+	const uint8_t OVERLONG_2 = 1 << 5;
+	const uint8_t TOO_LARGE_1000 = 1 << 6;
+	const uint8_t OVERLONG_4 = 1 << 6;
+	const uint8_t TWO_CONTS = 1 << 7;
+	const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+	const __m128i byte_1_high_table = _mm_setr_epi8(
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+		TOO_SHORT | OVERLONG_2,
+		TOO_SHORT,
+		TOO_SHORT | OVERLONG_3 | SURROGATE,
+		(char)(TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4));
+	const __m128i byte_1_low_table = _mm_setr_epi8(
+		(char)(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4),
+		(char)(CARRY | OVERLONG_2),
+		(char)CARRY,
+		(char)CARRY,
+		(char)(CARRY | TOO_LARGE),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000));
+	const __m128i byte_2_high_table = _mm_setr_epi8(
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4),
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE),
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+	const __m128i low_nibble = _mm_set1_epi8(0x0F);
+
+	__m128i prev1 = _mm_alignr_epi8(in, prev, 15);
+	__m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table,
+		_mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble));
+	__m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, low_nibble));
+	__m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table,
+		_mm_and_si128(_mm_srli_epi16(in, 4), low_nibble));
+	__m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+	// bytes 2 or 3 after a 3/4-byte lead must be continuations, those are
+	// the positions where special has no TWO_CONTS bit to cancel
+	__m128i prev2 = _mm_alignr_epi8(in, prev, 14);
+	__m128i prev3 = _mm_alignr_epi8(in, prev, 13);
+	__m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+	__m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+	__m128i must23 = _mm_and_si128(_mm_or_si128(is_third, is_fourth), _mm_set1_epi8((char)0x80));
+	return _mm_xor_si128(must23, special);
+}
+
+LLJSON_TARGET_SSSE3 static bool validateUtf8Ssse3(const char *s, size_t n)
+{
+	__m128i prev = _mm_setzero_si128();
+	__m128i error = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+		error = _mm_or_si128(error, utf8BlockErrors(in, prev));
+		prev = in;
+	}
+	// zero padding also flags a sequence cut by the end of input
+	char tail[16] = { 0 };
+	memcpy(tail, s + i, n - i);
+	__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tail));
+	error = _mm_or_si128(error, utf8BlockErrors(in, prev));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
 }
 
-JsonParser::JsonParser(const char * _str)
-	:JsonParser(std::string(_str))
+static bool hasSsse3()
 {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3) != 0;
+#endif
 }
+#endif
 
-Json JsonParser::parse()
+static bool validateUtf8(const char *s, size_t n)
 {
-	Json j = parseValue();
-	if (j.state() == Json::PARSE_OK) {
-		consumeWhitespace();
-		if (_i != _parse_string.size()) {
-			return Json(Json::NUL, Json::PARSE_ROOT_NOT_SINGULAR);
+#ifdef LLJSON_X86
+	static const bool ssse3 = hasSsse3();
+	if (ssse3) {
+		return validateUtf8Ssse3(s, n);
+	}
+#endif
+	return validateUtf8Scalar(reinterpret_cast<const unsigned char *>(s), n);
+}
+
+//========================string scanning======================================
+#ifdef LLJSON_SSE2
+static inline unsigned lowestBit(int mask)
+{
+#if defined(_MSC_VER)
+	unsigned long bit;
+	_BitScanForward(&bit, mask);
+	return bit;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+static inline bool isWhitespace(char ch)
+{
+	return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+// Index of the first non-whitespace char at or after i
+static size_t skipWhitespace(const std::string &str, size_t i)
+{
+	const char *s = str.data();
+	// minified input has none, separators like ": " have one
+	if (!isWhitespace(s[i])) return i;
+	if (!isWhitespace(s[++i])) return i;
+#ifdef LLJSON_SSE2
+	// indentation, 16 bytes at a time
+	size_t n = str.size();
+	for (; i + 16 <= n; i += 16) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+		__m128i ws = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\n'))),
+			_mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\t'))));
+		int mask = ~_mm_movemask_epi8(ws) & 0xFFFF;
+		if (mask != 0) {
+			return i + lowestBit(mask);
+		}
+	}
+#endif
+	while (isWhitespace(s[i])) i++;
+	return i;
+}
+
+// Index of the first '"', '\\' or control char (including the terminating
+// '\0') at or after i. high gets the OR of the skipped bytes, possibly of a
+// few more, which is enough to tell whether a UTF-8 check is needed.
+static size_t scanStringRun(const std::string &str, size_t i, unsigned char &high)
+{
+	const char *s = str.data();
+	size_t n = str.size();
+#ifdef LLJSON_SSE2
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1F);
+	__m128i bytes = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+		bytes = _mm_or_si128(bytes, in);
+		__m128i special = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(in, quote), _mm_cmpeq_epi8(in, backslash)),
+			_mm_cmpeq_epi8(_mm_min_epu8(in, control), in));
+		int mask = _mm_movemask_epi8(special);
+		if (mask != 0) {
+			if (_mm_movemask_epi8(bytes)) high |= 0x80;
+			return i + lowestBit(mask);
 		}
 	}
-	return std::move(j);
+	if (_mm_movemask_epi8(bytes)) high |= 0x80;
+#endif
+	for (; ; i++) {
+		unsigned char ch = s[i];
+		if (ch == '"' || ch == '\\' || ch < 0x20) return i;
+		high |= ch;
+	}
 }
 
-Json JsonParser::parseValue()
+struct HexTable {
+	signed char v[256];
+	constexpr HexTable() : v() {
+		for (int i = 0; i < 256; i++) v[i] = -1;
+		for (int i = 0; i < 10; i++) v['0' + i] = static_cast<signed char>(i);
+		for (int i = 0; i < 6; i++) {
+			v['a' + i] = static_cast<signed char>(10 + i);
+			v['A' + i] = static_cast<signed char>(10 + i);
+		}
+	}
+};
+static constexpr HexTable HEX_TABLE;
+
+// Stops at the first non-hex digit, so never reads past the terminating '\0'
+static inline bool parseHex4(const char *p, long &value)
 {
-	char ch = nextToken();
-	if (_parse_state != Json::PARSE_OK) return Json(Json::NUL, _parse_state);
-	switch (ch)
-	{
-	case 'n':	return parseNull();
-	case 't':	// down to below
-	case 'f':	return parseBoolean();
-	case '"':	return parseString();
-	case '[':	return parseArray();
-	case '{':	return parseObject();
-	default:	return parseNumber();
+	value = 0;
+	for (int k = 0; k < 4; k++) {
+		int d = HEX_TABLE.v[static_cast<unsigned char>(p[k])];
+		if (d < 0) return false;
+		value = (value << 4) | d;
 	}
+	return true;
 }
 
-Json JsonParser::parseNull()
+//========================JsonProjection=======================================
+JsonProjection::JsonProjection(std::initializer_list<std::string> pointers)
 {
-	_i--;
-	assert(_parse_string[_i] == 'n' && _parse_state == Json::PARSE_OK);
-	if (_parse_string.substr(_i, 4) == "null") {
-		_i += 4;
-		return Json(Json::NUL, Json::PARSE_OK);
+	for (const std::string &pointer : pointers) {
+		bool ok = add(pointer);
+		assert(ok);
+		(void)ok;
 	}
-	else {
-		return Json(Json::NUL, Json::PARSE_INVALID_VALUE);
+}
+
+bool JsonProjection::add(const std::string & pointer)
+{
+	if (!pointer.empty() && pointer[0] != '/') return false;
+	// validate before touching the tree, ~ must be followed by 0 or 1
+	for (size_t i = 0; i < pointer.size(); i++) {
+		if (pointer[i] == '~' && (i + 1 == pointer.size() || (pointer[i + 1] != '0' && pointer[i + 1] != '1'))) {
+			return false;
+		}
+	}
+	Node *node = &_root;
+	std::string token;
+	for (size_t i = 1; i <= pointer.size(); i++) {
+		if (i == pointer.size() || pointer[i] == '/') {
+			node = &node->children[token];
+			token.clear();
+		}
+		else if (pointer[i] == '~') {
+			token += pointer[++i] == '0' ? '~' : '/';
+		}
+		else {
+			token += pointer[i];
+		}
 	}
+	node->keep_all = true;
+	return true;
 }
 
-Json JsonParser::parseBoolean()
+const JsonProjection::Node & JsonProjection::root() const
 {
-	_i--;
-	assert((_parse_string[_i] == 't' || _parse_string[_i] == 'f')
-		&& _parse_state == Json::PARSE_OK);
-	if (_parse_string.substr(_i, 4) == "true") {
-		_i += 4;
-		return Json(true);
+	return _root;
+}
+
+//========================JsonParser===========================================
+JsonParser::JsonParser(const std::string & _str, const ParseOptions & _options)
+	:_parse_string(_str), _options(_options)
+{
+	const ParseLimits &limits = _options.limits;
+	if (limits.yield || limits.deadline != std::chrono::steady_clock::time_point::max()) {
+		_next_check = limits.check_interval;
 	}
-	else if (_parse_string.substr(_i, 5) == "false") {
-		_i += 5;
-		return Json(false);
+	if (_str.size() > limits.max_input) {
+		failLimit(Json::PARSE_INPUT_TOO_LARGE);
+		_limit_offset = limits.max_input;
 	}
-	else {
-		return Json(Json::NUL, Json::PARSE_INVALID_VALUE);
+}
+
+Json JsonParser::parse()
+{
+	char ch = nextToken();
+	if (_parse_state == Json::PARSE_OK) {
+		Json j = parseValue(ch);
+		if (_parse_state == Json::PARSE_OK && atEnd()) return j;
+		setState(Json::PARSE_ROOT_NOT_SINGULAR);
 	}
+	return Json(Json::NUL, finish());
 }
 
-Json JsonParser::parseNumber()
+void JsonParser::parseInto(Json & target)
 {
+	char ch = nextToken();
+	if (_parse_state == Json::PARSE_OK && parseValueInto(ch, target) && !atEnd()) {
+		_parse_state = Json::PARSE_ROOT_NOT_SINGULAR;
+	}
+	if (finish() != Json::PARSE_OK) {
+		target = Json(Json::NUL, state());
+	}
+}
 
-	/*
-	number = ["-"] int [frac] [exp]
-	int = "0" / digit1-9(digit)+
-	frac = "." (digit)+
-	exp = ("e" / "E")["-" / "+"] (digit)+
-	*/
-	_i--;
-	size_t idx = _i;
-	// ["-"]
-	if (_parse_string[idx] == '-') idx++;
-	// int
-	if (_parse_string[idx] == '0') idx++;
-	else {
-		if (!inRange(_parse_string[idx], '1', '9')) {
-			return Json(Json::NUL, Json::PARSE_INVALID_VALUE);
+Json JsonParser::parseValue(char ch)
+{
+	// open containers, innermost last, with the key of the member being parsed
+	struct Frame {
+		Json json;
+		std::string key;
+		const JsonProjection::Node *proj;
+	};
+	std::vector<Frame> stack;
+	std::string_view sv;
+	Json value;
+	// projection of the value being parsed, nullptr keeps all of it
+	const JsonProjection::Node *node = rootProjection();
+	const JsonProjection::Node *child;
+	while (true) {
+		// ch starts a value
+		if (_parse_state != Json::PARSE_OK) return Json(Json::NUL, _parse_state);
+		switch (ch)
+		{
+		case 'n':
+			if (!parseLiteral("null")) return Json(Json::NUL, _parse_state);
+			value = Json();
+			break;
+		case 't':
+			if (!parseLiteral("true")) return Json(Json::NUL, _parse_state);
+			value = true;
+			break;
+		case 'f':
+			if (!parseLiteral("false")) return Json(Json::NUL, _parse_state);
+			value = false;
+			break;
+		case '"':
+			if (!parseRawStringView(sv, _string_buf)) return Json(Json::NUL, _parse_state);
+			value = Json(std::string(sv));
+			break;
+		case '[':
+			if (!enterDepth()) return Json(Json::NUL, _parse_state);
+			ch = nextToken();
+			if (ch == ']') {
+				leaveDepth();
+				value = Json::Array();
+				break;
+			}
+			if (_options.pack_numbers) {
+				value = Json::Array();
+				value.destroyUnion();
+				new(&value._numbers) std::vector<double>();
+				value._packed = true;
+				if (parseNumberRun(ch, value._numbers)) {
+					leaveDepth();
+					break;
+				}
+				if (_parse_state != Json::PARSE_OK) return Json(Json::NUL, _parse_state);
+				// ch starts an element which is not a number
+				value.unpackArray();
+				stack.push_back(Frame{ std::move(value), std::string(), node });
+				continue;
+			}
+			stack.push_back(Frame{ Json::Array(), std::string(), node });
+			continue;
+		case '{':
+			if (!enterDepth()) return Json(Json::NUL, _parse_state);
+			ch = nextToken();
+			if (ch == '}') {
+				leaveDepth();
+				value = Json::Object();
+				break;
+			}
+			if (!parseMember(ch, node, sv, child)) {
+				if (_parse_state != Json::PARSE_OK) return Json(Json::NUL, _parse_state);
+				leaveDepth();	// every member was projected out
+				value = Json::Object();
+				break;
+			}
+			stack.push_back(Frame{ Json::Object(), std::string(sv), node });
+			node = child;
+			continue;
+		default:
+			if (!parseNumberInto(value)) return Json(Json::NUL, _parse_state);
+			break;
 		}
-		for (idx++; inRange(_parse_string[idx], '0', '9'); idx++);
-	}
-	// [frac]
-	if (_parse_string[idx] == '.') {
-		idx++;
-		if (!inRange(_parse_string[idx], '0', '9')) {
-			return Json(Json::NUL, Json::PARSE_INVALID_VALUE);
+
+		// value is complete, add it to its container and close every
+		// container which ends right after it
+		while (!stack.empty()) {
+			Frame &top = stack.back();
+			if (top.json._type == Json::ARRAY) {
+				top.json._array.push_back(std::move(value));
+				ch = nextToken();
+				if (ch == ',') {
+					ch = nextToken();
+					node = top.proj;
+					break;
+				}
+				if (ch != ']') {
+					_parse_state = Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+					return Json(Json::NUL, _parse_state);
+				}
+			}
+			else {
+				top.json._object[std::move(top.key)] = std::move(value);
+				ch = nextToken();
+				if (ch == ',') {
+					ch = nextToken();
+					if (parseMember(ch, top.proj, sv, node)) {
+						top.key.assign(sv.data(), sv.size());
+						break;
+					}
+					if (_parse_state != Json::PARSE_OK) return Json(Json::NUL, _parse_state);
+				}
+				else if (ch != '}') {
+					_parse_state = Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+					return Json(Json::NUL, _parse_state);
+				}
+			}
+			leaveDepth();
+			value = std::move(top.json);
+			stack.pop_back();
 		}
-		for (idx++; inRange(_parse_string[idx], '0', '9'); idx++);
-	}
-	// [exp]
-	if (_parse_string[idx] == 'e' || _parse_string[idx] == 'E') {
-		idx++;
-		if (_parse_string[idx] == '-' || _parse_string[idx] == '+') idx++;
-		if (!inRange(_parse_string[idx], '0', '9')) {
-			return Json(Json::NUL, Json::PARSE_INVALID_VALUE);
+		if (stack.empty()) {
+			return value;
 		}
-		for (idx++; inRange(_parse_string[idx], '0', '9'); idx++);
 	}
+}
 
-	
-	errno = 0;
-	double n = strtod(_parse_string.substr(_i).c_str(), NULL);
-	if (errno == ERANGE && (n == HUGE_VAL || n == -HUGE_VAL)) {
-		return Json(Json::NUL, Json::PARSE_NUMBER_TOO_BIG);
+bool JsonParser::parseValueInto(char ch, Json & target)
+{
+	// open containers, innermost last, with the number of elements or
+	// distinct keys written so far
+	struct Frame {
+		Json *json;
+		size_t count;
+		const JsonProjection::Node *proj;
+	};
+	std::vector<Frame> stack;
+	stack.reserve(16);
+	auto element_at = [](Json::Array &a, size_t i) -> Json & {
+		if (i < a.size()) return a[i];
+		a.emplace_back();
+		return a.back();
+	};
+	auto member_at = [](Frame &f, std::string_view key) -> Json & {
+		Json::Object &o = f.json->_object;
+		auto it = o.find(key);
+		if (it == o.end()) {
+			f.count++;
+			return o.emplace_hint(it, std::string(key), Json())->second;
+		}
+		if (it->second._parse_mark) {	// else a duplicate key, the last one wins
+			it->second._parse_mark = false;
+			f.count++;
+		}
+		return it->second;
+	};
+	std::string_view sv;
+	Json *value = &target;
+	const JsonProjection::Node *node = rootProjection();
+	const JsonProjection::Node *child;
+	while (true) {
+		// ch starts a value
+		if (_parse_state != Json::PARSE_OK) return false;
+		switch (ch)
+		{
+		case 'n':
+			if (!parseLiteral("null")) return false;
+			reuseAs(*value, Json::NUL);
+			break;
+		case 't':
+			if (!parseLiteral("true")) return false;
+			reuseAs(*value, Json::BOOLEAN);
+			value->_boolean = true;
+			break;
+		case 'f':
+			if (!parseLiteral("false")) return false;
+			reuseAs(*value, Json::BOOLEAN);
+			value->_boolean = false;
+			break;
+		case '"':
+			if (!parseRawStringView(sv, _string_buf)) return false;
+			reuseAs(*value, Json::STRING);
+			value->_string.assign(sv.data(), sv.size());
+			break;
+		case '[':
+			if (!enterDepth()) return false;
+			ch = nextToken();
+			// an array which was mixed last time is likely mixed again,
+			// keep its elements for reuse rather than trying to pack
+			if (_options.pack_numbers && ch != ']'
+				&& !(value->_type == Json::ARRAY && !value->_packed && !value->_array.empty())) {
+				if (value->_type == Json::ARRAY && value->_packed) {
+					value->_numbers.clear();
+				}
+				else {
+					value->destroyUnion();
+					new(&value->_numbers) std::vector<double>();
+					value->_type = Json::ARRAY;
+					value->_packed = true;
+				}
+				value->_state = Json::PARSE_OK;
+				value->invalidateCache();
+				if (parseNumberRun(ch, value->_numbers)) {
+					leaveDepth();
+					break;
+				}
+				if (_parse_state != Json::PARSE_OK) return false;
+				// ch starts an element which is not a number
+				value->unpackArray();
+				size_t count = value->_array.size();
+				stack.push_back(Frame{ value, count + 1, node });
+				value = &element_at(value->_array, count);
+				continue;
+			}
+			reuseAs(*value, Json::ARRAY);
+			if (ch == ']') {
+				leaveDepth();
+				value->_array.clear();
+				break;
+			}
+			stack.push_back(Frame{ value, 1, node });
+			value = &element_at(value->_array, 0);
+			continue;
+		case '{':
+			if (!enterDepth()) return false;
+			reuseAs(*value, Json::OBJECT);
+			ch = nextToken();
+			if (ch == '}') {
+				leaveDepth();
+				value->_object.clear();
+				break;
+			}
+			if (!parseMember(ch, node, sv, child)) {
+				if (_parse_state != Json::PARSE_OK) return false;
+				leaveDepth();	// every member was projected out
+				value->_object.clear();
+				break;
+			}
+			for (auto &kv : value->_object) {
+				kv.second._parse_mark = true;
+			}
+			stack.push_back(Frame{ value, 0, node });
+			value = &member_at(stack.back(), sv);
+			node = child;
+			continue;
+		default:
+			if (!parseNumberInto(*value)) return false;
+			break;
+		}
+
+		// value is complete, close every container which ends right after it
+		while (!stack.empty()) {
+			Frame &top = stack.back();
+			Json &container = *top.json;
+			ch = nextToken();
+			if (container._type == Json::ARRAY) {
+				if (ch == ',') {
+					ch = nextToken();
+					value = &element_at(container._array, top.count++);
+					node = top.proj;
+					break;
+				}
+				if (ch != ']') {
+					_parse_state = Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+					return false;
+				}
+				container._array.erase(container._array.begin() + top.count, container._array.end());
+			}
+			else {
+				if (ch == ',') {
+					ch = nextToken();
+					if (parseMember(ch, top.proj, sv, node)) {
+						value = &member_at(top, sv);
+						break;
+					}
+					if (_parse_state != Json::PARSE_OK) return false;
+				}
+				else if (ch != '}') {
+					_parse_state = Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+					return false;
+				}
+				// members whose key did not come back are still marked
+				if (top.count != container._object.size()) {
+					for (auto it = container._object.begin(); it != container._object.end();) {
+						if (it->second._parse_mark) it = container._object.erase(it);
+						else ++it;
+					}
+				}
+			}
+			leaveDepth();
+			stack.pop_back();
+		}
+		if (stack.empty()) {
+			return true;
+		}
 	}
-	_i = idx;
-	return Json(n);
 }
 
+bool JsonParser::parseNumberRun(char & ch, std::vector<double> & numbers)
+{
+	while (ch == '-' || inRange(ch, '0', '9')) {
+		double n;
+		if (!parseRawNumber(n)) return false;
+		numbers.push_back(n);
+		ch = nextToken();
+		if (ch == ']') return true;
+		if (ch != ',') {
+			_parse_state = Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+			return false;
+		}
+		ch = nextToken();
+	}
+	return false;
+}
 
-Json JsonParser::parseString()
+void JsonParser::reuseAs(Json & j, Json::Type type)
 {
-	std::string res = parseRawString();
-	if (_parse_state != Json::PARSE_OK) {
-		return Json(Json::NUL, _parse_state);
+	j._state = Json::PARSE_OK;
+	j.invalidateCache();
+	if (j._type == type && !j._packed && !j._raw) {
+		return;
+	}
+	j.destroyUnion();
+	switch (type)
+	{
+	case Json::STRING: new(&j._string) std::string(); break;
+	case Json::ARRAY: new(&j._array) Json::Array(); break;
+	case Json::OBJECT: new(&j._object) Json::Object(); break;
+	default: break;
 	}
-	return Json(res);
+	j._type = type;
 }
 
+bool JsonParser::parseKey(char ch, std::string_view & key)
+{
+	if (ch != '"') {
+		_parse_state = Json::PARSE_MISS_KEY;
+		return false;
+	}
+	if (!parseRawStringView(key, _string_buf)) return false;
+	if (nextToken() != ':') {
+		_parse_state = Json::PARSE_MISS_COLON;
+		return false;
+	}
+	return true;
+}
 
-Json JsonParser::parseArray()
+Json::State JsonParser::parseEvents(JsonHandler & handler)
 {
-	std::vector<Json> arr;
 	char ch = nextToken();
-	if (ch == ']') return arr;
-
+	if (_parse_state == Json::PARSE_OK && parseEvents(ch, handler) && !atEnd()) {
+		_parse_state = Json::PARSE_ROOT_NOT_SINGULAR;
+	}
+	return finish();
+}
+
+bool JsonParser::parseEvents(char ch, JsonHandler & handler)
+{
+	// open containers, innermost last
+	struct Frame {
+		bool object;
+		const JsonProjection::Node *proj;
+	};
+	std::vector<Frame> stack;
+	std::string_view sv;
+	const JsonProjection::Node *node = rootProjection();
+	const JsonProjection::Node *child;
+	auto aborted = [this]() {
+		_parse_state = Json::PARSE_ABORTED;
+		return false;
+	};
 	while (true) {
-		_i--;
-		Json elem = parseValue();
-		if (elem.state() != Json::PARSE_OK) {
-			return elem;
+		// ch starts a value
+		if (_parse_state != Json::PARSE_OK) return false;
+		switch (ch)
+		{
+		case 'n':
+			if (!parseLiteral("null")) return false;
+			if (!handler.null()) return aborted();
+			break;
+		case 't':
+			if (!parseLiteral("true")) return false;
+			if (!handler.boolean(true)) return aborted();
+			break;
+		case 'f':
+			if (!parseLiteral("false")) return false;
+			if (!handler.boolean(false)) return aborted();
+			break;
+		case '"':
+			if (!parseRawStringView(sv, _string_buf)) return false;
+			if (!handler.string(sv)) return aborted();
+			break;
+		case '[':
+			if (!enterDepth()) return false;
+			if (!handler.startArray()) return aborted();
+			ch = nextToken();
+			if (ch == ']') {
+				leaveDepth();
+				if (!handler.endArray()) return aborted();
+				break;
+			}
+			stack.push_back(Frame{ false, node });
+			continue;
+		case '{':
+			if (!enterDepth()) return false;
+			if (!handler.startObject()) return aborted();
+			ch = nextToken();
+			if (ch != '}' && parseMember(ch, node, sv, child)) {
+				if (!handler.key(sv)) return aborted();
+				stack.push_back(Frame{ true, node });
+				node = child;
+				continue;
+			}
+			if (_parse_state != Json::PARSE_OK) return false;
+			leaveDepth();
+			if (!handler.endObject()) return aborted();
+			break;
+		default: {
+				size_t begin, end;
+				double n;
+				if (!scanNumber(begin, end) || !convertNumber(begin, n)) return false;
+				if (!handler.rawNumber(std::string_view(_parse_string.data() + begin, end - begin), n)) {
+					return aborted();
+				}
+				break;
+			}
 		}
-		arr.push_back(elem);
 
-		ch = nextToken();
-		if (ch == ',') {
+		// value is complete, close every container which ends right after it
+		while (!stack.empty()) {
+			Frame &top = stack.back();
 			ch = nextToken();
+			if (!top.object) {
+				if (ch == ',') {
+					ch = nextToken();
+					node = top.proj;
+					break;
+				}
+				if (ch != ']') {
+					_parse_state = Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+					return false;
+				}
+				if (!handler.endArray()) return aborted();
+			}
+			else {
+				if (ch == ',') {
+					ch = nextToken();
+					if (parseMember(ch, top.proj, sv, node)) {
+						if (!handler.key(sv)) return aborted();
+						break;
+					}
+					if (_parse_state != Json::PARSE_OK) return false;
+				}
+				else if (ch != '}') {
+					_parse_state = Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+					return false;
+				}
+				if (!handler.endObject()) return aborted();
+			}
+			leaveDepth();
+			stack.pop_back();
 		}
-		else if (ch == ']') {
-			return arr;
-		}
-		else {
-			return Json(Json::NUL, Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+		if (stack.empty()) {
+			return true;
 		}
 	}
 }
 
-Json JsonParser::parseObject()
+Json::State JsonParser::transcode(std::string & out, const std::string * indent)
 {
-	std::map<std::string, Json> object;
+	out.clear();
 	char ch = nextToken();
-	if (ch == '}') return object;
+	if (_parse_state == Json::PARSE_OK) {
+		out.reserve(_parse_string.size());
+	}
+	if (_parse_state == Json::PARSE_OK && transcode(ch, out, indent) && !atEnd()) {
+		_parse_state = Json::PARSE_ROOT_NOT_SINGULAR;
+	}
+	if (finish() != Json::PARSE_OK) {
+		out.clear();
+	}
+	return state();
+}
 
-	while (true) {
+bool JsonParser::transcode(char ch, std::string & out, const std::string * indent)
+{
+	// same walk as skipValue, tokens are copied from input as they are
+	std::string stack;
+	std::string_view sv;
+	auto newline = [&]() {
+		if (indent == nullptr) return;
+		out += '\n';
+		for (size_t i = 0; i < stack.size(); i++) {
+			out += *indent;
+		}
+	};
+	// key at ch and its colon
+	auto copy_key = [&]() {
 		if (ch != '"') {
-			return Json(Json::NUL, Json::PARSE_MISS_KEY);
+			_parse_state = Json::PARSE_MISS_KEY;
+			return false;
 		}
-
-		std::string key = parseRawString();
-		if (_parse_state != Json::PARSE_OK) {
-			return Json(Json::NUL, _parse_state);
+		size_t begin = _i - 1;
+		if (!parseRawStringView(sv, _string_buf)) return false;
+		out.append(_parse_string, begin, _i - begin);
+		if (nextToken() != ':') {
+			_parse_state = Json::PARSE_MISS_COLON;
+			return false;
 		}
-		
+		out += indent ? ": " : ":";
 		ch = nextToken();
-		if (ch != ':') {
-			return Json(Json::NUL, Json::PARSE_MISS_COLON);
+		return true;
+	};
+	while (true) {
+		// ch starts a value
+		if (_parse_state != Json::PARSE_OK) return false;
+		size_t begin = _i - 1;
+		switch (ch)
+		{
+		case 'n':
+			if (!parseLiteral("null")) return false;
+			out += "null";
+			break;
+		case 't':
+			if (!parseLiteral("true")) return false;
+			out += "true";
+			break;
+		case 'f':
+			if (!parseLiteral("false")) return false;
+			out += "false";
+			break;
+		case '"':
+			if (!parseRawStringView(sv, _string_buf)) return false;
+			out.append(_parse_string, begin, _i - begin);
+			break;
+		case '[':
+		case '{': {
+				if (!enterDepth()) return false;
+				char close = ch == '[' ? ']' : '}';
+				out += ch;
+				char open = ch;
+				ch = nextToken();
+				if (ch == close) {
+					leaveDepth();
+					out += close;
+					break;
+				}
+				stack.push_back(open);
+				newline();
+				if (open == '{' && !copy_key()) return false;
+				continue;
+			}
+		default: {
+				size_t end;
+				if (!scanNumber(begin, end)) return false;
+				out.append(_parse_string, begin, end - begin);
+				break;
+			}
 		}
-		
-		auto value = parseValue();
-		if (_parse_state != Json::PARSE_OK) {
-			return Json(Json::NUL, _parse_state);
+
+		while (!stack.empty()) {
+			ch = nextToken();
+			if (ch == ',') {
+				out += ',';
+				newline();
+				ch = nextToken();
+				if (stack.back() == '{' && !copy_key()) return false;
+				break;
+			}
+			if (stack.back() == '[' && ch != ']') {
+				_parse_state = Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+				return false;
+			}
+			if (stack.back() == '{' && ch != '}') {
+				_parse_state = Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+				return false;
+			}
+			leaveDepth();
+			stack.pop_back();
+			newline();
+			out += ch;
+		}
+		if (stack.empty()) {
+			return true;
 		}
-		object[std::move(key)] = std::move(value);
+	}
+}
 
-		ch = nextToken();
-		if (ch == ',') {
+bool JsonParser::parseMember(char & ch, const JsonProjection::Node * node, std::string_view & key,
+	const JsonProjection::Node *& child)
+{
+	while (true) {
+		if (!parseKey(ch, key)) return false;
+		if (node == nullptr) {
+			child = nullptr;
 			ch = nextToken();
+			return true;
 		}
-		else if (ch == '}') {
-			break;
+		auto it = node->children.find(key);
+		if (it != node->children.end()) {
+			child = it->second.keep_all ? nullptr : &it->second;
+			ch = nextToken();
+			return true;
 		}
-		else {
-			return Json(Json::NUL, Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+		if (!skipValue(nextToken())) return false;
+		ch = nextToken();
+		if (ch == '}') return false;
+		if (ch != ',') {
+			_parse_state = Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+			return false;
 		}
+		ch = nextToken();
+	}
+}
+
+const JsonProjection::Node * JsonParser::rootProjection() const
+{
+	if (_options.projection == nullptr || _options.projection->root().keep_all) {
+		return nullptr;
+	}
+	return &_options.projection->root();
+}
+
+bool JsonParser::enterDepth()
+{
+	if (_depth >= _options.max_depth) {
+		setState(Json::PARSE_DEPTH_EXCEEDED);
+		return false;
 	}
-	return object;
+	_depth++;
+	if (_members.size() < _depth) _members.push_back(0);
+	else _members[_depth - 1] = 0;
+	return true;
+}
+
+void JsonParser::leaveDepth()
+{
+	_depth--;
 }
 
 std::string JsonParser::parseRawString()
 {
-	std::string res = "";
+	std::string res;
+	size_t begin = _i;
+	unsigned char high = 0;	// bit 7 set if any raw byte is non-ASCII
+
+	// escapes never decode to more bytes than they take, so the raw length
+	// up to the closing quote bounds the result
+	size_t end = begin;
 	while (true) {
-		char ch = _parse_string[_i++];
+		end = scanStringRun(_parse_string, end, high);
+		if (_parse_string[end] != '\\' || _parse_string[end + 1] == '\0') break;
+		end += 2;
+	}
+	// a limit fails the parse before the string outgrows it
+	size_t room = stringRoom();
+	res.reserve(std::min(end - begin, room));
+
+	while (true) {
+		size_t run = scanStringRun(_parse_string, _i, high);
+		if (run - _i > room - res.size()) {
+			failString(res.size() + (run - _i));
+			return "";
+		}
+		res.append(_parse_string, _i, run - _i);
+		_i = run + 1;
+		char ch = _parse_string[run];
 		switch (ch)
 		{
 		case '"':
-			return res;	//??Json(std::move(res))
+			// escapes are ASCII, so checking the raw input covers every non-ASCII byte
+			if (_options.validate_utf8 && (high & 0x80)
+				&& !validateUtf8(_parse_string.data() + begin, run - begin)) {
+				_parse_state = Json::PARSE_INVALID_UTF8;
+				return "";
+			}
+			if (!countString(res.size())) return "";
+			return res;
 		case '\\':
 			switch (_parse_string[_i++])
 			{
@@ -271,39 +1076,23 @@ std::string JsonParser::parseRawString()
 			case 'r':	res += '\r'; break;
 			case 't':	res += '\t'; break;
 			case 'u':	{
-					std::string hex4 = _parse_string.substr(_i, 4);
-					auto is_hex4 = [&](const std::string &hex) {
-						for (size_t j = 0; j < 4; j++) {
-							if (!inRange(hex[j], 'a', 'f')
-								&& !inRange(hex[j], 'A', 'F')
-								&& !inRange(hex[j], '0', '9')) {
-								return false;
-							}
-						}
-						return true;
-					};
-					
-					if (!is_hex4(hex4)) {
+					long codepoint;
+					if (!parseHex4(_parse_string.data() + _i, codepoint)) {
 						_parse_state = Json::PARSE_INVALID_UNICODE_HEX;
 						return "";
 					}
-					long codepoint = strtol(hex4.c_str(), nullptr, 16);
 					_i += 4;
 					if (inRange(codepoint, 0xD800, 0xDBFF)) { // surrogate pair
-						if (_parse_string[_i++] != '\\') {
-							_parse_state = Json::PARSE_INVALID_UNICODE_SURROGATE;
-							return "";
-						}
-						if (_parse_string[_i++] != 'u') {
+						if (_parse_string[_i] != '\\' || _parse_string[_i + 1] != 'u') {
 							_parse_state = Json::PARSE_INVALID_UNICODE_SURROGATE;
 							return "";
 						}
-						hex4 = _parse_string.substr(_i, 4);
-						if (!is_hex4(hex4)) {
+						_i += 2;
+						long low;
+						if (!parseHex4(_parse_string.data() + _i, low)) {
 							_parse_state = Json::PARSE_INVALID_UNICODE_HEX;
 							return "";
 						}
-						long low = strtol(hex4.c_str(), nullptr, 16);
 						_i += 4;
 						if (!inRange(low, 0xDC00, 0xDFFF)) {
 							_parse_state = Json::PARSE_INVALID_UNICODE_SURROGATE;
@@ -311,6 +1100,11 @@ std::string JsonParser::parseRawString()
 						}
 						codepoint = (((codepoint - 0xD800) << 10) | (low - 0xDC00)) + 0x10000;
 					}
+					else if (_options.validate_utf8 && inRange(codepoint, 0xDC00, 0xDFFF)) {
+						// a lone low surrogate would encode as ill-formed UTF-8
+						_parse_state = Json::PARSE_INVALID_UNICODE_SURROGATE;
+						return "";
+					}
 					encode_utf8(codepoint, res);
 				}
 				break;
@@ -318,39 +1112,370 @@ std::string JsonParser::parseRawString()
 				_parse_state = Json::PARSE_INVALID_STRING_ESCAPE;
 				return "";
 			}
+			if (res.size() > room) {
+				failString(res.size());
+				return "";
+			}
 			break;
 		case '\0':
 			_parse_state = Json::PARSE_MISS_QUOTATION_MARK;
 			return "";
 		default:
-			if ((unsigned char)ch < 0x20) {
-				_parse_state = Json::PARSE_INVALID_STRING_CHAR;
-				return "";
-			}
-			res += ch;
+			_parse_state = Json::PARSE_INVALID_STRING_CHAR;
+			return "";
+		}
+	}
+}
+
+bool JsonParser::parseRawStringView(std::string_view & sv, std::string & buf)
+{
+	// fast path: no escape before the closing quote, point into input
+	unsigned char high = 0;
+	size_t j = scanStringRun(_parse_string, _i, high);
+	if (_parse_string[j] == '"') {
+		sv = std::string_view(_parse_string.data() + _i, j - _i);
+		if (_options.validate_utf8 && (high & 0x80) && !validateUtf8(sv.data(), sv.size())) {
+			_parse_state = Json::PARSE_INVALID_UTF8;
+			return false;
+		}
+		if (!countString(sv.size())) return false;
+		_i = j + 1;
+		return true;
+	}
+	buf = parseRawString();
+	sv = buf;
+	return _parse_state == Json::PARSE_OK;
+}
+
+bool JsonParser::scanNumber(size_t & begin, size_t & end)
+{
+	/*
+	number = ["-"] int [frac] [exp]
+	int = "0" / digit1-9(digit)+
+	frac = "." (digit)+
+	exp = ("e" / "E")["-" / "+"] (digit)+
+	*/
+	_i--;
+	size_t idx = _i;
+	// ["-"]
+	if (_parse_string[idx] == '-') idx++;
+	// int
+	if (_parse_string[idx] == '0') idx++;
+	else {
+		if (!inRange(_parse_string[idx], '1', '9')) {
+			_parse_state = Json::PARSE_INVALID_VALUE;
+			return false;
+		}
+		for (idx++; inRange(_parse_string[idx], '0', '9'); idx++);
+	}
+	// [frac]
+	if (_parse_string[idx] == '.') {
+		idx++;
+		if (!inRange(_parse_string[idx], '0', '9')) {
+			_parse_state = Json::PARSE_INVALID_VALUE;
+			return false;
+		}
+		for (idx++; inRange(_parse_string[idx], '0', '9'); idx++);
+	}
+	// [exp]
+	if (_parse_string[idx] == 'e' || _parse_string[idx] == 'E') {
+		idx++;
+		if (_parse_string[idx] == '-' || _parse_string[idx] == '+') idx++;
+		if (!inRange(_parse_string[idx], '0', '9')) {
+			_parse_state = Json::PARSE_INVALID_VALUE;
+			return false;
+		}
+		for (idx++; inRange(_parse_string[idx], '0', '9'); idx++);
+	}
+	begin = _i;
+	end = idx;
+	_i = idx;
+	return true;
+}
+
+bool JsonParser::parseRawNumber(double & n)
+{
+	size_t begin, end;
+	if (!scanNumber(begin, end)) {
+		return false;
+	}
+	return convertNumber(begin, n);
+}
+
+bool JsonParser::parseNumberInto(Json & j)
+{
+	size_t begin, end;
+	if (!scanNumber(begin, end)) {
+		return false;
+	}
+	std::string_view text(_parse_string.data() + begin, end - begin);
+	std::uint64_t bits = Json::RawNumber::NOT_CONVERTED;
+	// only an exponent or a very long integer part can be out of range
+	if (!_options.lazy_numbers || text.size() > 300 || text.find_first_of("eE") != std::string_view::npos) {
+		double n;
+		if (!convertNumber(begin, n)) return false;
+		if (!_options.lazy_numbers) {
+			reuseAs(j, Json::NUMBER);
+			j._number = n;
+			return true;
+		}
+		std::memcpy(&bits, &n, sizeof(n));
+	}
+	if (j._type == Json::NUMBER && j._raw) {
+		j._raw_number.text.assign(text.data(), text.size());
+		j._raw_number.bits.store(bits, std::memory_order_relaxed);
+	}
+	else {
+		j.destroyUnion();
+		new(&j._raw_number) Json::RawNumber(text, bits);
+		j._type = Json::NUMBER;
+		j._raw = true;
+	}
+	j._state = Json::PARSE_OK;
+	j.invalidateCache();
+	return true;
+}
+
+bool JsonParser::convertNumber(size_t begin, double & n)
+{
+	// input is validated and NUL terminated, strtod stops right at end
+	errno = 0;
+	n = strtod(_parse_string.c_str() + begin, NULL);
+	if (errno == ERANGE && (n == HUGE_VAL || n == -HUGE_VAL)) {
+		_parse_state = Json::PARSE_NUMBER_TOO_BIG;
+		return false;
+	}
+	return true;
+}
+
+bool JsonParser::parseLiteral(const char * lit)
+{
+	size_t n = strlen(lit);
+	_i--;
+	if (_parse_string.compare(_i, n, lit) != 0) {
+		_parse_state = Json::PARSE_INVALID_VALUE;
+		return false;
+	}
+	_i += n;
+	return true;
+}
+
+bool JsonParser::skipValue(char ch)
+{
+	// same walk as parseValue without building anything, _skip_stack
+	// holds the open containers as '[' or '{'
+	std::string_view sv;
+	_skip_stack.clear();
+	while (true) {
+		if (_parse_state != Json::PARSE_OK) return false;
+		switch (ch)
+		{
+		case 'n':
+			if (!parseLiteral("null")) return false;
+			break;
+		case 't':
+			if (!parseLiteral("true")) return false;
 			break;
+		case 'f':
+			if (!parseLiteral("false")) return false;
+			break;
+		case '"':
+			if (!parseRawStringView(sv, _string_buf)) return false;
+			break;
+		case '[':
+			if (!enterDepth()) return false;
+			ch = nextToken();
+			if (ch == ']') {
+				leaveDepth();
+				break;
+			}
+			_skip_stack.push_back('[');
+			continue;
+		case '{':
+			if (!enterDepth()) return false;
+			ch = nextToken();
+			if (ch == '}') {
+				leaveDepth();
+				break;
+			}
+			if (!parseKey(ch, sv)) return false;
+			_skip_stack.push_back('{');
+			ch = nextToken();
+			continue;
+		default: {
+				size_t begin, end;
+				if (!scanNumber(begin, end)) return false;
+				break;
+			}
 		}
+
+		while (!_skip_stack.empty()) {
+			ch = nextToken();
+			if (ch == ',') {
+				ch = nextToken();
+				if (_skip_stack.back() == '{') {
+					if (!parseKey(ch, sv)) return false;
+					ch = nextToken();
+				}
+				break;
+			}
+			if (_skip_stack.back() == '[' && ch != ']') {
+				_parse_state = Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+				return false;
+			}
+			if (_skip_stack.back() == '{' && ch != '}') {
+				_parse_state = Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+				return false;
+			}
+			leaveDepth();
+			_skip_stack.pop_back();
+		}
+		if (_skip_stack.empty()) {
+			return true;
+		}
+	}
+}
+
+bool JsonParser::atEnd()
+{
+	consumeWhitespace();
+	return _i == _parse_string.size();
+}
+
+Json::State JsonParser::state() const
+{
+	return _limit_state != Json::PARSE_OK ? _limit_state : _parse_state;
+}
+
+void JsonParser::setState(Json::State s)
+{
+	// keep the first error
+	if (_parse_state == Json::PARSE_OK) {
+		_parse_state = s;
+	}
+}
+
+Json::State JsonParser::finish()
+{
+	Json::State s = state();
+	if (s != Json::PARSE_OK && _options.error_offset != nullptr) {
+		*_options.error_offset = _limit_state != Json::PARSE_OK ? _limit_offset
+			: std::min(_i, _parse_string.size());
+	}
+	return s;
+}
+
+size_t JsonParser::position() const
+{
+	return _i;
+}
+
+const std::string & JsonParser::input() const
+{
+	return _parse_string;
+}
+
+char JsonParser::nextToken()
+{
+	consumeWhitespace();
+	if (_parse_state != Json::PARSE_OK) return 0;
+	if (_i == _parse_string.size()) {
+		_parse_state = Json::PARSE_EXPECT_VALUE;
+		return 0;
+	}
+	char ch = _parse_string[_i++];
+	return countToken(ch) ? ch : 0;
+}
+
+bool JsonParser::countToken(char ch)
+{
+	const ParseLimits &limits = _options.limits;
+	// every token but punctuation starts a value, except a key, which the
+	// colon after it takes back
+	switch (ch)
+	{
+	case ',':
+		if (_depth > 0 && ++_members[_depth - 1] >= limits.max_members) {
+			return failLimit(Json::PARSE_TOO_MANY_MEMBERS);
+		}
+		break;
+	case ':':
+		_nodes--;
+		_memory += 4 * sizeof(void *) + sizeof(std::string) - sizeof(Json);	// map node and key
+		break;
+	case ']':
+	case '}':
+		break;
+	case '"':
+		// may be a key, so it is checked at the next token
+		_nodes++;
+		_memory += sizeof(Json);
+		return _i < _next_check || checkBudget();
+	default:
+		_nodes++;
+		_memory += sizeof(Json);
+		break;
+	}
+	if (_nodes > limits.max_nodes) {
+		return failLimit(Json::PARSE_TOO_MANY_NODES);
+	}
+	if (_memory > limits.max_memory) {
+		return failLimit(Json::PARSE_MEMORY_EXCEEDED);
+	}
+	return _i < _next_check || checkBudget();
+}
+
+bool JsonParser::countString(size_t n)
+{
+	if (n > _options.limits.max_string) {
+		return failLimit(Json::PARSE_STRING_TOO_LONG);
+	}
+	_memory += n;
+	return true;
+}
+
+size_t JsonParser::stringRoom() const
+{
+	const ParseLimits &limits = _options.limits;
+	// _memory holds a node for the string, a key swaps it for a map node
+	// and the key, so allow for the smaller of the two
+	size_t used = _memory - std::min(_memory, sizeof(Json));
+	size_t memory = limits.max_memory - std::min(used, limits.max_memory);
+	return std::min(limits.max_string, memory);
+}
+
+bool JsonParser::failString(size_t n)
+{
+	return failLimit(n > _options.limits.max_string ? Json::PARSE_STRING_TOO_LONG : Json::PARSE_MEMORY_EXCEEDED);
+}
+
+bool JsonParser::checkBudget()
+{
+	const ParseLimits &limits = _options.limits;
+	_next_check = _i + limits.check_interval;
+	if (std::chrono::steady_clock::now() >= limits.deadline) {
+		return failLimit(Json::PARSE_TIMEOUT);
+	}
+	if (limits.yield && !limits.yield(_i)) {
+		return failLimit(Json::PARSE_ABORTED);
 	}
+	return true;
 }
 
-char JsonParser::nextToken()
+bool JsonParser::failLimit(Json::State s)
 {
-	consumeWhitespace();
-	if (_parse_state != Json::PARSE_OK) return 0;
-	if (_i == _parse_string.size()) {
-		_parse_state = Json::PARSE_EXPECT_VALUE;
-		return 0;
+	if (_limit_state == Json::PARSE_OK) {
+		_limit_state = s;
+		_limit_offset = _i;
 	}
-	return _parse_string[_i++];
+	// stops every walker, which may then record a syntax error of its own
+	setState(s);
+	return false;
 }
 
 void JsonParser::consumeWhitespace()
 {
-	while (_parse_string[_i] == ' '
-		|| _parse_string[_i] == '\r'
-		|| _parse_string[_i] == '\t'
-		|| _parse_string[_i] == '\n')
-		_i++;
+	_i = skipWhitespace(_parse_string, _i);
 }
 
 void JsonParser::encode_utf8(long l, std::string & res)
@@ -378,10 +1503,260 @@ void JsonParser::encode_utf8(long l, std::string & res)
 }
 
 
+//========================JsonReader===========================================
+JsonReader::JsonReader(const std::string & str, const ParseOptions & options)
+	:_parser(str, options)
+{
+}
+
+bool JsonReader::next()
+{
+	if (_parser.state() != Json::PARSE_OK) return false;
+	char ch;
+	switch (_expect)
+	{
+	case ROOT:
+	case AFTER_KEY:
+		return readValue(_parser.nextToken());
+	case FIRST_ELEMENT:
+		ch = _parser.nextToken();
+		return ch == ']' ? close() : readValue(ch);
+	case FIRST_MEMBER:
+		ch = _parser.nextToken();
+		return ch == '}' ? close() : readKey(ch);
+	case AFTER_VALUE:
+		if (_stack.empty()) {
+			_expect = DONE;
+			if (!_parser.atEnd()) _parser.setState(Json::PARSE_ROOT_NOT_SINGULAR);
+			return false;
+		}
+		ch = _parser.nextToken();
+		if (ch == ',') {
+			ch = _parser.nextToken();
+			return _stack.back() == '[' ? readValue(ch) : readKey(ch);
+		}
+		if (ch == (_stack.back() == '[' ? ']' : '}')) {
+			return close();
+		}
+		_parser.setState(_stack.back() == '[' ? Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET
+			: Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+		return false;
+	default:
+		return false;
+	}
+}
+
+bool JsonReader::skipValue()
+{
+	if (_parser.state() != Json::PARSE_OK) return false;
+	if (_token == KEY && _expect == AFTER_KEY) {
+		if (!_parser.skipValue(_parser.nextToken())) return false;
+		_expect = AFTER_VALUE;
+		return true;
+	}
+	if (_expect != FIRST_ELEMENT && _expect != FIRST_MEMBER) {
+		return true;
+	}
+	// rest of the container just opened, values go through the parser's skipValue
+	bool object = _stack.back() == '{';
+	char end = object ? '}' : ']';
+	char ch = _parser.nextToken();
+	while (ch != end) {
+		if (object && !readKey(ch)) return false;
+		if (!_parser.skipValue(object ? _parser.nextToken() : ch)) return false;
+		ch = _parser.nextToken();
+		if (ch == ',') {
+			ch = _parser.nextToken();
+		}
+		else if (ch != end) {
+			_parser.setState(object ? Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET : Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+			return false;
+		}
+	}
+	return close();
+}
+
+JsonReader::Token JsonReader::token() const
+{
+	return _token;
+}
+
+std::string_view JsonReader::getString() const
+{
+	assert(_token == KEY || _token == STRING);
+	return _string;
+}
+
+double JsonReader::getNumber() const
+{
+	assert(_token == NUMBER);
+	return _number;
+}
+
+bool JsonReader::getBoolean() const
+{
+	assert(_token == BOOLEAN);
+	return _boolean;
+}
+
+size_t JsonReader::depth() const
+{
+	return _stack.size();
+}
+
+Json::State JsonReader::state() const
+{
+	return _parser.state();
+}
+
+bool JsonReader::readValue(char ch)
+{
+	if (_parser.state() != Json::PARSE_OK) return false;
+	_expect = AFTER_VALUE;
+	switch (ch)
+	{
+	case 'n':
+		_token = NUL;
+		return _parser.parseLiteral("null");
+	case 't':
+		_token = BOOLEAN;
+		_boolean = true;
+		return _parser.parseLiteral("true");
+	case 'f':
+		_token = BOOLEAN;
+		_boolean = false;
+		return _parser.parseLiteral("false");
+	case '"':
+		_token = STRING;
+		return _parser.parseRawStringView(_string, _string_buf);
+	case '[':
+	case '{':
+		if (!_parser.enterDepth()) return false;
+		_token = ch == '[' ? START_ARRAY : START_OBJECT;
+		_expect = ch == '[' ? FIRST_ELEMENT : FIRST_MEMBER;
+		_stack.push_back(ch);
+		return true;
+	default:
+		_token = NUMBER;
+		return _parser.parseRawNumber(_number);
+	}
+}
+
+bool JsonReader::readKey(char ch)
+{
+	if (_parser.state() != Json::PARSE_OK) return false;
+	if (ch != '"') {
+		_parser.setState(Json::PARSE_MISS_KEY);
+		return false;
+	}
+	if (!_parser.parseRawStringView(_string, _string_buf)) return false;
+	if (_parser.nextToken() != ':') {
+		_parser.setState(Json::PARSE_MISS_COLON);
+		return false;
+	}
+	_token = KEY;
+	_expect = AFTER_KEY;
+	return true;
+}
+
+bool JsonReader::close()
+{
+	_parser.leaveDepth();
+	_token = _stack.back() == '[' ? END_ARRAY : END_OBJECT;
+	_stack.pop_back();
+	_expect = AFTER_VALUE;
+	return true;
+}
+
+//========================JsonBuilder==========================================
+bool JsonBuilder::null()
+{
+	return add(Json());
+}
+
+bool JsonBuilder::boolean(bool b)
+{
+	return add(Json(b));
+}
+
+bool JsonBuilder::number(double n)
+{
+	return add(Json(n));
+}
+
+bool JsonBuilder::string(std::string_view s)
+{
+	return add(Json(std::string(s)));
+}
+
+bool JsonBuilder::startArray()
+{
+	_stack.emplace_back(Json::Array());
+	return true;
+}
+
+bool JsonBuilder::endArray()
+{
+	Json value = std::move(_stack.back());
+	_stack.pop_back();
+	return add(std::move(value));
+}
+
+bool JsonBuilder::startObject()
+{
+	_stack.emplace_back(Json::Object());
+	_keys.emplace_back();
+	return true;
+}
+
+bool JsonBuilder::key(std::string_view k)
+{
+	_keys.back().assign(k.data(), k.size());
+	return true;
+}
+
+bool JsonBuilder::endObject()
+{
+	_keys.pop_back();
+	Json value = std::move(_stack.back());
+	_stack.pop_back();
+	return add(std::move(value));
+}
+
+Json & JsonBuilder::result()
+{
+	return _result;
+}
+
+bool JsonBuilder::add(Json && value)
+{
+	if (_stack.empty()) {
+		_result = std::move(value);
+	}
+	else if (_stack.back()._type == Json::ARRAY) {
+		_stack.back()._array.push_back(std::move(value));
+	}
+	else {
+		_stack.back()._object[_keys.back()] = std::move(value);
+	}
+	return true;
+}
+
 //========================Json=================================================
 Json::Json(Json::Type _t, Json::State _s)
 	:_type(_t), _state(_s)
 {
+	// an empty value of the type
+	switch (_t)
+	{
+	case Json::BOOLEAN:	_boolean = false; break;
+	case Json::NUMBER:	_number = 0; break;
+	case Json::STRING:	new(&_string) std::string(); break;
+	case Json::ARRAY:	new(&_array) Array(); break;
+	case Json::OBJECT:	new(&_object) Object(); break;
+	default:
+		break;
+	}
 }
 
 Json::Json(const bool _b)
@@ -417,16 +1792,47 @@ Json::Json(const std::vector<Json>& _a)
 	new(&_array) std::vector<Json>(_a);
 }
 
+Json::Json(const Object &_o)
+	:_type(Json::OBJECT)
+{
+	new(&_object) Object(_o);
+}
+
 Json::Json(const std::map<std::string, Json> &_o)
 	:_type(Json::OBJECT)
 {
-	new(&_object) std::map<std::string, Json>(_o);
+	new(&_object) Object(_o.begin(), _o.end());
+}
+
+Json::Json(std::string && _s)
+	:_type(Json::STRING)
+{
+	new(&_string) std::string(std::move(_s));
+}
+
+Json::Json(std::vector<Json> && _a)
+	:_type(Json::ARRAY)
+{
+	new(&_array) std::vector<Json>(std::move(_a));
+}
+
+Json::Json(Object && _o)
+	:_type(Json::OBJECT)
+{
+	new(&_object) Object(std::move(_o));
 }
 
 Json::Json(const Json & _j)
 	:_type(_j.type()), _state(_j.state())
 {
 	copyUnion(_j);
+	copyHash(_j);
+}
+
+Json::Json(Json && _j) noexcept
+	:_type(_j.type()), _state(_j.state()), _cache(std::move(_j._cache))
+{
+	moveUnion(std::move(_j));
 }
 
 Json & Json::operator=(const Json & _j)
@@ -434,15 +1840,31 @@ Json & Json::operator=(const Json & _j)
 	if (this == &_j) {
 		return *this;
 	}
+	invalidateCache();
 	destroyUnion();
 	copyUnion(_j);
 	_state = _j.state();
 	_type = _j.type();
+	copyHash(_j);
+	return *this;
+}
+
+Json & Json::operator=(Json && _j) noexcept
+{
+	if (this == &_j) {
+		return *this;
+	}
+	destroyUnion();
+	_type = _j.type();
+	_state = _j.state();
+	_cache = std::move(_j._cache);
+	moveUnion(std::move(_j));
 	return *this;
 }
 
 Json & Json::operator=(bool _b)
 {
+	invalidateCache();
 	destroyUnion();
 	_boolean = _b;
 	_type = Json::BOOLEAN;
@@ -451,6 +1873,7 @@ Json & Json::operator=(bool _b)
 
 Json & Json::operator=(int _n)
 {
+	invalidateCache();
 	destroyUnion();
 	_number = static_cast<double>(_n);
 	_type = Json::NUMBER;
@@ -459,6 +1882,7 @@ Json & Json::operator=(int _n)
 
 Json & Json::operator=(double _n)
 {
+	invalidateCache();
 	destroyUnion();
 	_number = _n;
 	_type = Json::NUMBER;
@@ -467,6 +1891,7 @@ Json & Json::operator=(double _n)
 
 Json & Json::operator=(const std::string & _s)
 {
+	invalidateCache();
 	destroyUnion();
 	new(&_string) std::string(_s);
 	_type = Json::STRING;
@@ -475,6 +1900,7 @@ Json & Json::operator=(const std::string & _s)
 
 Json & Json::operator=(const char * _c)
 {
+	invalidateCache();
 	destroyUnion();
 	new(&_string) std::string(_c);
 	_type = Json::STRING;
@@ -483,16 +1909,18 @@ Json & Json::operator=(const char * _c)
 
 Json & Json::operator=(const std::vector<Json>& _a)
 {
+	invalidateCache();
 	destroyUnion();
 	new(&_array) std::vector<Json>(_a);
 	_type = Json::ARRAY;
 	return *this;
 }
 
-Json & Json::operator=(const std::map<std::string, Json> &_o)
+Json & Json::operator=(const Object &_o)
 {
+	invalidateCache();
 	destroyUnion();
-	new(&_object) std::map<std::string, Json>(_o);
+	new(&_object) Object(_o);
 	_type = Json::OBJECT;
 	return *this;
 }
@@ -528,43 +1956,336 @@ bool Json::isNumber() const
 	return _type == NUMBER;
 }
 
-bool Json::isString() const
+bool Json::isString() const
+{
+	return _type == STRING;
+}
+
+bool Json::isArray() const
+{
+	return _type == ARRAY;
+}
+
+bool Json::isObject() const
+{
+	return _type == OBJECT;
+}
+
+void Json::clearObject()
+{
+	assert(_type == OBJECT);
+	invalidateCache();
+	_object.clear();
+}
+
+std::size_t Json::size() const
+{
+	assert(_type == ARRAY || _type == OBJECT);
+	if (_type == ARRAY) {
+		return _packed ? _numbers.size() : _array.size();
+	}
+	return _object.size();
+}
+
+Json Json::parse(const std::string & str)
+{
+	JsonParser jp(str);
+	return jp.parse();
+}
+
+Json Json::parse(const std::string & str, const ParseOptions & options)
+{
+	JsonParser jp(str, options);
+	return jp.parse();
+}
+
+Json::State Json::parseInto(Json & target, const std::string & str)
+{
+	JsonParser jp(str);
+	jp.parseInto(target);
+	return target.state();
+}
+
+Json::State Json::parseInto(Json & target, const std::string & str, const ParseOptions & options)
+{
+	JsonParser jp(str, options);
+	jp.parseInto(target);
+	return target.state();
+}
+
+Json::State Json::minify(const std::string & str, std::string & out)
+{
+	JsonParser jp(str);
+	return jp.transcode(out, nullptr);
+}
+
+Json::State Json::prettify(const std::string & str, std::string & out, const std::string & indent)
+{
+	JsonParser jp(str);
+	return jp.transcode(out, &indent);
+}
+
+Json::State Json::minify(const std::string & str, std::string & out, const ParseOptions & options)
+{
+	JsonParser jp(str, options);
+	return jp.transcode(out, nullptr);
+}
+
+Json::State Json::prettify(const std::string & str, std::string & out, const std::string & indent,
+	const ParseOptions & options)
+{
+	JsonParser jp(str, options);
+	return jp.transcode(out, &indent);
+}
+
+Json::State Json::parseEvents(const std::string & str, JsonHandler & handler)
+{
+	JsonParser jp(str);
+	return jp.parseEvents(handler);
+}
+
+Json::State Json::parseEvents(const std::string & str, JsonHandler & handler, const ParseOptions & options)
+{
+	JsonParser jp(str, options);
+	return jp.parseEvents(handler);
+}
+
+std::string Json::stringify(const Json & j)
+{
+	JsonStringify js(j);
+	return js.stringify();
+}
+
+std::size_t Json::hash() const
+{
+	return static_cast<std::size_t>(hashValue());
+}
+
+std::size_t Json::cacheHash()
+{
+	switch (_type)
+	{
+	case Json::ARRAY:
+		if (!_packed) {
+			for (auto &e : _array) {
+				e.cacheHash();
+			}
+		}
+		break;
+	case Json::OBJECT:
+		for (auto &kv : _object) {
+			kv.second.cacheHash();
+		}
+		break;
+	default:
+		break;
+	}
+	// children are cached now, so hashValue only combines one level
+	if (_cache) {
+		_cache->hash_valid = false;
+	}
+	std::uint64_t h = hashValue();
+	if ((_type == ARRAY || _type == OBJECT) && !_lent) {
+		if (!_cache) {
+			_cache.reset(new Cache());
+		}
+		_cache->hash = h;
+		_cache->hash_valid = true;
+	}
+	return static_cast<std::size_t>(h);
+}
+
+void Json::invalidateCache()
+{
+	if (_cache) {
+		_cache->hash_valid = false;
+		_cache->text_valid = false;
+	}
+}
+
+void Json::lend()
+{
+	invalidateCache();
+	_lent = true;
+}
+
+bool Json::hashCached() const
+{
+	return _cache && _cache->hash_valid;
+}
+
+void Json::copyHash(const Json & _j)
+{
+	if (!_j.hashCached()) {
+		invalidateCache();
+		return;
+	}
+	if (!_cache) {
+		_cache.reset(new Cache());
+	}
+	_cache->hash = _j._cache->hash;
+	_cache->hash_valid = true;
+}
+
+const std::string & Json::cacheStringify()
 {
-	return _type == STRING;
+	if (_cache && _cache->text_valid) {
+		return _cache->text;
+	}
+	if (!_cache) {
+		_cache.reset(new Cache());
+	}
+	// a lent node still returns its text from the buffer, but doesn't keep it
+	std::string &res = _cache->text;
+	res.clear();
+	if (_type == ARRAY && !_packed) {
+		res += '[';
+		for (size_t i = 0; i < _array.size(); i++) {
+			if (i != 0) { res += ','; }
+			Json &e = _array[i];
+			if (e.isArray() || e.isObject()) res += e.cacheStringify();
+			else JsonStringify::appendLeaf(res, e);
+		}
+		res += ']';
+	}
+	else if (_type == OBJECT) {
+		res += '{';
+		for (auto it = _object.begin(); it != _object.end(); ++it) {
+			if (it != _object.begin()) { res += ','; }
+			JsonStringify::appendString(res, it->first);
+			res += ':';
+			Json &v = it->second;
+			if (v.isArray() || v.isObject()) res += v.cacheStringify();
+			else JsonStringify::appendLeaf(res, v);
+		}
+		res += '}';
+	}
+	else {
+		JsonStringify::appendLeaf(res, *this);
+	}
+	_cache->text_valid = !_lent;
+	return res;
 }
 
-bool Json::isArray() const
+void Json::compact()
 {
-	return _type == ARRAY;
+	Json j;
+	j.compactFrom(*this);
+	*this = std::move(j);
 }
 
-bool Json::isObject() const
+void Json::compactFrom(const Json & _j)
 {
-	return _type == OBJECT;
+	_type = _j._type;
+	_state = _j._state;
+	copyHash(_j);
+	switch (_type)
+	{
+	case Json::ARRAY:
+		_packed = _j._packed;
+		if (_packed) {
+			new(&_numbers) std::vector<double>(_j._numbers);
+			break;
+		}
+		new(&_array) Array();
+		_array.reserve(_j._array.size());
+		for (const auto &e : _j._array) {
+			_array.emplace_back();
+			_array.back().compactFrom(e);
+		}
+		break;
+	case Json::OBJECT:
+		// inserting in order at end() builds each node before its value's subtree
+		new(&_object) Object();
+		for (const auto &kv : _j._object) {
+			auto it = _object.emplace_hint(_object.end(), kv.first, Json());
+			it->second.compactFrom(kv.second);
+		}
+		break;
+	default:
+		copyUnion(_j);
+		break;
+	}
 }
 
-void Json::clearObject()
+// Heap bytes of a string, none while it fits in the string itself
+static std::size_t stringUsage(const std::string & s)
 {
-	assert(_type == OBJECT);
-	_object.clear();
+	static const std::size_t inline_capacity = std::string().capacity();
+	return s.capacity() > inline_capacity ? s.capacity() + 1 : 0;
 }
 
-std::size_t Json::size() const
+std::size_t Json::memoryUsage() const
 {
-	assert(_type == ARRAY || _type == OBJECT);
-	return (_type == ARRAY) ? _array.size() : _object.size();
+	return sizeof(Json) + heapUsage();
 }
 
-Json Json::parse(const std::string & str)
+std::size_t Json::heapUsage() const
 {
-	JsonParser jp(str);
-	return jp.parse();
+	// red-black tree node: color and three links, as in libstdc++ and MSVC
+	static const std::size_t node_links = 4 * sizeof(void *);
+	std::size_t n = _cache ? sizeof(Cache) + stringUsage(_cache->text) : 0;
+	switch (_type)
+	{
+	case Json::STRING:
+		return n + stringUsage(_string);
+	case Json::ARRAY:
+		if (_packed) {
+			return n + _numbers.capacity() * sizeof(double);
+		}
+		n += _array.capacity() * sizeof(Json);
+		for (const auto &e : _array) {
+			n += e.heapUsage();
+		}
+		return n;
+	case Json::OBJECT:
+		for (const auto &kv : _object) {
+			n += node_links + sizeof(Object::value_type) + stringUsage(kv.first) + kv.second.heapUsage();
+		}
+		return n;
+	case Json::NUMBER:
+		return _raw ? n + stringUsage(_raw_number.text) : n;
+	default:
+		return n;
+	}
 }
 
-std::string Json::stringify(const Json & j)
+std::uint64_t Json::hashValue() const
 {
-	JsonStringify js(j);
-	return js.stringify();
+	if (hashCached()) {
+		return _cache->hash;
+	}
+	uint64_t h = hashCombine(0, static_cast<uint64_t>(_type) + 1);
+	switch (_type)
+	{
+	case Json::BOOLEAN:
+		return hashCombine(h, _boolean ? 1 : 0);
+	case Json::NUMBER:
+		return hashNumber(getNumber());
+	case Json::STRING:
+		return hashCombine(h, hashBytes(_string.data(), _string.size()));
+	case Json::ARRAY:
+		h = hashCombine(h, size());
+		if (_packed) {
+			for (double n : _numbers) {
+				h = hashCombine(h, hashNumber(n));
+			}
+			return h;
+		}
+		for (const auto &e : _array) {
+			h = hashCombine(h, e.hashValue());
+		}
+		return h;
+	case Json::OBJECT:
+		h = hashCombine(h, _object.size());
+		for (const auto &kv : _object) {	// std::map is ordered, so the combine is stable
+			h = hashCombine(h, hashBytes(kv.first.data(), kv.first.size()));
+			h = hashCombine(h, kv.second.hashValue());
+		}
+		return h;
+	default: // Json::NUL case
+		return h;
+	}
 }
 
 
@@ -574,13 +2295,52 @@ void Json::copyUnion(const Json & _j)
 	{
 	case Json::NUL:			break;
 	case Json::BOOLEAN:		_boolean = _j._boolean; break;
-	case Json::NUMBER:		_number = _j._number; break;
+	case Json::NUMBER:
+		if (_j._raw) new(&_raw_number) RawNumber(_j._raw_number.text, _j._raw_number.bits.load(std::memory_order_relaxed));
+		else _number = _j._number;
+		_raw = _j._raw;
+		break;
 	case Json::STRING:		new(&_string) std::string(_j._string); break;
-	case Json::ARRAY:		new(&_array) std::vector<Json>(_j._array); break;
-	case Json::OBJECT:		new(&_object) std::map<std::string, Json>(_j._object); break;
+	case Json::ARRAY:
+		if (_j._packed) new(&_numbers) std::vector<double>(_j._numbers);
+		else new(&_array) std::vector<Json>(_j._array);
+		_packed = _j._packed;
+		break;
+	case Json::OBJECT:		new(&_object) Object(_j._object); break;
+	default:
+		break;
+	}
+}
+
+// Moved-from _j keeps its type with an empty container
+void Json::moveUnion(Json && _j)
+{
+	switch (_j.type())
+	{
+	case Json::NUL:			break;
+	case Json::BOOLEAN:		_boolean = _j._boolean; break;
+	case Json::NUMBER:
+		if (_j._raw) {
+			new(&_raw_number) RawNumber(std::string_view(), _j._raw_number.bits.load(std::memory_order_relaxed));
+			_raw_number.text.swap(_j._raw_number.text);
+		}
+		else _number = _j._number;
+		_raw = _j._raw;
+		break;
+	case Json::STRING:		new(&_string) std::string(std::move(_j._string)); break;
+	case Json::ARRAY:
+		if (_j._packed) new(&_numbers) std::vector<double>(std::move(_j._numbers));
+		else new(&_array) std::vector<Json>(std::move(_j._array));
+		_packed = _j._packed;
+		break;
+	case Json::OBJECT:		new(&_object) Object(std::move(_j._object)); break;
 	default:
 		break;
 	}
+	// references to _j's members now reach ours
+	_lent = _j._lent;
+	_j._lent = false;
+	_j.invalidateCache();
 }
 
 void Json::destroyUnion()
@@ -592,6 +2352,7 @@ void Json::destroyUnion()
 	case Json::BOOLEAN:	
 		break;
 	case Json::NUMBER:	
+		if (_raw) _raw_number.~RawNumber();
 		break;
 	case Json::STRING:	
 		using std::string; // can't straight use _string.~std::string();
@@ -599,7 +2360,8 @@ void Json::destroyUnion()
 		break;
 	case Json::ARRAY:
 		using std::vector;
-		_array.~vector();
+		if (_packed) _numbers.~vector();
+		else _array.~vector();
 		break;
 	case Json::OBJECT:
 		using std::map;
@@ -608,6 +2370,9 @@ void Json::destroyUnion()
 	default:
 		break;
 	}
+	_packed = false;
+	_raw = false;
+	_lent = false;
 }
 
 
@@ -621,7 +2386,46 @@ bool Json::getBoolean() const
 double Json::getNumber() const
 {
 	assert(this->isNumber());
-	return _number;
+	return _raw ? rawValue() : _number;
+}
+
+double Json::rawValue() const
+{
+	double n;
+	std::uint64_t bits = _raw_number.bits.load(std::memory_order_relaxed);
+	if (bits == RawNumber::NOT_CONVERTED) {
+		n = strtod(_raw_number.text.c_str(), NULL);
+		std::memcpy(&bits, &n, sizeof(n));
+		_raw_number.bits.store(bits, std::memory_order_relaxed);
+	}
+	else {
+		std::memcpy(&n, &bits, sizeof(n));
+	}
+	return n;
+}
+
+bool Json::getInt64(std::int64_t & n) const
+{
+	assert(this->isNumber());
+	if (_raw && _raw_number.text.find_first_of(".eE") == std::string::npos) {
+		errno = 0;
+		long long v = strtoll(_raw_number.text.c_str(), NULL, 10);
+		if (errno == ERANGE) return false;
+		n = v;
+		return true;
+	}
+	double d = getNumber();
+	if (d != std::floor(d) || d < -9223372036854775808.0 || d >= 9223372036854775808.0) {
+		return false;
+	}
+	n = static_cast<std::int64_t>(d);
+	return true;
+}
+
+const std::string * Json::getRawNumber() const
+{
+	assert(this->isNumber());
+	return _raw ? &_raw_number.text : nullptr;
 }
 
 const std::string & Json::getString() const
@@ -632,7 +2436,7 @@ const std::string & Json::getString() const
 
 const Json::Array & Json::getArray() const
 {
-	assert(this->isArray());
+	assert(this->isArray() && !_packed);
 	return _array;
 }
 
@@ -642,33 +2446,92 @@ const Json::Object & Json::getObject() const
 	return _object;
 }
 
+bool Json::isPackedArray() const
+{
+	return _type == ARRAY && _packed;
+}
+
+const std::vector<double>& Json::getNumberArray() const
+{
+	assert(this->isPackedArray());
+	return _numbers;
+}
+
+bool Json::packArray()
+{
+	assert(_type == ARRAY);
+	if (_packed) return true;
+	std::vector<double> numbers;
+	numbers.reserve(_array.size());
+	for (const auto &e : _array) {
+		if (e._type != NUMBER) return false;
+		numbers.push_back(e.getNumber());
+	}
+	// same value and hash, but lazy numbers lose their source text
+	if (_cache) {
+		_cache->text_valid = false;
+	}
+	using std::vector;
+	_array.~vector();
+	new(&_numbers) std::vector<double>(std::move(numbers));
+	_packed = true;
+	return true;
+}
+
+void Json::unpackArray()
+{
+	assert(_type == ARRAY);
+	if (!_packed) return;
+	Array array(_numbers.begin(), _numbers.end());
+	using std::vector;
+	_numbers.~vector();
+	new(&_array) Array(std::move(array));
+	_packed = false;
+}
+
 const Json & Json::operator[](size_t i) const
 {
-	assert(_type == ARRAY && i < _array.size());
+	assert(_type == ARRAY && !_packed && i < _array.size());
 	return _array[i];
 }
 
 Json & Json::operator[](size_t i)
 {
-	assert(_type == ARRAY && i < _array.size());
+	assert(_type == ARRAY && i < size());
+	lend();
+	unpackArray();
 	return _array[i];
 }
 
 void Json::pushbackArrayElement(const Json & e)
 {
 	assert(_type == ARRAY);
+	invalidateCache();
+	if (_packed && e._type == NUMBER) {
+		_numbers.push_back(e.getNumber());
+		return;
+	}
+	unpackArray();
 	_array.push_back(e);
 }
 
 void Json::popbackArrayElement()
 {
 	assert(_type == ARRAY);
-	_array.pop_back();
+	invalidateCache();
+	if (_packed) _numbers.pop_back();
+	else _array.pop_back();
 }
 
 size_t Json::insertArrayElement(size_t i, const Json & e)
 {
-	assert(_type == ARRAY && i <= _array.size()); // Note: i can be equal to _array.size()
+	assert(_type == ARRAY && i <= size()); // Note: i can be equal to size()
+	invalidateCache();
+	if (_packed && e._type == NUMBER) {
+		_numbers.insert(_numbers.begin() + i, e.getNumber());
+		return i;
+	}
+	unpackArray();
 	auto iter = _array.begin() + i;
 	_array.insert(iter, e);
 	return i;
@@ -676,7 +2539,12 @@ size_t Json::insertArrayElement(size_t i, const Json & e)
 
 size_t Json::eraseArrayElement(size_t i)
 {
-	assert(_type == ARRAY && i < _array.size());
+	assert(_type == ARRAY && i < size());
+	invalidateCache();
+	if (_packed) {
+		_numbers.erase(_numbers.begin() + i);
+		return i;
+	}
 	auto iter = _array.begin() + i;
 	_array.erase(iter);
 	return i;
@@ -685,47 +2553,99 @@ size_t Json::eraseArrayElement(size_t i)
 void Json::clearArray()
 {
 	assert(_type == ARRAY);
-	_array.clear();
+	invalidateCache();
+	if (_packed) _numbers.clear();
+	else _array.clear();
 }
 
 
-const Json & Json::operator[](const std::string & str) const
+const Json & Json::operator[](std::string_view key) const
 {
 	assert(_type == OBJECT);
-	//auto iter = _object.find(str);
-	//return (iter == _object.end() ? Json() : iter->second); // this may return temp variable Json()..., add move later??
-	//return _object[str]; // the same as above ? can not use
-	return _object.at(str); // simple use at, later add exception handler??
+	// like _object.at, which has no transparent overload
+	auto iter = _object.find(key);
+	if (iter == _object.end()) {
+		throw std::out_of_range("Json::operator[]: no such member");
+	}
+	return iter->second;
 }
 
-Json & Json::operator[](const std::string & str)
+Json & Json::operator[](std::string_view key)
 {
 	assert(_type == OBJECT);
-	//return _object.at(str); // simple use at, later add exception handler??
-	return _object[str];
+	lend();
+	// the key is only copied when it is inserted
+	auto iter = _object.lower_bound(key);
+	if (iter == _object.end() || iter->first != key) {
+		iter = _object.emplace_hint(iter, std::string(key), Json());
+	}
+	return iter->second;
 }
 
-Json::ObjectIterator Json::findObjectElement(const std::string & str)
+Json::ObjectIterator Json::findObjectElement(std::string_view key)
 {
 	assert(_type == OBJECT);
-	return _object.find(str);
+	lend();
+	return _object.find(key);
 }
 
-Json::ConstObjectIterator Json::findObjectElement(const std::string & str) const
+Json::ConstObjectIterator Json::findObjectElement(std::string_view key) const
 {
 	assert(_type == OBJECT);
-	return _object.find(str);
+	return _object.find(key);
+}
+
+const Json * Json::find(std::string_view key) const
+{
+	if (_type != OBJECT) return nullptr;
+	auto iter = _object.find(key);
+	return iter == _object.end() ? nullptr : &iter->second;
+}
+
+Json * Json::find(std::string_view key)
+{
+	if (_type != OBJECT) return nullptr;
+	auto iter = _object.find(key);
+	if (iter == _object.end()) return nullptr;
+	lend();
+	return &iter->second;
+}
+
+const Json * Json::getIf(std::string_view key, Type type) const
+{
+	const Json *j = find(key);
+	return j != nullptr && j->_type == type ? j : nullptr;
+}
+
+bool Json::getBooleanOr(std::string_view key, bool def) const
+{
+	const Json *j = getIf(key, BOOLEAN);
+	return j != nullptr ? j->_boolean : def;
+}
+
+double Json::getNumberOr(std::string_view key, double def) const
+{
+	const Json *j = getIf(key, NUMBER);
+	return j != nullptr ? j->getNumber() : def;
+}
+
+std::string_view Json::getStringOr(std::string_view key, std::string_view def) const
+{
+	const Json *j = getIf(key, STRING);
+	return j != nullptr ? std::string_view(j->_string) : def;
 }
 
 Json::ObjectIterator Json::eraseObjectElement(ObjectIterator pos)
 {
 	assert(_type == OBJECT);
+	lend();
 	return _object.erase(pos);
 }
 
 Json::ObjectIterator Json::eraseObjectElement(ConstObjectIterator pos)
 {
 	assert(_type == OBJECT);
+	lend();
 	return _object.erase(pos);
 }
 
@@ -737,79 +2657,340 @@ JsonStringify::JsonStringify(const Json & _j)
 
 std::string JsonStringify::stringify()
 {
-	switch (_json.type())
-	{
-		case Json::NUL:
-			return "null";
-		case Json::BOOLEAN:
-			return (_json.getBoolean() == true ? "true" : "false");
-		case Json::NUMBER: {
-				char buf[32];
-				snprintf(buf, sizeof buf, "%.17g", _json.getNumber());
-				return buf;
-			}
-		case Json::STRING:
-			return stringifyString(_json.getString());
-		case Json::ARRAY: {
-				std::string res;
-				res += '[';
-				for (int i = 0; i < _json.size(); i++) {
-					if (i != 0) { res += ','; }
-					res += JsonStringify(_json[i]).stringify();
+	std::string res;
+	appendValue(res, _json);
+	return res;
+}
+
+void JsonStringify::appendValue(std::string & res, const Json & j)
+{
+	// open containers, innermost last, with the next element / member
+	struct Frame {
+		const Json *json;
+		size_t index;
+		Json::ConstObjectIterator iter;
+	};
+	std::vector<Frame> stack;
+	const Json *cur = &j;
+	while (cur != nullptr) {
+		if (cur->_cache && cur->_cache->text_valid) {
+			res += cur->_cache->text;
+		}
+		else if (cur->isArray() && !cur->_packed) {
+			res += '[';
+			stack.push_back(Frame{ cur, 0, Json::ConstObjectIterator() });
+		}
+		else if (cur->isObject()) {
+			res += '{';
+			stack.push_back(Frame{ cur, 0, cur->getObject().cbegin() });
+		}
+		else {
+			appendLeaf(res, *cur);
+		}
+
+		// find the next value, closing every container which is finished
+		cur = nullptr;
+		while (!stack.empty()) {
+			Frame &f = stack.back();
+			if (f.json->isArray()) {
+				if (f.index < f.json->size()) {
+					if (f.index != 0) { res += ','; }
+					cur = &(*f.json)[f.index++];
+					break;
 				}
 				res += ']';
-				return std::move(res);
 			}
-		case Json::OBJECT: {
-				bool first = true;
-				std::string res;
-				res += '{';
-				const auto &object = _json.getObject();
-				for (const auto &kv : object) {
-					if (!first) { res += ','; }
-					res += stringifyString(kv.first);
+			else {
+				if (f.iter != f.json->getObject().cend()) {
+					if (f.index++ != 0) { res += ','; }
+					appendString(res, f.iter->first);
 					res += ':';
-					res += JsonStringify(kv.second).stringify();
-					first = false;
+					cur = &f.iter->second;
+					++f.iter;
+					break;
 				}
 				res += '}';
-				return std::move(res);
 			}
+			stack.pop_back();
+		}
+	}
+}
+
+void JsonStringify::appendLeaf(std::string & res, const Json & j)
+{
+	switch (j.type())
+	{
+		case Json::NUL:
+			res += "null";
+			break;
+		case Json::BOOLEAN:
+			res += (j.getBoolean() == true ? "true" : "false");
+			break;
+		case Json::NUMBER: {
+				if (j._raw) {
+					res += j._raw_number.text;
+					break;
+				}
+				char buf[32];
+				res.append(buf, formatNumber(j.getNumber(), buf));
+				break;
+			}
+		case Json::STRING:
+			appendString(res, j.getString());
+			break;
+		case Json::ARRAY:
+			appendNumbers(res, j._numbers);
+			break;
 		default:
 			break;
 	}
 }
 
+void JsonStringify::appendNumbers(std::string & res, const std::vector<double>& numbers)
+{
+	char buf[32];
+	res += '[';
+	for (size_t i = 0; i < numbers.size(); i++) {
+		if (i != 0) { res += ','; }
+		res.append(buf, formatNumber(numbers[i], buf));
+	}
+	res += ']';
+}
+
+std::string JsonStringify::stringifyNumber(double _n)
+{
+	char buf[32];
+	size_t len = formatNumber(_n, buf);
+	return std::string(buf, len);
+}
+
+size_t JsonStringify::formatNumber(double _n, char * buf)
+{
+	return static_cast<size_t>(snprintf(buf, 32, "%.17g", _n));
+}
 
 std::string JsonStringify::stringifyString(const std::string & _s)
 {
 	std::string res;
+	appendString(res, _s);
+	return res;
+}
+
+void JsonStringify::appendString(std::string & res, const std::string & _s)
+{
 	res += '"';
-	for (int i = 0; i < _s.size(); i++) {
+	size_t run = 0;	// start of chars not yet appended, copied as one block
+	for (size_t i = 0; i < _s.size(); i++) {
 		const char ch = _s[i];
+		const char *escape;
 		switch (ch)
 		{
-			case '"':	res += R"(\")"; break;
-			case '\\':	res += R"(\\)";	break;
-			case '\b':	res += R"(\b)";	break;
-			case '\f':	res += R"(\f)";	break;
-			case '\n':	res += R"(\n)";	break;
-			case '\r':	res += R"(\r)";	break;
-			case '\t':	res += R"(\t)";	break;
+			case '"':	escape = R"(\")"; break;
+			case '\\':	escape = R"(\\)";	break;
+			case '\b':	escape = R"(\b)";	break;
+			case '\f':	escape = R"(\f)";	break;
+			case '\n':	escape = R"(\n)";	break;
+			case '\r':	escape = R"(\r)";	break;
+			case '\t':	escape = R"(\t)";	break;
 			default:
-				if (static_cast<uint8_t>(ch) < 0x20) {
-					char buf[8];
-					snprintf(buf, sizeof(buf), "\\u%04X", ch);
-					res += buf;
-				}
-				else {
-					res += ch;
+				if (static_cast<uint8_t>(ch) >= 0x20) {
+					continue;
 				}
+				escape = nullptr;
 				break;
 		}
+		res.append(_s, run, i - run);
+		run = i + 1;
+		if (escape != nullptr) {
+			res += escape;
+		}
+		else {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04X", ch);
+			res += buf;
+		}
 	}
+	res.append(_s, run, _s.size() - run);
 	res += '"';
-	return std::move(res);
+}
+
+//========================JsonChunkStringify===================================
+JsonChunkStringify::JsonChunkStringify(const Json & _j)
+	:_next(&_j)
+{
+}
+
+size_t JsonChunkStringify::nextChunk(char * buf, size_t cap)
+{
+	size_t n = 0;
+	while (n < cap) {
+		if (_pending_pos < _pending_len) {
+			size_t len = std::min(cap - n, _pending_len - _pending_pos);
+			memcpy(buf + n, _pending + _pending_pos, len);
+			n += len;
+			_pending_pos += len;
+		}
+		else if (_str != nullptr) {
+			n += writeString(buf + n, cap - n);
+		}
+		else if (!step()) {
+			break;
+		}
+	}
+	return n;
+}
+
+bool JsonChunkStringify::finished() const
+{
+	return _next == nullptr && _stack.empty() && _str == nullptr && _pending_pos == _pending_len;
+}
+
+bool JsonChunkStringify::step()
+{
+	if (_next != nullptr) {
+		const Json *j = _next;
+		_next = nullptr;
+		startValue(*j);
+		return true;
+	}
+	if (_stack.empty()) {
+		return false;
+	}
+	Frame &f = _stack.back();
+	if (f.json->isArray()) {
+		if (f.index == f.json->size()) {
+			queue("]", 1);
+			_stack.pop_back();
+		}
+		else if (f.json->isPackedArray()) {
+			char number[32];
+			size_t len = JsonStringify::formatNumber(f.json->getNumberArray()[f.index], number);
+			_pending_len = 0;
+			if (f.index++ != 0) { _pending[_pending_len++] = ','; }
+			memcpy(_pending + _pending_len, number, len);
+			_pending_len += len;
+			_pending_pos = 0;
+		}
+		else {
+			const auto &array = f.json->getArray();
+			if (f.index != 0) { queue(",", 1); }
+			_next = &array[f.index++];
+		}
+		return true;
+	}
+	if (f.key_done) {
+		queue(":", 1);
+		_next = &f.iter->second;
+		++f.iter;
+		f.key_done = false;
+	}
+	else if (f.iter == f.json->getObject().cend()) {
+		queue("}", 1);
+		_stack.pop_back();
+	}
+	else {
+		if (f.index++ != 0) {
+			queue(",\"", 2);
+		}
+		else {
+			queue("\"", 1);
+		}
+		_str = &f.iter->first;
+		_str_pos = 0;
+		f.key_done = true;
+	}
+	return true;
+}
+
+void JsonChunkStringify::startValue(const Json & j)
+{
+	switch (j.type())
+	{
+	case Json::NUL:
+		queue("null", 4);
+		break;
+	case Json::BOOLEAN:
+		if (j.getBoolean()) {
+			queue("true", 4);
+		}
+		else {
+			queue("false", 5);
+		}
+		break;
+	case Json::NUMBER:
+		if (j.getRawNumber() != nullptr) {
+			_str = j.getRawNumber();
+			_str_pos = 0;
+			_str_raw = true;
+			break;
+		}
+		_pending_len = JsonStringify::formatNumber(j.getNumber(), _pending);
+		_pending_pos = 0;
+		break;
+	case Json::STRING:
+		queue("\"", 1);
+		_str = &j.getString();
+		_str_pos = 0;
+		break;
+	case Json::ARRAY:
+		queue("[", 1);
+		_stack.push_back(Frame{ &j, 0, Json::ConstObjectIterator(), false });
+		break;
+	case Json::OBJECT:
+		queue("{", 1);
+		_stack.push_back(Frame{ &j, 0, j.getObject().cbegin(), false });
+		break;
+	default:
+		break;
+	}
+}
+
+size_t JsonChunkStringify::writeString(char * buf, size_t cap)
+{
+	const std::string &s = *_str;
+	size_t n = 0;
+	while (n < cap && _str_pos < s.size()) {
+		const char ch = s[_str_pos];
+		const char *escape = nullptr;
+		switch (ch)
+		{
+			case '"':	escape = R"(\")"; break;
+			case '\\':	escape = R"(\\)"; break;
+			case '\b':	escape = R"(\b)"; break;
+			case '\f':	escape = R"(\f)"; break;
+			case '\n':	escape = R"(\n)"; break;
+			case '\r':	escape = R"(\r)"; break;
+			case '\t':	escape = R"(\t)"; break;
+			default:
+				if (static_cast<uint8_t>(ch) < 0x20) {
+					char hex[8];
+					snprintf(hex, sizeof(hex), "\\u%04X", ch);
+					queue(hex, 6);
+					_str_pos++;
+					return n;
+				}
+				buf[n++] = ch;
+				_str_pos++;
+				continue;
+		}
+		queue(escape, 2);
+		_str_pos++;
+		return n;
+	}
+	if (_str_pos == s.size()) {
+		if (!_str_raw) queue("\"", 1);
+		_str = nullptr;
+		_str_raw = false;
+	}
+	return n;
+}
+
+void JsonChunkStringify::queue(const char * s, size_t len)
+{
+	assert(_pending_pos == _pending_len && len <= sizeof _pending);
+	memcpy(_pending, s, len);
+	_pending_len = len;
+	_pending_pos = 0;
 }
 
 
@@ -819,6 +3000,9 @@ bool operator==(const Json &lhs, const Json &rhs)
 	if (lhs.type() != rhs.type()) {
 		return false;
 	}
+	if (lhs.hashCached() && rhs.hashCached() && lhs._cache->hash != rhs._cache->hash) {
+		return false;
+	}
 	switch (lhs.type())
 	{
 		case Json::BOOLEAN: return lhs.getBoolean() == rhs.getBoolean();
@@ -828,6 +3012,23 @@ bool operator==(const Json &lhs, const Json &rhs)
 			if (lhs.size() != rhs.size()) {
 				return false;
 			}
+			if (lhs._packed || rhs._packed) {
+				// elements of the unpacked side must be equal numbers
+				auto number_at = [](const Json &j, size_t i, double &n) {
+					if (j._packed) {
+						n = j._numbers[i];
+						return true;
+					}
+					if (j._array[i]._type != Json::NUMBER) return false;
+					n = j._array[i].getNumber();
+					return true;
+				};
+				for (size_t i = 0; i < lhs.size(); i++) {
+					double l, r;
+					if (!number_at(lhs, i, l) || !number_at(rhs, i, r) || l != r) return false;
+				}
+				return true;
+			}
 			for (int i = 0; i < lhs.size(); i++) {
 				if (lhs[i] != rhs[i]) return false;
 			}
@@ -1,7 +1,14 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <string_view>
 #include <type_traits>
 
 namespace ll {
@@ -10,8 +17,90 @@ namespace json {
 
 class JsonParser;
 
+// Members a parse keeps, as JSON Pointer paths. A path ending at a member
+// keeps all of it, arrays pass a path on to every element, e.g. "/items/id"
+// keeps the id of each item. Members off every path are skipped unbuilt.
+class JsonProjection {
+public:
+	struct Node {
+		bool keep_all = false;
+		std::map<std::string, Node, std::less<>> children;
+	};
+
+	JsonProjection() = default;
+	JsonProjection(std::initializer_list<std::string> pointers);
+	// false if pointer is not a valid JSON Pointer
+	bool add(const std::string &pointer);
+	const Node &root() const;
+private:
+	Node _root;
+};
+
+// Bounds for untrusted input, a parse which exceeds one fails with its
+// state. Tokens are counted as they are read, so leaving them on costs a
+// few compares a token; a string may be a key, so nodes and memory are
+// checked again at the token after it.
+struct ParseLimits {
+	size_t max_input = SIZE_MAX;		// bytes of input: PARSE_INPUT_TOO_LARGE
+	size_t max_string = SIZE_MAX;		// decoded bytes of a string or key: PARSE_STRING_TOO_LONG
+	size_t max_members = SIZE_MAX;		// elements of an array or members of an object: PARSE_TOO_MANY_MEMBERS
+	size_t max_nodes = SIZE_MAX;		// values in the document: PARSE_TOO_MANY_NODES
+	// Estimated bytes of the tree: a Json per value, a map node per member
+	// and the bytes of strings and keys: PARSE_MEMORY_EXCEEDED
+	size_t max_memory = SIZE_MAX;
+	// Budget, checked every check_interval bytes of input: past deadline is
+	// PARSE_TIMEOUT, and yield is called with the offset reached. It may do
+	// other work before returning, false stops the parse with PARSE_ABORTED
+	size_t check_interval = 1 << 16;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+	std::function<bool(size_t)> yield;
+};
+
+struct ParseOptions {
+	// Max nesting of arrays/objects, deeper input is PARSE_DEPTH_EXCEEDED
+	size_t max_depth = 1024;
+	// Reject strings which are not well-formed UTF-8 with PARSE_INVALID_UTF8
+	bool validate_utf8 = false;
+	// Only build the members it selects, not owned
+	const JsonProjection *projection = nullptr;
+	// Store arrays of only numbers packed, see Json::isPackedArray
+	bool pack_numbers = false;
+	// Keep numbers as their source text, converted on the first getNumber()
+	// and written back verbatim by stringify until reassigned. Numbers with
+	// an exponent are converted right away to check their range, and so are
+	// the ones pack_numbers reads for packing
+	bool lazy_numbers = false;
+	ParseLimits limits;
+	// If set, receives the byte offset in the input where a parse failed
+	size_t *error_offset = nullptr;
+};
+
+// Receives a document as a stream of events, see Json::parseEvents.
+// Strings and keys only live during the call. Returning false stops the
+// parse with PARSE_ABORTED.
+class JsonHandler {
+public:
+	virtual ~JsonHandler() = default;
+	virtual bool null() { return true; }
+	virtual bool boolean(bool) { return true; }
+	virtual bool number(double) { return true; }
+	// Called by the parser with the number's source text, which is beyond
+	// double precision for long integers. Calls number(n) unless overridden
+	virtual bool rawNumber(std::string_view, double n) { return number(n); }
+	virtual bool string(std::string_view) { return true; }
+	virtual bool startArray() { return true; }
+	virtual bool endArray() { return true; }
+	virtual bool startObject() { return true; }
+	virtual bool key(std::string_view) { return true; }
+	virtual bool endObject() { return true; }
+};
+
+// Const member functions never write to the tree (lazy numbers cache
+// through an atomic), so any number of threads may read a Json while no
+// thread modifies it.
 class Json {
 	friend class JsonParser;
+	friend class JsonBuilder;
 	friend class JsonStringify;
 	friend bool operator==(const Json &lhs, const Json &rhs);
 	friend bool operator!=(const Json &lhs, const Json &rhs);
@@ -34,11 +123,25 @@ public:
 		PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
 		PARSE_MISS_KEY,
 		PARSE_MISS_COLON,
-		PARSE_MISS_COMMA_OR_CURLY_BRACKET
+		PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+		PARSE_TYPE_MISMATCH,	// typed binding, JsonShredder: value doesn't fit the bound C++ type or column
+		PARSE_MISS_FIELD,		// typed binding: non-optional field is absent
+		PARSE_DEPTH_EXCEEDED,	// nesting is deeper than ParseOptions::max_depth
+		PARSE_INVALID_UTF8,		// ParseOptions::validate_utf8: malformed UTF-8 in a string
+		PARSE_ABORTED,			// a JsonHandler, record callback or ParseLimits::yield returned false
+		PARSE_SCHEMA_MISMATCH,	// JsonSchema: document doesn't satisfy the schema
+		PARSE_INPUT_ERROR,		// JsonGzipReader: file can't be opened or decompressed
+		PARSE_INPUT_TOO_LARGE,	// exceeded ParseLimits, see there
+		PARSE_STRING_TOO_LONG,
+		PARSE_TOO_MANY_MEMBERS,
+		PARSE_TOO_MANY_NODES,
+		PARSE_MEMORY_EXCEEDED,
+		PARSE_TIMEOUT
 	};
 
 	typedef std::vector<Json> Array;
-	typedef std::map<std::string, Json> Object;
+	// std::less<> lets members be found by std::string_view without a temporary key
+	typedef std::map<std::string, Json, std::less<>> Object;
 	typedef Object::iterator ObjectIterator;
 	typedef Object::const_iterator ConstObjectIterator;
 
@@ -49,17 +152,23 @@ public:
 	Json(const std::string &_s);
 	Json(const char *_c);
 	Json(const std::vector<Json> &_a);
-	Json(const std::map<std::string, Json> &_o);
+	Json(const Object &_o);
+	Json(const std::map<std::string, Json> &_o);	// copied into an Object
+	Json(std::string &&_s);
+	Json(std::vector<Json> &&_a);
+	Json(Object &&_o);
 	Json(const Json &_j);
+	Json(Json &&_j) noexcept;
 
 	Json &operator=(const Json &_j);
+	Json &operator=(Json &&_j) noexcept;
 	Json &operator=(bool _b);
 	Json &operator=(int _n);	// receive int value and cast to double
 	Json &operator=(double _n);
 	Json &operator=(const std::string &_s);
 	Json &operator=(const char *_c);
 	Json &operator=(const std::vector<Json> &_a);
-	Json &operator=(const std::map<std::string, Json> &_o);
+	Json &operator=(const Object &_o);
 
 	~Json();
 
@@ -75,11 +184,26 @@ public:
 
 	bool getBoolean() const;
 	double getNumber() const;
+	// false if the number isn't an integer in range, exact for source text
+	// beyond double precision
+	bool getInt64(std::int64_t &n) const;
+	// Source text of a number kept by ParseOptions::lazy_numbers, else nullptr
+	const std::string *getRawNumber() const;
 	const std::string& getString() const;
 	const Array& getArray() const;
 	const Object& getObject() const;
 
 	// =================Array==================
+	// A packed array keeps its numbers in one std::vector<double> instead of
+	// a Json per element. Read it with getNumberArray(), getArray() and the
+	// const operator[] need real elements and don't accept it. Mutators keep
+	// it packed while only numbers are added, others unpack it first.
+	bool isPackedArray() const;
+	const std::vector<double>& getNumberArray() const;
+	// Pack an array of only numbers, return false (and leave it) otherwise
+	bool packArray();
+	void unpackArray();
+
 	const Json & operator[](size_t i) const;
 	Json & operator[](size_t i);
 	void pushbackArrayElement(const Json &e);
@@ -92,10 +216,21 @@ public:
 	void clearArray();
 
 	// =================Object=================
-	const Json & operator[](const std::string &str) const;
-	Json & operator[](const std::string &str);
-	ObjectIterator findObjectElement(const std::string &str);
-	ConstObjectIterator findObjectElement(const std::string &str) const;
+	// Keys are taken as std::string_view, a lookup never allocates.
+	// The const operator[] throws std::out_of_range on a missing key
+	const Json & operator[](std::string_view key) const;
+	Json & operator[](std::string_view key);
+	ObjectIterator findObjectElement(std::string_view key);
+	ConstObjectIterator findObjectElement(std::string_view key) const;
+	// Member key, or nullptr if it is missing or this isn't an object
+	const Json * find(std::string_view key) const;
+	Json * find(std::string_view key);
+	// Like find, but also nullptr if the member isn't of type
+	const Json * getIf(std::string_view key, Type type) const;
+	// Value of member key, or def if it is missing or of another type
+	bool getBooleanOr(std::string_view key, bool def) const;
+	double getNumberOr(std::string_view key, double def) const;
+	std::string_view getStringOr(std::string_view key, std::string_view def) const;
 	ObjectIterator eraseObjectElement(ObjectIterator pos);
 	ObjectIterator eraseObjectElement(ConstObjectIterator pos);
 	void clearObject();
@@ -103,25 +238,357 @@ public:
 	// Array and Object
 	std::size_t size() const;
 
+	// =================Hash===================
+	// Structural hash, equal Json always have equal hash, cached subtree hash is used if present
+	std::size_t hash() const;
+	// Compute hash of whole tree and cache it on every array/object node.
+	// Mutators drop the cache of the node they are called on. A node which
+	// has handed out a non-const reference to a member (operator[], find,
+	// findObjectElement) isn't cached, as the member may still be changed
+	// through it, until the node is assigned a new value
+	std::size_t cacheHash();
+
+	// =================Stringify==============
+	// Opt-in cache for trees that are stringified again after small edits:
+	// keep the text of every array/object node, so stringify() copies clean
+	// subtrees and only encodes the path to what changed. Kept on the same
+	// nodes as cacheHash(), and costs a copy of each subtree's text per level
+	const std::string &cacheStringify();
+
+	// =================Memory=================
+	// Rebuild the tree depth-first in key/element order with exact
+	// capacities, so its blocks are allocated in traversal order. Values
+	// compare equal and cached hashes are kept
+	void compact();
+	// Bytes of this Json and every block it owns, as asked of the
+	// allocator; map nodes are counted with their links
+	std::size_t memoryUsage() const;
+
 	static Json parse(const std::string &str);
+	static Json parse(const std::string &str, const ParseOptions &options);
+	// Parse into target, reusing its strings, array capacity and object
+	// nodes where the shape matches and dropping the rest. On error
+	// target is reset to what parse() would return.
+	static State parseInto(Json &target, const std::string &str);
+	static State parseInto(Json &target, const std::string &str, const ParseOptions &options);
+	// Reformat str into out without building a tree, keeping key order and
+	// the text of strings and numbers. out is empty on error
+	static State minify(const std::string &str, std::string &out);
+	static State minify(const std::string &str, std::string &out, const ParseOptions &options);
+	static State prettify(const std::string &str, std::string &out, const std::string &indent = "    ");
+	static State prettify(const std::string &str, std::string &out, const std::string &indent,
+		const ParseOptions &options);
+	// Parse str into handler callbacks without building a tree
+	static State parseEvents(const std::string &str, JsonHandler &handler);
+	static State parseEvents(const std::string &str, JsonHandler &handler, const ParseOptions &options);
 	// note: stringify will make Json::Object sorted as lexicographical order
 	static std::string stringify(const Json &j);
 private:
+	// NUMBER as source text, the double is cached in bits on first read.
+	// Racing readers store the same bits, so const access stays thread-safe
+	struct RawNumber {
+		static constexpr std::uint64_t NOT_CONVERTED = ~std::uint64_t(0);	// a NaN
+		std::string text;
+		mutable std::atomic<std::uint64_t> bits;
+
+		RawNumber(std::string_view t, std::uint64_t b)
+			:text(t), bits(b)
+		{
+		}
+	};
+
+	// Kept out of the node, only the ones cacheHash() and cacheStringify()
+	// reach pay for it
+	struct Cache {
+		bool hash_valid = false;
+		bool text_valid = false;
+		std::uint64_t hash = 0;
+		// stringify() of the node, the buffer is kept while invalid
+		std::string text;
+	};
+
 	Type _type = NUL;
 	State _state = PARSE_OK;
+	// set on object members by parseInto until their key is seen again
+	bool _parse_mark = false;
+	// ARRAY stored in _numbers
+	bool _packed = false;
+	// NUMBER stored in _raw_number
+	bool _raw = false;
+	// a non-const reference to a member was handed out, caches aren't kept
+	bool _lent = false;
+	std::unique_ptr<Cache> _cache;
 	union {
 		bool _boolean;
 		double _number;
+		RawNumber _raw_number;
 		std::string _string;
 		Array _array;
 		Object _object;
+		std::vector<double> _numbers;
 	};
 
 	void copyUnion(const Json &_j);
+	void moveUnion(Json &&_j);
 	void destroyUnion();
+	void invalidateCache();
+	// invalidateCache() before handing out a member by non-const reference
+	void lend();
+	bool hashCached() const;
+	void copyHash(const Json &_j);
+	// Build this (NUL) as a compact copy of _j
+	void compactFrom(const Json &_j);
+	// memoryUsage() without sizeof(Json)
+	std::size_t heapUsage() const;
+	double rawValue() const;
+	std::uint64_t hashValue() const;
+};
+
+
+class JsonParser {
+public:
+	JsonParser(const std::string &_str, const ParseOptions &_options = ParseOptions());
+	Json parse();
+	void parseInto(Json &target);
+	Json::State parseEvents(JsonHandler &handler);
+	// Copy input to out without whitespace, or indented if indent is given
+	Json::State transcode(std::string &out, const std::string *indent);
+
+	// =================Tokenizer==============
+	// Primitives below are shared with typed binding, the ones taking
+	// a char expect that char already consumed by nextToken()
+
+	// Skip whitespace, return next char and step over it
+	char nextToken();
+	// Parse a whole value, containers are walked with an explicit stack
+	Json parseValue(char ch);
+	// Like parseValue, but overwrite target in place
+	bool parseValueInto(char ch, Json &target);
+	// Like parseValue, but report the value to handler
+	bool parseEvents(char ch, JsonHandler &handler);
+	bool transcode(char ch, std::string &out, const std::string *indent);
+	// Parse string body after the opening quote
+	std::string parseRawString();
+	// Like parseRawString, but sv points into input when the string has
+	// no escapes, otherwise it is decoded into buf
+	bool parseRawStringView(std::string_view &sv, std::string &buf);
+	// Validate a number, [begin, end) is its text in input
+	bool scanNumber(size_t &begin, size_t &end);
+	bool parseRawNumber(double &n);
+	// Like parseRawNumber, but store the number into j, as text if
+	// ParseOptions::lazy_numbers is set
+	bool parseNumberInto(Json &j);
+	// Match null/true/false
+	bool parseLiteral(const char *lit);
+	bool skipValue(char ch);
+	// Track container nesting against ParseOptions::max_depth
+	bool enterDepth();
+	void leaveDepth();
+	// Skip trailing whitespace, true if the whole input is consumed
+	bool atEnd();
+
+	// A ParseLimits error wins over the syntax error that stopping leads to
+	Json::State state() const;
+	// Record an error, the first error wins
+	void setState(Json::State s);
+	// End of a parse: the state, reported at ParseOptions::error_offset if it's an error
+	Json::State finish();
+	size_t position() const;
+	const std::string &input() const;
+private:
+	Json::State _parse_state = Json::PARSE_OK;
+	const std::string &_parse_string;
+	ParseOptions _options;
+	// index of parse string
+	size_t _i = 0;
+	size_t _depth = 0;
+	// scratch reused across values: decoded escaped strings, open containers of skipValue
+	std::string _string_buf;
+	std::string _skip_stack;
+	// ParseLimits accounting
+	Json::State _limit_state = Json::PARSE_OK;
+	size_t _limit_offset = 0;
+	size_t _nodes = 0;
+	size_t _memory = 0;
+	size_t _next_check = SIZE_MAX;
+	// separators read in each open container, outermost first
+	std::vector<size_t> _members;
+
+	// Parse an object key starting at ch and the colon after it
+	bool parseKey(char ch, std::string_view &key);
+	// Parse members from the key starting at ch until one the projection node
+	// keeps, ch is then the start of its value and child its projection.
+	// False on error, or with state OK if the object ended first.
+	bool parseMember(char &ch, const JsonProjection::Node *node, std::string_view &key,
+		const JsonProjection::Node *&child);
+	const JsonProjection::Node *rootProjection() const;
+	// Turn j into an empty value of type, keeping its storage if the type matches
+	static void reuseAs(Json &j, Json::Type type);
+	// strtod the number text at begin, out of range is PARSE_NUMBER_TOO_BIG
+	bool convertNumber(size_t begin, double &n);
+	// Parse the leading number elements of an array after ch. True if they
+	// close it, else ch starts the first other element or an error is set
+	bool parseNumberRun(char &ch, std::vector<double> &numbers);
+	void consumeWhitespace();
+	void encode_utf8(long l, std::string &res);
+	// Account for a token nextToken() read, false if that exceeds a limit
+	bool countToken(char ch);
+	// Account for a string or key of n bytes
+	bool countString(size_t n);
+	// Decoded bytes a string can reach before it exceeds max_string or,
+	// once it is counted, max_memory
+	size_t stringRoom() const;
+	// Fail with the limit a string of n bytes over stringRoom() exceeds
+	bool failString(size_t n);
+	bool checkBudget();
+	// Stop the parse with a ParseLimits state, always false
+	bool failLimit(Json::State s);
+};
+
+
+// Pull cursor over a document, built on JsonParser's tokenizer:
+//   JsonReader r(str);
+//   while (r.next()) { switch (r.token()) ... }
+// next() is false at the end of the document or on error, see state().
+// Only the open containers are kept, so memory doesn't grow with input.
+class JsonReader {
+public:
+	enum Token {
+		NONE,		// before the first next()
+		NUL, BOOLEAN, NUMBER, STRING,
+		START_ARRAY, END_ARRAY, START_OBJECT, KEY, END_OBJECT
+	};
+
+	// str is read in place and must outlive the reader
+	JsonReader(const std::string &str, const ParseOptions &options = ParseOptions());
+	JsonReader(std::string &&str, const ParseOptions &options = ParseOptions()) = delete;
+	bool next();
+	// At KEY skip the member's value, at START_ARRAY/START_OBJECT skip to
+	// the matching end token, else do nothing. False on error
+	bool skipValue();
+
+	Token token() const;
+	// KEY and STRING, points into input unless there are escapes, valid
+	// until the next call to next() or skipValue()
+	std::string_view getString() const;
+	double getNumber() const;
+	bool getBoolean() const;
+	// Containers open after the current token
+	size_t depth() const;
+	Json::State state() const;
+private:
+	// what next() reads
+	enum Expect {
+		ROOT, FIRST_ELEMENT, FIRST_MEMBER, AFTER_KEY, AFTER_VALUE, DONE
+	};
+
+	JsonParser _parser;
+	Token _token = NONE;
+	Expect _expect = ROOT;
+	// open containers as '[' or '{'
+	std::string _stack;
+	std::string_view _string;
+	std::string _string_buf;
+	double _number = 0;
+	bool _boolean = false;
+
+	bool readValue(char ch);
+	bool readKey(char ch);
+	bool close();
+};
+
+// Handler which builds the Json its events describe
+class JsonBuilder : public JsonHandler {
+public:
+	bool null() override;
+	bool boolean(bool b) override;
+	bool number(double n) override;
+	bool string(std::string_view s) override;
+	bool startArray() override;
+	bool endArray() override;
+	bool startObject() override;
+	bool key(std::string_view k) override;
+	bool endObject() override;
+
+	// The complete value, take it with std::move
+	Json &result();
+private:
+	// open containers and the key of the member being built in each object
+	std::vector<Json> _stack;
+	std::vector<std::string> _keys;
+	Json _result;
+
+	bool add(Json &&value);
+};
+
+class JsonStringify {
+public:
+	JsonStringify(const Json &_j);
+	std::string stringify();
+
+	static std::string stringifyNumber(double _n);
+	static std::string stringifyString(const std::string &_s);
+	static void appendString(std::string &res, const std::string &_s);
+	// Write j as stringify() does
+	static void appendValue(std::string &res, const Json &j);
+	// Write a scalar or a packed array
+	static void appendLeaf(std::string &res, const Json &j);
+	// Write a packed array
+	static void appendNumbers(std::string &res, const std::vector<double> &numbers);
+	// Format number into buf (at least 32 bytes), return its length
+	static size_t formatNumber(double _n, char *buf);
+private:
+	const Json &_json;
+};
+
+
+// Resumable stringify: output is pulled in bounded chunks and the position
+// in the tree is kept on an explicit stack, so no buffer holding the whole
+// document is ever allocated. The tree must not change until finished().
+class JsonChunkStringify {
+public:
+	JsonChunkStringify(const Json &_j);
+	// Write at most cap bytes of output to buf, return bytes written,
+	// 0 once the whole document is written
+	size_t nextChunk(char *buf, size_t cap);
+	bool finished() const;
+private:
+	struct Frame {
+		const Json *json;
+		size_t index;	// elements (members) started so far
+		Json::ConstObjectIterator iter;
+		bool key_done;	// object member key is written, value is next
+	};
+
+	std::vector<Frame> _stack;
+	const Json *_next;	// value to start at next step
+	// string being written and position in it
+	const std::string *_str = nullptr;
+	size_t _str_pos = 0;
+	bool _str_raw = false;	// number text, not quoted
+	// small token (literal, number, punctuation, escape) not yet written
+	char _pending[32];
+	size_t _pending_len = 0;
+	size_t _pending_pos = 0;
+
+	bool step();
+	void startValue(const Json &j);
+	size_t writeString(char *buf, size_t cap);
+	void queue(const char *s, size_t len);
 };
 
 
 
 } // namespace json
 } // namespace ll
+
+namespace std {
+
+template <>
+struct hash<ll::json::Json> {
+	size_t operator()(const ll::json::Json &j) const {
+		return j.hash();
+	}
+};
+
+} // namespace std
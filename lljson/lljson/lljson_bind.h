@@ -0,0 +1,620 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <array>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "lljson.h"
+
+// Typed binding: parse JSON text straight into C++ structs and write them
+// back without building a Json tree.
+//
+//	struct Point { double x; double y; std::optional<std::string> label; };
+//	LLJSON_BIND(Point, x, y, label)
+//
+//	Point pt;
+//	Json::State s = ll::json::bindParse(R"({"x":1,"y":2})", pt);
+//	std::string out = ll::json::bindStringify(pt);
+//
+// LLJSON_BIND goes in the namespace of the struct (found by ADL) and takes
+// up to 64 fields. They may be bool, arithmetic types, std::string, Json,
+// bound structs, and std::vector / std::optional / std::map<std::string, T>
+// of those.
+// Unknown keys are skipped, or parsed into the Json object member named by
+// LLJSON_BIND_REST(Type, member) if there is one. A missing non-optional
+// field is PARSE_MISS_FIELD and a value of the wrong JSON type is
+// PARSE_TYPE_MISMATCH.
+//
+// The field list is the schema: keys are dispatched through a perfect
+// hash table computed at compile time, a key costs one hash, one
+// memcmp and an indirect call to the typed reader of its field.
+
+#define LLJSON_BIND(Type, ...)\
+	inline constexpr auto lljsonFields(const Type *)\
+	{\
+		return std::make_tuple(LLJSON_EXPAND(LLJSON_FOR_EACH(LLJSON_BIND_FIELD, Type, __VA_ARGS__)));\
+	}
+
+#define LLJSON_BIND_REST(Type, f)\
+	inline constexpr auto lljsonRest(const Type *)\
+	{\
+		return &Type::f;\
+	}
+
+#define LLJSON_BIND_FIELD(Type, f) ::ll::json::BindField<Type, decltype(Type::f)>{ #f, &Type::f }
+
+// MSVC expands __VA_ARGS__ as a single token without this
+#define LLJSON_EXPAND(x) x
+#define LLJSON_FOR_EACH(M, T, ...)\
+	LLJSON_EXPAND(LLJSON_FE_PICK(__VA_ARGS__, LLJSON_FE_64, LLJSON_FE_63, LLJSON_FE_62, LLJSON_FE_61, LLJSON_FE_60, LLJSON_FE_59, LLJSON_FE_58, LLJSON_FE_57, LLJSON_FE_56, LLJSON_FE_55, LLJSON_FE_54, LLJSON_FE_53, LLJSON_FE_52, LLJSON_FE_51, LLJSON_FE_50, LLJSON_FE_49, LLJSON_FE_48, LLJSON_FE_47, LLJSON_FE_46, LLJSON_FE_45, LLJSON_FE_44, LLJSON_FE_43, LLJSON_FE_42, LLJSON_FE_41, LLJSON_FE_40, LLJSON_FE_39, LLJSON_FE_38, LLJSON_FE_37, LLJSON_FE_36, LLJSON_FE_35, LLJSON_FE_34, LLJSON_FE_33, LLJSON_FE_32, LLJSON_FE_31, LLJSON_FE_30, LLJSON_FE_29, LLJSON_FE_28, LLJSON_FE_27, LLJSON_FE_26, LLJSON_FE_25, LLJSON_FE_24, LLJSON_FE_23, LLJSON_FE_22, LLJSON_FE_21, LLJSON_FE_20, LLJSON_FE_19, LLJSON_FE_18, LLJSON_FE_17, LLJSON_FE_16, LLJSON_FE_15, LLJSON_FE_14, LLJSON_FE_13, LLJSON_FE_12, LLJSON_FE_11, LLJSON_FE_10, LLJSON_FE_9, LLJSON_FE_8, LLJSON_FE_7, LLJSON_FE_6, LLJSON_FE_5, LLJSON_FE_4, LLJSON_FE_3, LLJSON_FE_2, LLJSON_FE_1)(M, T, __VA_ARGS__))
+#define LLJSON_FE_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, _33, _34, _35, _36, _37, _38, _39, _40, _41, _42, _43, _44, _45, _46, _47, _48, _49, _50, _51, _52, _53, _54, _55, _56, _57, _58, _59, _60, _61, _62, _63, _64, N, ...) N
+#define LLJSON_FE_1(M, T, a) M(T, a)
+#define LLJSON_FE_2(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_1(M, T, __VA_ARGS__))
+#define LLJSON_FE_3(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_2(M, T, __VA_ARGS__))
+#define LLJSON_FE_4(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_3(M, T, __VA_ARGS__))
+#define LLJSON_FE_5(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_4(M, T, __VA_ARGS__))
+#define LLJSON_FE_6(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_5(M, T, __VA_ARGS__))
+#define LLJSON_FE_7(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_6(M, T, __VA_ARGS__))
+#define LLJSON_FE_8(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_7(M, T, __VA_ARGS__))
+#define LLJSON_FE_9(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_8(M, T, __VA_ARGS__))
+#define LLJSON_FE_10(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_9(M, T, __VA_ARGS__))
+#define LLJSON_FE_11(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_10(M, T, __VA_ARGS__))
+#define LLJSON_FE_12(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_11(M, T, __VA_ARGS__))
+#define LLJSON_FE_13(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_12(M, T, __VA_ARGS__))
+#define LLJSON_FE_14(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_13(M, T, __VA_ARGS__))
+#define LLJSON_FE_15(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_14(M, T, __VA_ARGS__))
+#define LLJSON_FE_16(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_15(M, T, __VA_ARGS__))
+#define LLJSON_FE_17(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_16(M, T, __VA_ARGS__))
+#define LLJSON_FE_18(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_17(M, T, __VA_ARGS__))
+#define LLJSON_FE_19(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_18(M, T, __VA_ARGS__))
+#define LLJSON_FE_20(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_19(M, T, __VA_ARGS__))
+#define LLJSON_FE_21(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_20(M, T, __VA_ARGS__))
+#define LLJSON_FE_22(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_21(M, T, __VA_ARGS__))
+#define LLJSON_FE_23(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_22(M, T, __VA_ARGS__))
+#define LLJSON_FE_24(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_23(M, T, __VA_ARGS__))
+#define LLJSON_FE_25(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_24(M, T, __VA_ARGS__))
+#define LLJSON_FE_26(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_25(M, T, __VA_ARGS__))
+#define LLJSON_FE_27(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_26(M, T, __VA_ARGS__))
+#define LLJSON_FE_28(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_27(M, T, __VA_ARGS__))
+#define LLJSON_FE_29(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_28(M, T, __VA_ARGS__))
+#define LLJSON_FE_30(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_29(M, T, __VA_ARGS__))
+#define LLJSON_FE_31(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_30(M, T, __VA_ARGS__))
+#define LLJSON_FE_32(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_31(M, T, __VA_ARGS__))
+#define LLJSON_FE_33(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_32(M, T, __VA_ARGS__))
+#define LLJSON_FE_34(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_33(M, T, __VA_ARGS__))
+#define LLJSON_FE_35(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_34(M, T, __VA_ARGS__))
+#define LLJSON_FE_36(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_35(M, T, __VA_ARGS__))
+#define LLJSON_FE_37(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_36(M, T, __VA_ARGS__))
+#define LLJSON_FE_38(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_37(M, T, __VA_ARGS__))
+#define LLJSON_FE_39(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_38(M, T, __VA_ARGS__))
+#define LLJSON_FE_40(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_39(M, T, __VA_ARGS__))
+#define LLJSON_FE_41(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_40(M, T, __VA_ARGS__))
+#define LLJSON_FE_42(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_41(M, T, __VA_ARGS__))
+#define LLJSON_FE_43(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_42(M, T, __VA_ARGS__))
+#define LLJSON_FE_44(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_43(M, T, __VA_ARGS__))
+#define LLJSON_FE_45(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_44(M, T, __VA_ARGS__))
+#define LLJSON_FE_46(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_45(M, T, __VA_ARGS__))
+#define LLJSON_FE_47(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_46(M, T, __VA_ARGS__))
+#define LLJSON_FE_48(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_47(M, T, __VA_ARGS__))
+#define LLJSON_FE_49(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_48(M, T, __VA_ARGS__))
+#define LLJSON_FE_50(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_49(M, T, __VA_ARGS__))
+#define LLJSON_FE_51(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_50(M, T, __VA_ARGS__))
+#define LLJSON_FE_52(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_51(M, T, __VA_ARGS__))
+#define LLJSON_FE_53(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_52(M, T, __VA_ARGS__))
+#define LLJSON_FE_54(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_53(M, T, __VA_ARGS__))
+#define LLJSON_FE_55(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_54(M, T, __VA_ARGS__))
+#define LLJSON_FE_56(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_55(M, T, __VA_ARGS__))
+#define LLJSON_FE_57(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_56(M, T, __VA_ARGS__))
+#define LLJSON_FE_58(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_57(M, T, __VA_ARGS__))
+#define LLJSON_FE_59(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_58(M, T, __VA_ARGS__))
+#define LLJSON_FE_60(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_59(M, T, __VA_ARGS__))
+#define LLJSON_FE_61(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_60(M, T, __VA_ARGS__))
+#define LLJSON_FE_62(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_61(M, T, __VA_ARGS__))
+#define LLJSON_FE_63(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_62(M, T, __VA_ARGS__))
+#define LLJSON_FE_64(M, T, a, ...) M(T, a), LLJSON_EXPAND(LLJSON_FE_63(M, T, __VA_ARGS__))
+
+namespace ll {
+
+namespace json {
+
+template <class C, class M>
+struct BindField {
+	std::string_view name;
+	M C::*member;
+};
+
+namespace detail {
+
+template <class T, class = void>
+struct IsBound : std::false_type {};
+template <class T>
+struct IsBound<T, std::void_t<decltype(lljsonFields(static_cast<const T *>(nullptr)))>> : std::true_type {};
+
+template <class T, class = void>
+struct HasRest : std::false_type {};
+template <class T>
+struct HasRest<T, std::void_t<decltype(lljsonRest(static_cast<const T *>(nullptr)))>> : std::true_type {};
+
+template <class T>
+struct IsOptional : std::false_type {};
+template <class T>
+struct IsOptional<std::optional<T>> : std::true_type {};
+
+template <class T>
+struct IsVector : std::false_type {};
+template <class T, class A>
+struct IsVector<std::vector<T, A>> : std::true_type {};
+
+template <class T>
+struct IsMap : std::false_type {};
+template <class T, class C, class A>
+struct IsMap<std::map<std::string, T, C, A>> : std::true_type {};
+
+template <class T>
+struct AlwaysFalse : std::false_type {};
+
+// Error path is built only while unwinding from a failure
+inline void prependPath(std::string *path, std::string_view segment)
+{
+	if (path == nullptr) return;
+	std::string escaped = "/";
+	for (char ch : segment) {
+		if (ch == '~') escaped += "~0";
+		else if (ch == '/') escaped += "~1";
+		else escaped += ch;
+	}
+	path->insert(0, escaped);
+}
+
+inline bool mismatch(JsonParser &p)
+{
+	p.setState(Json::PARSE_TYPE_MISMATCH);
+	return false;
+}
+
+// Convert validated number text to an integer, exact for the full
+// int64/uint64 range, numbers with frac/exp must still be integral
+template <class T>
+bool toInteger(JsonParser &p, size_t begin, size_t end, T &out)
+{
+	const char *s = p.input().c_str();
+	bool negative = (s[begin] == '-');
+	bool plain = true;
+	for (size_t i = begin; i < end; i++) {
+		if (s[i] == '.' || s[i] == 'e' || s[i] == 'E') plain = false;
+	}
+	if (plain) {
+		uint64_t mag = 0;
+		for (size_t i = begin + (negative ? 1 : 0); i < end; i++) {
+			uint64_t digit = static_cast<uint64_t>(s[i] - '0');
+			if (mag > (std::numeric_limits<uint64_t>::max() - digit) / 10) return mismatch(p);
+			mag = mag * 10 + digit;
+		}
+		if (negative) {
+			if (!std::is_signed<T>::value && mag != 0) return mismatch(p);
+			if (mag > static_cast<uint64_t>(std::numeric_limits<T>::max()) + 1) return mismatch(p);
+			out = static_cast<T>(0 - mag);
+		}
+		else {
+			if (mag > static_cast<uint64_t>(std::numeric_limits<T>::max())) return mismatch(p);
+			out = static_cast<T>(mag);
+		}
+		return true;
+	}
+	double d = strtod(s + begin, nullptr);
+	if (d < static_cast<double>(std::numeric_limits<T>::min())
+		|| d >= static_cast<double>(std::numeric_limits<T>::max()) + 1.0
+		|| std::trunc(d) != d) {
+		return mismatch(p);
+	}
+	out = static_cast<T>(d);
+	return true;
+}
+
+template <class T>
+bool readValue(JsonParser &p, char ch, T &out, std::string *path);
+
+//========================key dispatch=========================================
+constexpr uint32_t keyHash(std::string_view key, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ seed;
+	for (char ch : key) {
+		h ^= static_cast<unsigned char>(ch);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Slot holds field index + 1, 0 is empty
+template <size_t M>
+struct KeyTable {
+	uint32_t seed = 0;
+	std::array<uint8_t, M> slot{};
+};
+
+// Search a seed that maps every name to its own slot, evaluated at
+// compile time, a throw here surfaces as a compile error
+template <size_t M, size_t N>
+constexpr KeyTable<M> makeKeyTable(const std::array<std::string_view, N> &names)
+{
+	for (size_t i = 0; i < N; i++) {
+		for (size_t j = i + 1; j < N; j++) {
+			if (names[i] == names[j]) throw "LLJSON_BIND: duplicated field";
+		}
+	}
+	for (uint32_t seed = 0; seed < 4096; seed++) {
+		KeyTable<M> t{};
+		t.seed = seed;
+		bool ok = true;
+		for (size_t i = 0; i < N && ok; i++) {
+			size_t s = keyHash(names[i], seed) & (M - 1);
+			if (t.slot[s] != 0) ok = false;
+			else t.slot[s] = static_cast<uint8_t>(i + 1);
+		}
+		if (ok) return t;
+	}
+	throw "LLJSON_BIND: no perfect hash found";
+}
+
+constexpr size_t keyTableSize(size_t n)
+{
+	// load factor <= 1/8 keeps the seed search short
+	size_t m = 8;
+	while (m < n * 8) m *= 2;
+	return m;
+}
+
+template <class T, size_t I>
+bool readFieldAt(JsonParser &p, char ch, T &out, std::string *path)
+{
+	constexpr auto fields = lljsonFields(static_cast<const T *>(nullptr));
+	return readValue(p, ch, out.*(std::get<I>(fields).member), path);
+}
+
+template <class T>
+struct FieldDispatch {
+	using Reader = bool (*)(JsonParser &, char, T &, std::string *);
+	static constexpr auto fields = lljsonFields(static_cast<const T *>(nullptr));
+	static constexpr size_t count = std::tuple_size<std::decay_t<decltype(fields)>>::value;
+
+	template <size_t... I>
+	static constexpr std::array<std::string_view, count> makeNames(std::index_sequence<I...>)
+	{
+		return { { std::get<I>(fields).name... } };
+	}
+	template <size_t... I>
+	static constexpr std::array<Reader, count> makeReaders(std::index_sequence<I...>)
+	{
+		return { { &readFieldAt<T, I>... } };
+	}
+
+	static constexpr std::array<std::string_view, count> names = makeNames(std::make_index_sequence<count>());
+	static constexpr std::array<Reader, count> readers = makeReaders(std::make_index_sequence<count>());
+	static constexpr size_t tableSize = keyTableSize(count);
+	static constexpr KeyTable<tableSize> table = makeKeyTable<tableSize>(names);
+
+	// Field index of key, count if key is unknown
+	static size_t find(std::string_view key)
+	{
+		uint8_t f = table.slot[keyHash(key, table.seed) & (tableSize - 1)];
+		if (f != 0 && names[f - 1] == key) {
+			return f - 1;
+		}
+		return count;
+	}
+};
+
+template <class T, class Fields, size_t... I>
+bool checkFields(JsonParser &p, const Fields &fields, uint64_t seen, std::string *path, std::index_sequence<I...>)
+{
+	bool ok = true;
+	((ok && !(seen & (uint64_t(1) << I))
+		&& !IsOptional<std::decay_t<decltype(std::declval<T &>().*(std::get<I>(fields).member))>>::value
+		? (ok = false, prependPath(path, std::get<I>(fields).name), p.setState(Json::PARSE_MISS_FIELD), 0)
+		: 0), ...);
+	return ok;
+}
+
+// Absent optional fields read as std::nullopt, also when out is reused
+template <class T, class Fields, size_t... I>
+void resetOptionals(T &out, const Fields &fields, std::index_sequence<I...>)
+{
+	auto reset = [](auto &field) {
+		if constexpr (IsOptional<std::decay_t<decltype(field)>>::value) field.reset();
+	};
+	(reset(out.*(std::get<I>(fields).member)), ...);
+}
+
+template <class T>
+bool readStruct(JsonParser &p, char ch, T &out, std::string *path)
+{
+	using Dispatch = FieldDispatch<T>;
+	static_assert(Dispatch::count <= 64, "LLJSON_BIND supports at most 64 fields");
+
+	if (ch != '{') return mismatch(p);
+	if (!p.enterDepth()) return false;
+	uint64_t seen = 0;
+	std::string buf;
+	if constexpr (HasRest<T>::value) {
+		out.*lljsonRest(static_cast<const T *>(nullptr)) = Json::Object{};
+	}
+	resetOptionals(out, Dispatch::fields, std::make_index_sequence<Dispatch::count>());
+	ch = p.nextToken();
+	if (ch != '}') {
+		while (true) {
+			if (ch != '"') {
+				p.setState(Json::PARSE_MISS_KEY);
+				return false;
+			}
+			std::string_view key;
+			if (!p.parseRawStringView(key, buf)) return false;
+			if (p.nextToken() != ':') {
+				p.setState(Json::PARSE_MISS_COLON);
+				return false;
+			}
+			ch = p.nextToken();
+			if (p.state() != Json::PARSE_OK) return false;
+			size_t f = Dispatch::find(key);
+			if (f < Dispatch::count) {
+				seen |= (uint64_t(1) << f);
+				if (!Dispatch::readers[f](p, ch, out, path)) {
+					prependPath(path, key);
+					return false;
+				}
+			}
+			else if constexpr (HasRest<T>::value) {
+				// generic path for keys outside the schema
+				Json value = p.parseValue(ch);
+				p.setState(value.state());
+				if (p.state() != Json::PARSE_OK) return false;
+				(out.*lljsonRest(static_cast<const T *>(nullptr)))[key] = std::move(value);
+			}
+			else if (!p.skipValue(ch)) {
+				return false;
+			}
+
+			ch = p.nextToken();
+			if (ch == ',') {
+				ch = p.nextToken();
+			}
+			else if (ch == '}') {
+				break;
+			}
+			else {
+				p.setState(Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+				return false;
+			}
+		}
+	}
+	p.leaveDepth();
+	return checkFields<T>(p, Dispatch::fields, seen, path, std::make_index_sequence<Dispatch::count>());
+}
+
+template <class T>
+bool readValue(JsonParser &p, char ch, T &out, std::string *path)
+{
+	if (p.state() != Json::PARSE_OK) return false;
+	if constexpr (std::is_same<T, bool>::value) {
+		if (ch == 't') return (out = true, p.parseLiteral("true"));
+		if (ch == 'f') return (out = false, p.parseLiteral("false"));
+		return mismatch(p);
+	}
+	else if constexpr (std::is_arithmetic<T>::value) {
+		if (ch != '-' && (ch < '0' || ch > '9')) return mismatch(p);
+		if constexpr (std::is_floating_point<T>::value) {
+			double n;
+			if (!p.parseRawNumber(n)) return false;
+			out = static_cast<T>(n);
+			return true;
+		}
+		else {
+			size_t begin, end;
+			if (!p.scanNumber(begin, end)) return false;
+			return toInteger(p, begin, end, out);
+		}
+	}
+	else if constexpr (std::is_same<T, std::string>::value) {
+		if (ch != '"') return mismatch(p);
+		out = p.parseRawString();
+		return p.state() == Json::PARSE_OK;
+	}
+	else if constexpr (std::is_same<T, Json>::value) {
+		out = p.parseValue(ch);
+		p.setState(out.state());
+		return p.state() == Json::PARSE_OK;
+	}
+	else if constexpr (IsOptional<T>::value) {
+		if (ch == 'n') {
+			out.reset();
+			return p.parseLiteral("null");
+		}
+		if (!out) out.emplace();
+		return readValue(p, ch, *out, path);
+	}
+	else if constexpr (IsVector<T>::value) {
+		if (ch != '[') return mismatch(p);
+		if (!p.enterDepth()) return false;
+		out.clear();
+		ch = p.nextToken();
+		if (ch == ']') {
+			p.leaveDepth();
+			return true;
+		}
+		while (true) {
+			typename T::value_type elem{};
+			if (!readValue(p, ch, elem, path)) {
+				prependPath(path, std::to_string(out.size()));
+				return false;
+			}
+			out.push_back(std::move(elem));
+			ch = p.nextToken();
+			if (ch == ',') {
+				ch = p.nextToken();
+			}
+			else if (ch == ']') {
+				p.leaveDepth();
+				return true;
+			}
+			else {
+				p.setState(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+				return false;
+			}
+		}
+	}
+	else if constexpr (IsMap<T>::value) {
+		if (ch != '{') return mismatch(p);
+		if (!p.enterDepth()) return false;
+		out.clear();
+		ch = p.nextToken();
+		if (ch == '}') {
+			p.leaveDepth();
+			return true;
+		}
+		while (true) {
+			if (ch != '"') {
+				p.setState(Json::PARSE_MISS_KEY);
+				return false;
+			}
+			std::string key = p.parseRawString();
+			if (p.state() != Json::PARSE_OK) return false;
+			if (p.nextToken() != ':') {
+				p.setState(Json::PARSE_MISS_COLON);
+				return false;
+			}
+			typename T::mapped_type value{};
+			if (!readValue(p, p.nextToken(), value, path)) {
+				prependPath(path, key);
+				return false;
+			}
+			out[std::move(key)] = std::move(value);
+			ch = p.nextToken();
+			if (ch == ',') {
+				ch = p.nextToken();
+			}
+			else if (ch == '}') {
+				p.leaveDepth();
+				return true;
+			}
+			else {
+				p.setState(Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+				return false;
+			}
+		}
+	}
+	else if constexpr (IsBound<T>::value) {
+		return readStruct(p, ch, out, path);
+	}
+	else {
+		static_assert(AlwaysFalse<T>::value, "type is not bindable, use LLJSON_BIND");
+		return false;
+	}
+}
+
+template <class T>
+void writeValue(std::string &res, const T &v)
+{
+	if constexpr (std::is_same<T, bool>::value) {
+		res += (v ? "true" : "false");
+	}
+	else if constexpr (std::is_integral<T>::value) {
+		res += std::to_string(v);
+	}
+	else if constexpr (std::is_floating_point<T>::value) {
+		res += JsonStringify::stringifyNumber(static_cast<double>(v));
+	}
+	else if constexpr (std::is_same<T, std::string>::value) {
+		res += JsonStringify::stringifyString(v);
+	}
+	else if constexpr (std::is_same<T, Json>::value) {
+		res += Json::stringify(v);
+	}
+	else if constexpr (IsOptional<T>::value) {
+		if (v) writeValue(res, *v);
+		else res += "null";
+	}
+	else if constexpr (IsVector<T>::value) {
+		res += '[';
+		bool first = true;
+		for (const auto &e : v) {
+			if (!first) { res += ','; }
+			writeValue(res, static_cast<const typename T::value_type &>(e));
+			first = false;
+		}
+		res += ']';
+	}
+	else if constexpr (IsMap<T>::value) {
+		res += '{';
+		bool first = true;
+		for (const auto &kv : v) {
+			if (!first) { res += ','; }
+			res += JsonStringify::stringifyString(kv.first);
+			res += ':';
+			writeValue(res, kv.second);
+			first = false;
+		}
+		res += '}';
+	}
+	else if constexpr (IsBound<T>::value) {
+		constexpr auto fields = lljsonFields(static_cast<const T *>(nullptr));
+		res += '{';
+		bool first = true;
+		// field names are C++ identifiers, no escaping needed
+		std::apply([&](const auto &... f) {
+			((res += (first ? "\"" : ",\""), res.append(f.name.data(), f.name.size()), res += "\":",
+				writeValue(res, v.*(f.member)), first = false), ...);
+		}, fields);
+		if constexpr (HasRest<T>::value) {
+			const Json &rest = v.*lljsonRest(static_cast<const T *>(nullptr));
+			if (rest.isObject()) {
+				for (const auto &kv : rest.getObject()) {
+					res += (first ? "" : ",");
+					res += JsonStringify::stringifyString(kv.first);
+					res += ':';
+					res += Json::stringify(kv.second);
+					first = false;
+				}
+			}
+		}
+		res += '}';
+	}
+	else {
+		static_assert(AlwaysFalse<T>::value, "type is not bindable, use LLJSON_BIND");
+	}
+}
+
+} // namespace detail
+
+// Parse str straight into out, on error return the state and, if
+// error_path is given, the JSON Pointer of the offending value
+template <class T>
+Json::State bindParse(const std::string &str, T &out, std::string *error_path = nullptr)
+{
+	JsonParser p(str);
+	if (error_path != nullptr) {
+		error_path->clear();
+	}
+	char ch = p.nextToken();
+	if (detail::readValue(p, ch, out, error_path) && !p.atEnd()) {
+		p.setState(Json::PARSE_ROOT_NOT_SINGULAR);
+	}
+	return p.state();
+}
+
+template <class T>
+std::string bindStringify(const T &v)
+{
+	std::string res;
+	detail::writeValue(res, v);
+	return res;
+}
+
+} // namespace json
+} // namespace ll
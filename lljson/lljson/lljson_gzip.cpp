@@ -0,0 +1,309 @@
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#include "lljson_gzip.h"
+
+namespace ll {
+
+namespace json {
+
+//========================aux function=========================================
+static bool isBlank(char ch)
+{
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static bool isBlank(const std::string &s)
+{
+	for (char ch : s) {
+		if (!isBlank(ch)) return false;
+	}
+	return true;
+}
+
+//========================ChunkRing============================================
+// Chunks filled by the inflating thread and drained in order by the parsing one
+class ChunkRing {
+public:
+	ChunkRing(size_t chunk_size, size_t chunk_count)
+		:_chunks(chunk_count, std::string(chunk_size, '\0')), _sizes(chunk_count)
+	{
+	}
+
+	// Inflating thread, until end of file, an error or stop()
+	void run(gzFile file)
+	{
+		for (;;) {
+			size_t slot;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_not_full.wait(lock, [this] { return _stop || _produced - _consumed < _chunks.size(); });
+				if (_stop) return;
+				slot = _produced % _chunks.size();
+			}
+			std::string &chunk = _chunks[slot];
+			int n = gzread(file, &chunk[0], static_cast<unsigned>(chunk.size()));
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (n > 0) {
+					_sizes[slot] = static_cast<size_t>(n);
+					_produced++;
+				}
+				else {
+					_error = n < 0;
+					_end = true;
+				}
+			}
+			_not_empty.notify_one();
+			if (n <= 0) return;
+		}
+	}
+
+	// Wait for the next chunk, empty at the end, false on a read error.
+	// The chunk stays valid until release()
+	bool next(std::string_view &chunk)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_not_empty.wait(lock, [this] { return _produced > _consumed || _end; });
+		if (_produced > _consumed) {
+			size_t slot = _consumed % _chunks.size();
+			chunk = std::string_view(_chunks[slot].data(), _sizes[slot]);
+			return true;
+		}
+		chunk = std::string_view();
+		return !_error;
+	}
+
+	void release()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_consumed++;
+		}
+		_not_full.notify_one();
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_not_full.notify_one();
+	}
+private:
+	std::vector<std::string> _chunks;
+	std::vector<size_t> _sizes;
+	size_t _produced = 0, _consumed = 0;
+	bool _end = false, _error = false, _stop = false;
+	std::mutex _mutex;
+	std::condition_variable _not_full, _not_empty;
+};
+
+//========================RecordSplitter=======================================
+// Finds record boundaries in chunks as they come, the unfinished record
+// is carried in _pending. ARRAY tracks strings and nesting to find the
+// commas between elements, the elements are checked by the parser.
+class RecordSplitter {
+public:
+	RecordSplitter(JsonGzipReader::Layout layout, const std::function<bool(Json &&)> &callback,
+		const ParseOptions &options)
+		:_layout(layout), _callback(callback), _options(options)
+	{
+	}
+
+	// false when reading stops, see state()
+	bool feed(std::string_view chunk)
+	{
+		switch (_layout) {
+		case JsonGzipReader::NDJSON:
+			return feedLines(chunk);
+		case JsonGzipReader::ARRAY:
+			return feedArray(chunk);
+		default:
+			_pending.append(chunk.data(), chunk.size());
+			return true;
+		}
+	}
+
+	// End of input, the state of the whole read
+	Json::State finish()
+	{
+		switch (_layout) {
+		case JsonGzipReader::NDJSON:
+			emit(true);
+			break;
+		case JsonGzipReader::ARRAY:
+			if (!_started) _state = Json::PARSE_EXPECT_VALUE;
+			else if (!_closed) _state = Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+			break;
+		default:
+			emit(false);
+			break;
+		}
+		return _state;
+	}
+
+	Json::State state() const
+	{
+		return _state;
+	}
+private:
+	JsonGzipReader::Layout _layout;
+	const std::function<bool(Json &&)> &_callback;
+	const ParseOptions &_options;
+	Json::State _state = Json::PARSE_OK;
+	std::string _pending;
+	// ARRAY
+	bool _started = false, _closed = false;
+	bool _in_string = false, _escape = false;
+	size_t _depth = 0;
+	size_t _count = 0;
+
+	// Parse and pass on _pending, a blank one is skipped if allowed
+	bool emit(bool skip_blank)
+	{
+		if (skip_blank && isBlank(_pending)) {
+			_pending.clear();
+			return true;
+		}
+		Json record = Json::parse(_pending, _options);
+		_pending.clear();
+		if (record.state() != Json::PARSE_OK) {
+			_state = record.state();
+			return false;
+		}
+		if (!_callback(std::move(record))) {
+			_state = Json::PARSE_ABORTED;
+			return false;
+		}
+		return true;
+	}
+
+	bool feedLines(std::string_view chunk)
+	{
+		for (;;) {
+			const char *nl = static_cast<const char *>(std::memchr(chunk.data(), '\n', chunk.size()));
+			if (nl == nullptr) {
+				_pending.append(chunk.data(), chunk.size());
+				return true;
+			}
+			size_t n = static_cast<size_t>(nl - chunk.data());
+			_pending.append(chunk.data(), n);
+			if (!emit(true)) return false;
+			chunk.remove_prefix(n + 1);
+		}
+	}
+
+	bool feedArray(std::string_view chunk)
+	{
+		size_t begin = 0;
+		for (size_t i = 0; i < chunk.size(); i++) {
+			char ch = chunk[i];
+			if (_in_string) {
+				if (_escape) _escape = false;
+				else if (ch == '\\') _escape = true;
+				else if (ch == '"') _in_string = false;
+				continue;
+			}
+			if (_closed || !_started) {
+				if (isBlank(ch)) continue;
+				if (_closed) {
+					_state = Json::PARSE_ROOT_NOT_SINGULAR;
+					return false;
+				}
+				if (ch != '[') {
+					_state = Json::PARSE_TYPE_MISMATCH;
+					return false;
+				}
+				_started = true;
+				begin = i + 1;
+				continue;
+			}
+			switch (ch) {
+			case '"':
+				_in_string = true;
+				break;
+			case '[':
+			case '{':
+				_depth++;
+				break;
+			case ']':
+			case '}':
+				if (_depth > 0) {
+					_depth--;
+					break;
+				}
+				if (ch == '}') {
+					_state = Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+					return false;
+				}
+				_pending.append(chunk.data() + begin, i - begin);
+				_closed = true;
+				begin = i + 1;
+				if (!emit(_count == 0)) return false;
+				break;
+			case ',':
+				if (_depth > 0) break;
+				_pending.append(chunk.data() + begin, i - begin);
+				begin = i + 1;
+				_count++;
+				if (!emit(false)) return false;
+				break;
+			default:
+				break;
+			}
+		}
+		if (_started && !_closed) {
+			_pending.append(chunk.data() + begin, chunk.size() - begin);
+		}
+		return true;
+	}
+};
+
+//========================JsonGzipReader=======================================
+JsonGzipReader::JsonGzipReader(size_t chunk_size, size_t chunk_count)
+	:_chunk_size(chunk_size), _chunk_count(chunk_count)
+{
+}
+
+Json::State JsonGzipReader::read(const std::string & path, Layout layout,
+	const std::function<bool(Json&&)>& callback, const ParseOptions & options) const
+{
+	gzFile file = gzopen(path.c_str(), "rb");
+	if (file == nullptr) {
+		return Json::PARSE_INPUT_ERROR;
+	}
+	ChunkRing ring(_chunk_size, _chunk_count);
+	std::thread inflater([&ring, file] { ring.run(file); });
+	RecordSplitter splitter(layout, callback, options);
+	Json::State state;
+	for (;;) {
+		std::string_view chunk;
+		if (!ring.next(chunk)) {
+			state = Json::PARSE_INPUT_ERROR;
+			break;
+		}
+		if (chunk.empty()) {
+			state = splitter.finish();
+			break;
+		}
+		bool more = splitter.feed(chunk);
+		ring.release();
+		if (!more) {
+			state = splitter.state();
+			break;
+		}
+	}
+	ring.stop();
+	inflater.join();
+	gzclose(file);
+	return state;
+}
+
+} // namespace json
+} // namespace ll
@@ -0,0 +1,35 @@
+#pragma once
+#include <functional>
+#include <string>
+#include "lljson.h"
+
+namespace ll {
+
+namespace json {
+
+// Reads a gzip file (plain files are passed through by zlib) with a thread
+// inflating into a ring of fixed-size chunks while the calling thread
+// parses. Chunks are split into records as they arrive, so memory stays
+// at the ring plus the largest record whatever the file size.
+class JsonGzipReader {
+public:
+	enum Layout {
+		NDJSON,		// a record per line, blank lines are skipped
+		ARRAY,		// the root is an array, a record per element
+		DOCUMENT	// the whole file is one record
+	};
+
+	JsonGzipReader(size_t chunk_size = 1 << 16, size_t chunk_count = 4);
+
+	// Pass every record to callback in order, stop with PARSE_ABORTED when
+	// it returns false, or on the first record that fails to parse.
+	// A root that isn't an array is PARSE_TYPE_MISMATCH for ARRAY.
+	Json::State read(const std::string &path, Layout layout, const std::function<bool(Json &&)> &callback,
+		const ParseOptions &options = ParseOptions()) const;
+private:
+	size_t _chunk_size;
+	size_t _chunk_count;
+};
+
+} // namespace json
+} // namespace ll
@@ -0,0 +1,575 @@
+#include <chrono>
+#include <numeric>
+#include <queue>
+#include <unordered_set>
+#include "lljson_parallel.h"
+
+namespace ll {
+
+namespace json {
+
+//========================aux function=========================================
+// set on threads running chunks, a loop started there runs serially
+static thread_local bool in_loop = false;
+
+// Split JSON Pointer (RFC 6901) into unescaped reference tokens
+static bool splitPointer(const std::string &path, std::vector<std::string> &tokens)
+{
+	tokens.clear();
+	if (path.empty()) return true;	// whole element
+	if (path[0] != '/') return false;
+	std::string token;
+	for (size_t i = 1; i <= path.size(); i++) {
+		if (i == path.size() || path[i] == '/') {
+			tokens.push_back(std::move(token));
+			token.clear();
+		}
+		else if (path[i] == '~') {
+			if (i + 1 == path.size()) return false;
+			switch (path[++i])
+			{
+			case '0':	token += '~'; break;
+			case '1':	token += '/'; break;
+			default:	return false;
+			}
+		}
+		else {
+			token += path[i];
+		}
+	}
+	return true;
+}
+
+// Array index is "0" or digits without leading zero
+static bool parseIndex(const std::string &token, size_t &index)
+{
+	if (token.empty() || (token[0] == '0' && token.size() > 1)) return false;
+	index = 0;
+	for (char ch : token) {
+		if (ch < '0' || ch > '9') return false;
+		index = index * 10 + (ch - '0');
+	}
+	return true;
+}
+
+// Sort key of an element, string points into the element
+struct SortKey {
+	int rank;	// missing/null, false, true, number, string, array, object
+	double number;
+	const std::string *string;
+};
+
+static SortKey sortKey(const Json &element, const std::vector<std::string> &tokens)
+{
+	const SortKey missing{ 0, 0, nullptr };
+	const Json *cur = &element;
+	for (size_t t = 0; t < tokens.size(); t++) {
+		if (cur->isObject()) {
+			cur = cur->find(tokens[t]);
+			if (cur == nullptr) return missing;
+		}
+		else if (cur->isArray()) {
+			size_t i;
+			if (!parseIndex(tokens[t], i) || i >= cur->size()) return missing;
+			if (cur->isPackedArray()) {
+				return t + 1 == tokens.size() ? SortKey{ 3, cur->getNumberArray()[i], nullptr } : missing;
+			}
+			cur = &cur->getArray()[i];
+		}
+		else {
+			return missing;
+		}
+	}
+	switch (cur->type())
+	{
+	case Json::BOOLEAN:	return SortKey{ cur->getBoolean() ? 2 : 1, 0, nullptr };
+	case Json::NUMBER:	return SortKey{ 3, cur->getNumber(), nullptr };
+	case Json::STRING:	return SortKey{ 4, 0, &cur->getString() };
+	case Json::ARRAY:	return SortKey{ 5, 0, nullptr };
+	case Json::OBJECT:	return SortKey{ 6, 0, nullptr };
+	default:			return missing;
+	}
+}
+
+static bool keyLess(const SortKey &a, const SortKey &b)
+{
+	if (a.rank != b.rank) return a.rank < b.rank;
+	if (a.rank == 3) return a.number < b.number;
+	if (a.rank == 4) return *a.string < *b.string;
+	return false;
+}
+
+// A value of the output written by a worker, after the text between it
+// and the previous one (punctuation, brackets of split containers) and
+// its key if it is an object member
+struct StringifyUnit {
+	const Json *value;			// nullptr for a number of a packed array
+	double number;
+	const std::string *key;
+	size_t text_begin, text_end;	// in StringifyPlan::text
+};
+
+struct StringifyPlan {
+	std::string text;
+	std::vector<StringifyUnit> units;
+	size_t pending = 0;		// text not yet before a unit starts here
+};
+
+static bool splittable(const Json &j)
+{
+	return (j.isArray() || j.isObject()) && j.size() > 0;
+}
+
+// Containers to split, largest first while one holds more than 1/target
+// of the units so far or there are fewer than target. Element count
+// stands in for cost, the pool evens out the rest
+static std::unordered_set<const Json *> chooseSplits(const Json &root, size_t target)
+{
+	const size_t MAX_DEPTH = 64;
+	struct Candidate {
+		size_t size;
+		size_t depth;
+		const Json *json;
+		bool operator<(const Candidate &rhs) const { return size < rhs.size; }
+	};
+	std::unordered_set<const Json *> splits;
+	std::priority_queue<Candidate> heap;
+	heap.push(Candidate{ root.size(), 0, &root });
+	size_t units = 1;
+	while (!heap.empty()) {
+		Candidate c = heap.top();
+		if (units >= target && c.size * target <= units) break;
+		heap.pop();
+		splits.insert(c.json);
+		units += c.size - 1;
+		if (c.json->isPackedArray() || c.depth + 1 == MAX_DEPTH) continue;
+		auto push = [&](const Json &child) {
+			// units only grow, a child too small now stays too small
+			if (splittable(child) && (units < target || child.size() * target > units)) {
+				heap.push(Candidate{ child.size(), c.depth + 1, &child });
+			}
+		};
+		if (c.json->isArray()) {
+			for (const Json &e : c.json->getArray()) push(e);
+		}
+		else {
+			for (const auto &m : c.json->getObject()) push(m.second);
+		}
+	}
+	return splits;
+}
+
+static void addUnit(StringifyPlan &plan, const Json *value, double number, const std::string *key)
+{
+	plan.units.push_back(StringifyUnit{ value, number, key, plan.pending, plan.text.size() });
+	plan.pending = plan.text.size();
+}
+
+// Walk split containers in output order, every other value is a unit
+static void planStringify(const Json &j, const std::unordered_set<const Json *> &splits, StringifyPlan &plan)
+{
+	if (j.isPackedArray()) {
+		const std::vector<double> &numbers = j.getNumberArray();
+		plan.text += '[';
+		for (size_t i = 0; i < numbers.size(); i++) {
+			if (i != 0) plan.text += ',';
+			addUnit(plan, nullptr, numbers[i], nullptr);
+		}
+		plan.text += ']';
+	}
+	else if (j.isArray()) {
+		const Json::Array &elements = j.getArray();
+		plan.text += '[';
+		for (size_t i = 0; i < elements.size(); i++) {
+			if (i != 0) plan.text += ',';
+			if (splits.count(&elements[i])) planStringify(elements[i], splits, plan);
+			else addUnit(plan, &elements[i], 0, nullptr);
+		}
+		plan.text += ']';
+	}
+	else {
+		plan.text += '{';
+		bool first = true;
+		for (const auto &m : j.getObject()) {
+			if (!first) plan.text += ',';
+			first = false;
+			if (splits.count(&m.second)) {
+				JsonStringify::appendString(plan.text, m.first);
+				plan.text += ':';
+				planStringify(m.second, splits, plan);
+			}
+			else {
+				addUnit(plan, &m.second, 0, &m.first);
+			}
+		}
+		plan.text += '}';
+	}
+}
+
+//========================JsonThreadPool=======================================
+struct JsonThreadPool::Range {
+	std::mutex mutex;
+	size_t next = 0, end = 0;	// chunk indices
+};
+
+JsonThreadPool::JsonThreadPool(size_t threads)
+{
+	if (threads == 0) {
+		threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+	_threads = threads;
+	_ranges.reset(new Range[threads]);
+	for (size_t i = 1; i < threads; i++) {
+		_workers.emplace_back([this, i] { workerLoop(i); });
+	}
+}
+
+JsonThreadPool::~JsonThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (auto &t : _workers) {
+		t.join();
+	}
+}
+
+size_t JsonThreadPool::threads() const
+{
+	return _threads;
+}
+
+void JsonThreadPool::parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+	if (n == 0) return;
+	size_t begin = 0;
+	if (grain == 0) {
+		begin = tuneGrain(n, body, grain);
+	}
+	if (begin == n) return;
+	size_t chunks = (n - begin + grain - 1) / grain;
+	if (_threads == 1 || chunks == 1 || in_loop) {
+		body(begin, n);
+		return;
+	}
+
+	std::lock_guard<std::mutex> run(_run_mutex);
+	// workers are idle, so the ranges can be set without their locks
+	for (size_t i = 0; i < _threads; i++) {
+		_ranges[i].next = chunks * i / _threads;
+		_ranges[i].end = chunks * (i + 1) / _threads;
+	}
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_body = &body;
+		_begin = begin;
+		_end = n;
+		_grain = grain;
+		_failed = false;
+		_error = nullptr;
+		_finished = 0;
+		_generation++;
+	}
+	_wake.notify_all();
+	runChunks(0);
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_done.wait(lock, [this] { return _finished == _threads - 1; });
+		_body = nullptr;
+		error = _error;
+		_error = nullptr;
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+JsonThreadPool & JsonThreadPool::shared()
+{
+	static JsonThreadPool pool;
+	return pool;
+}
+
+void JsonThreadPool::workerLoop(size_t id)
+{
+	size_t seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this, seen] { return _stop || _generation != seen; });
+			if (_stop) return;
+			seen = _generation;
+		}
+		runChunks(id);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_finished++;
+		}
+		_done.notify_one();
+	}
+}
+
+void JsonThreadPool::runChunks(size_t id)
+{
+	in_loop = true;
+	size_t chunk;
+	while (takeChunk(id, chunk)) {
+		size_t begin = _begin + chunk * _grain;
+		try {
+			(*_body)(begin, std::min(_end, begin + _grain));
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!_error) _error = std::current_exception();
+			_failed = true;
+		}
+	}
+	in_loop = false;
+}
+
+bool JsonThreadPool::takeChunk(size_t id, size_t & chunk)
+{
+	if (_failed.load(std::memory_order_relaxed)) return false;
+	Range &own = _ranges[id];
+	{
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (own.next < own.end) {
+			chunk = own.next++;
+			return true;
+		}
+	}
+	// steal the back half of the next thread with chunks left
+	for (size_t k = 1; k < _threads; k++) {
+		Range &victim = _ranges[(id + k) % _threads];
+		size_t lo, hi;
+		{
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (victim.next == victim.end) continue;
+			hi = victim.end;
+			lo = victim.next + (victim.end - victim.next) / 2;
+			victim.end = lo;
+		}
+		std::lock_guard<std::mutex> lock(own.mutex);
+		own.next = lo + 1;
+		own.end = hi;
+		chunk = lo;
+		return true;
+	}
+	return false;
+}
+
+size_t JsonThreadPool::tuneGrain(size_t n, const std::function<void(size_t, size_t)>& body, size_t & grain)
+{
+	typedef std::chrono::steady_clock Clock;
+	const double probe_ns = 20000, chunk_ns = 50000;
+	// doubling steps until the prefix took probe_ns, cheap elements need many
+	Clock::time_point start = Clock::now();
+	double elapsed = 0;
+	size_t done = 0;
+	for (size_t step = 1; done < n && elapsed < probe_ns; step *= 2) {
+		size_t end = std::min(n, done + step);
+		body(done, end);
+		done = end;
+		elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+	}
+	double per_element = std::max(elapsed / static_cast<double>(done), 1.0);
+	grain = std::max<size_t>(1, static_cast<size_t>(chunk_ns / per_element));
+	// at least 4 chunks a thread, so there is something left to steal
+	grain = std::min(grain, std::max<size_t>(1, (n - done) / (4 * _threads)));
+	return done;
+}
+
+//========================algorithms===========================================
+namespace detail {
+
+JsonThreadPool & pool(const ParallelOptions & options)
+{
+	return options.pool != nullptr ? *options.pool : JsonThreadPool::shared();
+}
+
+} // namespace detail
+
+void parallelForEach(const Json & array, const std::function<void(const Json&, size_t)>& fn,
+	const ParallelOptions & options)
+{
+	detail::pool(options).parallelFor(array.size(), options.grain, [&](size_t begin, size_t end) {
+		detail::forElements(array, begin, end, fn);
+	});
+}
+
+void parallelForEachMember(const Json & object, const std::function<void(const std::string&, const Json&)>& fn,
+	const ParallelOptions & options)
+{
+	std::vector<Json::ConstObjectIterator> members;
+	members.reserve(object.size());
+	for (auto it = object.getObject().cbegin(); it != object.getObject().cend(); ++it) {
+		members.push_back(it);
+	}
+	detail::pool(options).parallelFor(members.size(), options.grain, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			fn(members[i]->first, members[i]->second);
+		}
+	});
+}
+
+Json parallelTransform(const Json & container, const std::function<Json(const Json&)>& fn,
+	const ParallelOptions & options)
+{
+	if (container.isObject()) {
+		std::vector<Json::ConstObjectIterator> members;
+		members.reserve(container.size());
+		for (auto it = container.getObject().cbegin(); it != container.getObject().cend(); ++it) {
+			members.push_back(it);
+		}
+		std::vector<Json> values(members.size());
+		detail::pool(options).parallelFor(members.size(), options.grain, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				values[i] = fn(members[i]->second);
+			}
+		});
+		Json::Object res;
+		for (size_t i = 0; i < members.size(); i++) {
+			res.emplace_hint(res.end(), members[i]->first, std::move(values[i]));
+		}
+		return Json(std::move(res));
+	}
+	Json::Array res(container.size());
+	detail::pool(options).parallelFor(res.size(), options.grain, [&](size_t begin, size_t end) {
+		detail::forElements(container, begin, end, [&](const Json &e, size_t i) {
+			res[i] = fn(e);
+		});
+	});
+	return Json(std::move(res));
+}
+
+Json parallelFilter(const Json & array, const std::function<bool(const Json&)>& fn, const ParallelOptions & options)
+{
+	JsonThreadPool &pool = detail::pool(options);
+	size_t n = array.size();
+	std::vector<char> keep(n);
+	pool.parallelFor(n, options.grain, [&](size_t begin, size_t end) {
+		detail::forElements(array, begin, end, [&](const Json &e, size_t i) {
+			keep[i] = fn(e);
+		});
+	});
+	// slot of each kept element, then copy them over in parallel
+	std::vector<size_t> slot(n);
+	size_t count = 0;
+	for (size_t i = 0; i < n; i++) {
+		slot[i] = count;
+		count += keep[i];
+	}
+	Json::Array res(count);
+	pool.parallelFor(n, 0, [&](size_t begin, size_t end) {
+		detail::forElements(array, begin, end, [&](const Json &e, size_t i) {
+			if (keep[i]) res[slot[i]] = e;
+		});
+	});
+	return Json(std::move(res));
+}
+
+bool parallelSort(Json & array, const std::string & key, const ParallelOptions & options)
+{
+	std::vector<std::string> tokens;
+	if (!splitPointer(key, tokens)) return false;
+	JsonThreadPool &pool = detail::pool(options);
+	bool packed = array.isPackedArray();
+	array.unpackArray();
+	const Json::Array &elements = array.getArray();
+	size_t n = elements.size();
+	std::vector<SortKey> keys(n);
+	pool.parallelFor(n, options.grain, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			keys[i] = sortKey(elements[i], tokens);
+		}
+	});
+
+	// stable sort runs of the order, then merge neighbours pairwise
+	std::vector<size_t> order(n), merged(n);
+	std::iota(order.begin(), order.end(), 0);
+	auto less = [&keys](size_t a, size_t b) { return keyLess(keys[a], keys[b]); };
+	size_t run = std::max<size_t>(1024, (n + 4 * pool.threads() - 1) / (4 * pool.threads()));
+	pool.parallelFor((n + run - 1) / run, 1, [&](size_t begin, size_t end) {
+		for (size_t r = begin; r < end; r++) {
+			std::stable_sort(order.begin() + r * run, order.begin() + std::min(n, (r + 1) * run), less);
+		}
+	});
+	for (size_t width = run; width < n; width *= 2) {
+		pool.parallelFor((n + 2 * width - 1) / (2 * width), 1, [&](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; p++) {
+				size_t lo = p * 2 * width, mid = std::min(n, lo + width), hi = std::min(n, lo + 2 * width);
+				std::merge(order.begin() + lo, order.begin() + mid, order.begin() + mid, order.begin() + hi,
+					merged.begin() + lo, less);
+			}
+		});
+		order.swap(merged);
+	}
+
+	Json::Array sorted;
+	sorted.reserve(n);
+	for (size_t i : order) {
+		sorted.push_back(std::move(array[i]));
+	}
+	array = Json(std::move(sorted));
+	if (packed) {
+		array.packArray();
+	}
+	return true;
+}
+
+std::vector<std::string> parallelStringifyPieces(const Json & j, const ParallelOptions & options)
+{
+	JsonThreadPool &pool = detail::pool(options);
+	if (!splittable(j) || pool.threads() == 1) {
+		return { Json::stringify(j) };
+	}
+	StringifyPlan plan;
+	planStringify(j, chooseSplits(j, 16 * pool.threads()), plan);
+
+	std::mutex mutex;
+	std::vector<std::pair<size_t, std::string>> chunks;
+	pool.parallelFor(plan.units.size(), options.grain, [&](size_t begin, size_t end) {
+		std::string out;
+		char buf[32];
+		for (size_t i = begin; i < end; i++) {
+			const StringifyUnit &u = plan.units[i];
+			out.append(plan.text, u.text_begin, u.text_end - u.text_begin);
+			if (u.key != nullptr) {
+				JsonStringify::appendString(out, *u.key);
+				out += ':';
+			}
+			if (u.value != nullptr) JsonStringify::appendValue(out, *u.value);
+			else out.append(buf, JsonStringify::formatNumber(u.number, buf));
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		chunks.emplace_back(begin, std::move(out));
+	});
+	std::sort(chunks.begin(), chunks.end(), [](const std::pair<size_t, std::string> &a, const std::pair<size_t, std::string> &b) {
+		return a.first < b.first;
+	});
+	std::vector<std::string> pieces;
+	pieces.reserve(chunks.size() + 1);
+	for (auto &c : chunks) {
+		pieces.push_back(std::move(c.second));
+	}
+	pieces.push_back(plan.text.substr(plan.pending));
+	return pieces;
+}
+
+std::string parallelStringify(const Json & j, const ParallelOptions & options)
+{
+	std::vector<std::string> pieces = parallelStringifyPieces(j, options);
+	if (pieces.size() == 1) return std::move(pieces[0]);
+	size_t total = 0;
+	for (const std::string &p : pieces) total += p.size();
+	std::string res;
+	res.reserve(total);
+	for (const std::string &p : pieces) res += p;
+	return res;
+}
+
+} // namespace json
+} // namespace ll
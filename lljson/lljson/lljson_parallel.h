@@ -0,0 +1,144 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "lljson.h"
+
+namespace ll {
+
+namespace json {
+
+// Runs loops over [0, n) on a fixed set of threads. Each thread starts on
+// an even share of the chunks and, once out of them, steals the back half
+// of what another one has left, so uneven element costs still balance.
+// The calling thread takes part, and a loop started from inside a loop
+// body runs serially on its thread.
+class JsonThreadPool {
+public:
+	// threads counts the caller, 0 is one per hardware thread
+	explicit JsonThreadPool(size_t threads = 0);
+	~JsonThreadPool();
+	JsonThreadPool(const JsonThreadPool &) = delete;
+	JsonThreadPool &operator=(const JsonThreadPool &) = delete;
+
+	size_t threads() const;
+	// Call body(begin, end) on chunks of grain elements covering [0, n)
+	// and wait for them. Grain 0 times a growing prefix on the calling
+	// thread and sizes chunks to take about 50us each. The first exception
+	// a body throws stops the loop and is rethrown here
+	void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+	// Pool used when ParallelOptions names none
+	static JsonThreadPool &shared();
+private:
+	struct Range;	// chunks a thread has left
+
+	size_t _threads;
+	std::vector<std::thread> _workers;
+	std::unique_ptr<Range[]> _ranges;
+	std::mutex _run_mutex;	// one loop at a time
+	std::mutex _mutex;
+	std::condition_variable _wake, _done;
+	size_t _generation = 0;
+	size_t _finished = 0;
+	bool _stop = false;
+	// the running loop
+	const std::function<void(size_t, size_t)> *_body = nullptr;
+	size_t _begin = 0, _end = 0, _grain = 1;
+	std::atomic<bool> _failed{ false };
+	std::exception_ptr _error;
+
+	void workerLoop(size_t id);
+	void runChunks(size_t id);
+	bool takeChunk(size_t id, size_t &chunk);
+	// Run the prefix timed for grain 0, return the elements it covered
+	size_t tuneGrain(size_t n, const std::function<void(size_t, size_t)> &body, size_t &grain);
+};
+
+struct ParallelOptions {
+	JsonThreadPool *pool = nullptr;		// nullptr is JsonThreadPool::shared()
+	size_t grain = 0;					// elements per chunk, 0 tunes it to their cost
+};
+
+// Callbacks get elements (member values) by const reference from several
+// threads at once, which Json allows for const access. Numbers of a packed
+// array are passed as temporary Json.
+
+void parallelForEach(const Json &array, const std::function<void(const Json &, size_t)> &fn,
+	const ParallelOptions &options = ParallelOptions());
+void parallelForEachMember(const Json &object, const std::function<void(const std::string &, const Json &)> &fn,
+	const ParallelOptions &options = ParallelOptions());
+// An array of fn of each element, or an object of fn of each member value
+Json parallelTransform(const Json &container, const std::function<Json(const Json &)> &fn,
+	const ParallelOptions &options = ParallelOptions());
+// An array of the elements fn keeps, in order
+Json parallelFilter(const Json &array, const std::function<bool(const Json &)> &fn,
+	const ParallelOptions &options = ParallelOptions());
+// Stable sort by the value at key, a JSON Pointer into each element ("" is
+// the element itself). Missing keys sort as null, then false < true <
+// numbers < strings < arrays < objects, arrays and objects compare equal.
+// false if key is not a valid JSON Pointer
+bool parallelSort(Json &array, const std::string &key, const ParallelOptions &options = ParallelOptions());
+// Json::stringify byte for byte, with large arrays and objects cut into
+// runs of elements written to separate buffers
+std::string parallelStringify(const Json &j, const ParallelOptions &options = ParallelOptions());
+// The same output as pieces in order, left unjoined for writev or a stream
+std::vector<std::string> parallelStringifyPieces(const Json &j, const ParallelOptions &options = ParallelOptions());
+
+namespace detail {
+
+JsonThreadPool &pool(const ParallelOptions &options);
+
+// f(element, i) over [begin, end) of array
+template <class F>
+void forElements(const Json &array, size_t begin, size_t end, F &&f)
+{
+	if (array.isPackedArray()) {
+		const std::vector<double> &numbers = array.getNumberArray();
+		for (size_t i = begin; i < end; i++) f(Json(numbers[i]), i);
+	}
+	else {
+		const Json::Array &elements = array.getArray();
+		for (size_t i = begin; i < end; i++) f(elements[i], i);
+	}
+}
+
+} // namespace detail
+
+// combine(...combine(combine(init, map(e0)), map(e1))..., map(en)), where
+// chunks are folded apart and then in order, so combine must be associative
+template <class T, class Map, class Combine>
+T parallelReduce(const Json &array, T init, Map map, Combine combine,
+	const ParallelOptions &options = ParallelOptions())
+{
+	std::mutex mutex;
+	std::vector<std::pair<size_t, T>> partials;
+	detail::pool(options).parallelFor(array.size(), options.grain, [&](size_t begin, size_t end) {
+		std::optional<T> acc;
+		detail::forElements(array, begin, end, [&](const Json &e, size_t) {
+			if (acc) acc = combine(std::move(*acc), map(e));
+			else acc.emplace(map(e));
+		});
+		std::lock_guard<std::mutex> lock(mutex);
+		partials.emplace_back(begin, std::move(*acc));
+	});
+	std::sort(partials.begin(), partials.end(), [](const std::pair<size_t, T> &a, const std::pair<size_t, T> &b) {
+		return a.first < b.first;
+	});
+	for (auto &p : partials) {
+		init = combine(std::move(init), std::move(p.second));
+	}
+	return init;
+}
+
+} // namespace json
+} // namespace ll
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <vector>
+#include "lljson_patch.h"
+
+namespace ll {
+
+namespace json {
+
+//========================aux function=========================================
+// Split JSON Pointer (RFC 6901) into unescaped reference tokens
+static bool splitPointer(const std::string &path, std::vector<std::string> &tokens)
+{
+	tokens.clear();
+	if (path.empty()) return true;	// whole document
+	if (path[0] != '/') return false;
+	std::string token;
+	for (size_t i = 1; i <= path.size(); i++) {
+		if (i == path.size() || path[i] == '/') {
+			tokens.push_back(std::move(token));
+			token.clear();
+		}
+		else if (path[i] == '~') {
+			if (i + 1 == path.size()) return false;
+			switch (path[++i])
+			{
+			case '0':	token += '~'; break;
+			case '1':	token += '/'; break;
+			default:	return false;
+			}
+		}
+		else {
+			token += path[i];
+		}
+	}
+	return true;
+}
+
+static std::string escapePointerToken(const std::string &token)
+{
+	std::string res;
+	for (char ch : token) {
+		switch (ch)
+		{
+		case '~':	res += "~0"; break;
+		case '/':	res += "~1"; break;
+		default:	res += ch; break;
+		}
+	}
+	return res;
+}
+
+// Array index is "0" or digits without leading zero
+static bool parseIndex(const std::string &token, size_t &index)
+{
+	if (token.empty() || (token[0] == '0' && token.size() > 1)) return false;
+	index = 0;
+	for (char ch : token) {
+		if (ch < '0' || ch > '9') return false;
+		index = index * 10 + (ch - '0');
+	}
+	return true;
+}
+
+// Walk the first n tokens from root, return nullptr if any of them is missing
+static Json *resolve(Json &root, const std::vector<std::string> &tokens, size_t n)
+{
+	Json *cur = &root;
+	for (size_t t = 0; t < n; t++) {
+		if (cur->isObject()) {
+			auto iter = cur->findObjectElement(tokens[t]);
+			if (iter == cur->getObject().end()) return nullptr;
+			cur = &iter->second;
+		}
+		else if (cur->isArray()) {
+			size_t i;
+			if (!parseIndex(tokens[t], i) || i >= cur->size()) return nullptr;
+			cur = &(*cur)[i];
+		}
+		else {
+			return nullptr;
+		}
+	}
+	return cur;
+}
+
+static const Json *member(const Json &op, const char *name)
+{
+	auto iter = op.findObjectElement(name);
+	return iter == op.getObject().end() ? nullptr : &iter->second;
+}
+
+//========================JSON Patch===========================================
+static PatchState addValue(Json &target, const std::vector<std::string> &tokens, const Json &value)
+{
+	if (tokens.empty()) {
+		target = value;
+		return PATCH_OK;
+	}
+	Json *parent = resolve(target, tokens, tokens.size() - 1);
+	if (parent == nullptr) return PATCH_PATH_NOT_FOUND;
+	const std::string &last = tokens.back();
+	if (parent->isObject()) {
+		(*parent)[last] = value;
+	}
+	else if (parent->isArray()) {
+		size_t i = parent->size();
+		if (last != "-" && (!parseIndex(last, i) || i > parent->size())) {
+			return PATCH_INVALID_POINTER;
+		}
+		parent->insertArrayElement(i, value);
+	}
+	else {
+		return PATCH_PATH_NOT_FOUND;
+	}
+	return PATCH_OK;
+}
+
+static PatchState removeValue(Json &target, const std::vector<std::string> &tokens)
+{
+	if (tokens.empty()) return PATCH_INVALID_POINTER;	// can't remove the document itself
+	Json *parent = resolve(target, tokens, tokens.size() - 1);
+	if (parent == nullptr) return PATCH_PATH_NOT_FOUND;
+	const std::string &last = tokens.back();
+	if (parent->isObject()) {
+		auto iter = parent->findObjectElement(last);
+		if (iter == parent->getObject().end()) return PATCH_PATH_NOT_FOUND;
+		parent->eraseObjectElement(iter);
+	}
+	else if (parent->isArray()) {
+		size_t i;
+		if (!parseIndex(last, i)) return PATCH_INVALID_POINTER;
+		if (i >= parent->size()) return PATCH_PATH_NOT_FOUND;
+		parent->eraseArrayElement(i);
+	}
+	else {
+		return PATCH_PATH_NOT_FOUND;
+	}
+	return PATCH_OK;
+}
+
+static PatchState applyOperation(Json &target, const Json &op)
+{
+	if (!op.isObject()) return PATCH_INVALID_PATCH;
+	const Json *name = member(op, "op");
+	const Json *path = member(op, "path");
+	if (name == nullptr || !name->isString() || path == nullptr || !path->isString()) {
+		return PATCH_INVALID_OPERATION;
+	}
+	std::vector<std::string> tokens;
+	if (!splitPointer(path->getString(), tokens)) return PATCH_INVALID_POINTER;
+
+	const std::string &opname = name->getString();
+	if (opname == "add" || opname == "replace" || opname == "test") {
+		const Json *value = member(op, "value");
+		if (value == nullptr) return PATCH_INVALID_OPERATION;
+		if (opname == "add") {
+			return addValue(target, tokens, *value);
+		}
+		Json *dest = resolve(target, tokens, tokens.size());
+		if (dest == nullptr) return PATCH_PATH_NOT_FOUND;
+		if (opname == "test") {
+			return (*dest == *value) ? PATCH_OK : PATCH_TEST_FAILED;
+		}
+		*dest = *value;
+		return PATCH_OK;
+	}
+	if (opname == "remove") {
+		return removeValue(target, tokens);
+	}
+	if (opname == "move" || opname == "copy") {
+		const Json *from = member(op, "from");
+		if (from == nullptr || !from->isString()) return PATCH_INVALID_OPERATION;
+		std::vector<std::string> from_tokens;
+		if (!splitPointer(from->getString(), from_tokens)) return PATCH_INVALID_POINTER;
+		Json *src = resolve(target, from_tokens, from_tokens.size());
+		if (src == nullptr) return PATCH_PATH_NOT_FOUND;
+		Json value = *src;
+		if (opname == "move") {
+			if (from_tokens == tokens) return PATCH_OK;
+			// a value can't be moved into one of its own children
+			if (from_tokens.size() < tokens.size()
+				&& std::equal(from_tokens.begin(), from_tokens.end(), tokens.begin())) {
+				return PATCH_INVALID_POINTER;
+			}
+			PatchState state = removeValue(target, from_tokens);
+			if (state != PATCH_OK) return state;
+		}
+		return addValue(target, tokens, value);
+	}
+	return PATCH_INVALID_OPERATION;
+}
+
+PatchState applyPatch(Json &target, const Json &patch)
+{
+	if (!patch.isArray()) return PATCH_INVALID_PATCH;
+	// a packed patch has only numbers, no operation
+	if (patch.isPackedArray()) return patch.size() == 0 ? PATCH_OK : PATCH_INVALID_PATCH;
+	for (const auto &op : patch.getArray()) {
+		PatchState state = applyOperation(target, op);
+		if (state != PATCH_OK) return state;
+	}
+	return PATCH_OK;
+}
+
+//========================JSON Merge Patch=====================================
+void applyMergePatch(Json &target, const Json &patch)
+{
+	if (!patch.isObject()) {
+		target = patch;
+		return;
+	}
+	if (!target.isObject()) {
+		target = Json::Object{};
+	}
+	for (const auto &kv : patch.getObject()) {
+		if (kv.second.isNull()) {
+			auto iter = target.findObjectElement(kv.first);
+			if (iter != target.getObject().end()) {
+				target.eraseObjectElement(iter);
+			}
+		}
+		else {
+			applyMergePatch(target[kv.first], kv.second);
+		}
+	}
+}
+
+//========================diff=================================================
+static void addOperation(Json &patch, const char *op, const std::string &path, const Json *value)
+{
+	Json::Object o{ { "op", op }, { "path", path } };
+	if (value != nullptr) {
+		o["value"] = *value;
+	}
+	patch.pushbackArrayElement(o);
+}
+
+static void diffValue(const Json &from, const Json &to, const std::string &path, Json &patch)
+{
+	if (from == to) return;
+	if (from.type() != to.type() || (!from.isArray() && !from.isObject())) {
+		addOperation(patch, "replace", path, &to);
+		return;
+	}
+	if (from.isPackedArray() || to.isPackedArray()) {
+		// elements are compared and copied as Json
+		Json f(from), t(to);
+		f.unpackArray();
+		t.unpackArray();
+		diffValue(f, t, path, patch);
+		return;
+	}
+	if (from.isArray()) {
+		// trim common prefix and suffix, pair up the rest by index
+		size_t fsize = from.size(), tsize = to.size();
+		size_t begin = 0;
+		while (begin < fsize && begin < tsize && from[begin] == to[begin]) begin++;
+		size_t fend = fsize, tend = tsize;
+		while (fend > begin && tend > begin && from[fend - 1] == to[tend - 1]) fend--, tend--;
+
+		size_t common = std::min(fend - begin, tend - begin);
+		for (size_t i = begin; i < begin + common; i++) {
+			diffValue(from[i], to[i], path + '/' + std::to_string(i), patch);
+		}
+		std::string at = path + '/' + std::to_string(begin + common);
+		for (size_t i = begin + common; i < fend; i++) {
+			addOperation(patch, "remove", at, nullptr);
+		}
+		for (size_t i = begin + common; i < tend; i++) {
+			addOperation(patch, "add", path + '/' + std::to_string(i), &to[i]);
+		}
+		return;
+	}
+	// std::map is ordered, so both objects can be merge-walked
+	const auto &fobj = from.getObject();
+	const auto &tobj = to.getObject();
+	auto fiter = fobj.cbegin();
+	auto titer = tobj.cbegin();
+	while (fiter != fobj.cend() || titer != tobj.cend()) {
+		if (titer == tobj.cend() || (fiter != fobj.cend() && fiter->first < titer->first)) {
+			addOperation(patch, "remove", path + '/' + escapePointerToken(fiter->first), nullptr);
+			++fiter;
+		}
+		else if (fiter == fobj.cend() || titer->first < fiter->first) {
+			addOperation(patch, "add", path + '/' + escapePointerToken(titer->first), &titer->second);
+			++titer;
+		}
+		else {
+			diffValue(fiter->second, titer->second, path + '/' + escapePointerToken(fiter->first), patch);
+			++fiter, ++titer;
+		}
+	}
+}
+
+Json diff(const Json &from, const Json &to)
+{
+	Json patch(Json::Array{});
+	diffValue(from, to, "", patch);
+	return patch;
+}
+
+} // namespace json
+} // namespace ll
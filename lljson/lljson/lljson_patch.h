@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include "lljson.h"
+
+namespace ll {
+
+namespace json {
+
+enum PatchState {
+	PATCH_OK = 0,
+	PATCH_INVALID_PATCH,		// patch is not an array of operation objects
+	PATCH_INVALID_OPERATION,	// unknown "op" or missing "path"/"from"/"value"
+	PATCH_INVALID_POINTER,		// malformed JSON Pointer or bad array index
+	PATCH_PATH_NOT_FOUND,
+	PATCH_TEST_FAILED
+};
+
+// RFC 6902 JSON Patch, apply an array of operations to target in place.
+// Evaluation stops at the first failing operation, target keeps the
+// operations applied before it, patch a copy if atomicity is needed
+PatchState applyPatch(Json &target, const Json &patch);
+
+// RFC 7386 JSON Merge Patch, apply patch to target in place
+void applyMergePatch(Json &target, const Json &patch);
+
+// Return a JSON Patch which turns from into to.
+// Equal subtrees are pruned with operator==, call cacheHash() on both
+// trees first to make rejecting changed subtrees O(1)
+Json diff(const Json &from, const Json &to);
+
+} // namespace json
+} // namespace ll
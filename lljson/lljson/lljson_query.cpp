@@ -0,0 +1,803 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include "lljson_query.h"
+
+namespace ll {
+
+namespace json {
+
+typedef JsonQuery::Node Node;
+typedef std::vector<const Json *> Batch;
+
+// records built from the event stream per batch
+static const size_t STREAM_BATCH = 1024;
+
+//========================aux function=========================================
+static const Json &nullValue()
+{
+	static const Json j;
+	return j;
+}
+
+static const Json &booleanValue(bool b)
+{
+	static const Json t(true), f(false);
+	return b ? t : f;
+}
+
+static bool truthy(const Json &j)
+{
+	return !(j.isNull() || (j.isBoolean() && !j.getBoolean()));
+}
+
+// jq order: null < false < true < numbers < strings < arrays < objects
+static int rank(const Json &j)
+{
+	switch (j.type()) {
+	case Json::NUL: return 0;
+	case Json::BOOLEAN: return j.getBoolean() ? 2 : 1;
+	case Json::NUMBER: return 3;
+	case Json::STRING: return 4;
+	case Json::ARRAY: return 5;
+	default: return 6;
+	}
+}
+
+static int compareValues(const Json &a, const Json &b)
+{
+	int ra = rank(a), rb = rank(b);
+	if (ra != rb) return ra < rb ? -1 : 1;
+	if (a.isNumber()) {
+		return a.getNumber() < b.getNumber() ? -1 : b.getNumber() < a.getNumber() ? 1 : 0;
+	}
+	if (a.isString()) {
+		return a.getString().compare(b.getString());
+	}
+	if (a.isArray() || a.isObject()) {
+		if (a == b) return 0;
+		return Json::stringify(a) < Json::stringify(b) ? -1 : 1;
+	}
+	return 0;
+}
+
+static bool compare(Node::Op op, const Json &a, const Json &b)
+{
+	switch (op) {
+	case Node::EQ: return a == b;
+	case Node::NE: return a != b;
+	case Node::LT: return compareValues(a, b) < 0;
+	case Node::LE: return compareValues(a, b) <= 0;
+	case Node::GT: return compareValues(a, b) > 0;
+	default: return compareValues(a, b) >= 0;
+	}
+}
+
+// Gives exactly one output per input
+static bool single(const Node &node)
+{
+	if (node.kind == Node::ITERATE || node.kind == Node::SELECT) return false;
+	if (node.kind == Node::PIPELINE) {
+		for (const Node &c : node.children) {
+			if (!single(c)) return false;
+		}
+	}
+	return true;
+}
+
+//========================QueryCompiler========================================
+class QueryCompiler {
+public:
+	QueryCompiler(const std::string &expr)
+		:_s(expr)
+	{
+	}
+
+	bool compile(Node &root, size_t &error_pos)
+	{
+		bool ok = parsePipe(root) && (skip(), _pos == _s.size());
+		error_pos = _pos;
+		return ok;
+	}
+private:
+	const std::string &_s;
+	size_t _pos = 0;
+
+	void skip()
+	{
+		while (_pos < _s.size() && std::isspace(static_cast<unsigned char>(_s[_pos]))) _pos++;
+	}
+
+	bool peek(char ch)
+	{
+		skip();
+		return _pos < _s.size() && _s[_pos] == ch;
+	}
+
+	bool eat(char ch)
+	{
+		if (!peek(ch)) return false;
+		_pos++;
+		return true;
+	}
+
+	static bool isIdent(char ch)
+	{
+		return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+	}
+
+	std::string ident()
+	{
+		size_t begin = _pos;
+		while (_pos < _s.size() && isIdent(_s[_pos])) _pos++;
+		return _s.substr(begin, _pos - begin);
+	}
+
+	// Match keyword w as a whole word
+	bool keyword(const char *w)
+	{
+		skip();
+		size_t n = std::char_traits<char>::length(w);
+		if (_s.compare(_pos, n, w) != 0 || (_pos + n < _s.size() && isIdent(_s[_pos + n]))) return false;
+		_pos += n;
+		return true;
+	}
+
+	bool string(std::string &out)
+	{
+		size_t begin = _pos++;
+		while (_pos < _s.size() && _s[_pos] != '"') {
+			if (_s[_pos] == '\\') _pos++;
+			_pos++;
+		}
+		if (_pos >= _s.size()) return false;
+		Json j = Json::parse(_s.substr(begin, ++_pos - begin));
+		if (j.state() != Json::PARSE_OK) return false;
+		out = j.getString();
+		return true;
+	}
+
+	bool integer(long &out)
+	{
+		skip();
+		size_t begin = _pos;
+		if (_pos < _s.size() && _s[_pos] == '-') _pos++;
+		while (_pos < _s.size() && std::isdigit(static_cast<unsigned char>(_s[_pos]))) _pos++;
+		if (_pos == begin || _s[_pos - 1] == '-') {
+			_pos = begin;
+			return false;
+		}
+		// strtol stops at the first non-digit, which is _pos
+		errno = 0;
+		out = std::strtol(_s.c_str() + begin, nullptr, 10);
+		if (errno == ERANGE) {
+			_pos = begin;
+			return false;
+		}
+		return true;
+	}
+
+	// Append node to pipeline, splicing nested pipelines
+	static void append(Node &pipeline, Node &&node)
+	{
+		if (node.kind == Node::PIPELINE) {
+			for (Node &c : node.children) pipeline.children.push_back(std::move(c));
+		}
+		else {
+			pipeline.children.push_back(std::move(node));
+		}
+	}
+
+	static Node binary(Node::Kind kind, Node &&lhs, Node &&rhs)
+	{
+		Node node;
+		node.kind = kind;
+		node.children.push_back(std::move(lhs));
+		node.children.push_back(std::move(rhs));
+		return node;
+	}
+
+	bool parsePipe(Node &out)
+	{
+		out = Node();
+		do {
+			Node term;
+			if (!parseOr(term)) return false;
+			append(out, std::move(term));
+		} while (eat('|'));
+		return true;
+	}
+
+	bool parseOr(Node &out)
+	{
+		if (!parseAnd(out)) return false;
+		while (keyword("or")) {
+			Node rhs;
+			if (!single(out) || !parseAnd(rhs) || !single(rhs)) return false;
+			out = binary(Node::OR, std::move(out), std::move(rhs));
+		}
+		return true;
+	}
+
+	bool parseAnd(Node &out)
+	{
+		if (!parseCompare(out)) return false;
+		while (keyword("and")) {
+			Node rhs;
+			if (!single(out) || !parseCompare(rhs) || !single(rhs)) return false;
+			out = binary(Node::AND, std::move(out), std::move(rhs));
+		}
+		return true;
+	}
+
+	bool parseCompare(Node &out)
+	{
+		if (!parsePostfix(out)) return false;
+		skip();
+		static const struct {
+			const char *text;
+			Node::Op op;
+		} ops[] = { { "==", Node::EQ }, { "!=", Node::NE }, { "<=", Node::LE },
+			{ ">=", Node::GE }, { "<", Node::LT }, { ">", Node::GT } };
+		for (const auto &o : ops) {
+			size_t n = std::char_traits<char>::length(o.text);
+			if (_s.compare(_pos, n, o.text) != 0) continue;
+			_pos += n;
+			Node rhs;
+			if (!single(out) || !parsePostfix(rhs) || !single(rhs)) return false;
+			out = binary(Node::COMPARE, std::move(out), std::move(rhs));
+			out.op = o.op;
+			return true;
+		}
+		return true;
+	}
+
+	// A primary term followed by .a ."a" [..] suffixes
+	bool parsePostfix(Node &out)
+	{
+		out = Node();
+		if (!parsePrimary(out)) return false;
+		for (;;) {
+			if (_pos < _s.size() && _s[_pos] == '.' && _pos + 1 < _s.size()
+				&& (isIdent(_s[_pos + 1]) || _s[_pos + 1] == '"' || _s[_pos + 1] == '[')) {
+				_pos++;
+				if (!parseStep(out)) return false;
+			}
+			else if (_pos < _s.size() && _s[_pos] == '[') {
+				_pos++;
+				if (!parseBracket(out)) return false;
+			}
+			else {
+				return true;
+			}
+		}
+	}
+
+	// After a '.': a name, a quoted name or a bracket
+	bool parseStep(Node &pipeline)
+	{
+		Node node;
+		if (_pos < _s.size() && isIdent(_s[_pos])) {
+			node.kind = Node::FIELD;
+			node.name = ident();
+		}
+		else if (_pos < _s.size() && _s[_pos] == '"') {
+			node.kind = Node::FIELD;
+			if (!string(node.name)) return false;
+		}
+		else if (_pos < _s.size() && _s[_pos] == '[') {
+			_pos++;
+			return parseBracket(pipeline);
+		}
+		else {
+			return true;	// identity
+		}
+		pipeline.children.push_back(std::move(node));
+		return true;
+	}
+
+	// After a '[': ] or n] or [n]:[m]]
+	bool parseBracket(Node &pipeline)
+	{
+		Node node;
+		if (eat(']')) {
+			node.kind = Node::ITERATE;
+		}
+		else {
+			node.has_begin = integer(node.begin);
+			if (eat(':')) {
+				node.kind = Node::SLICE;
+				node.has_end = integer(node.end);
+			}
+			else if (node.has_begin) {
+				node.kind = Node::INDEX;
+				node.index = node.begin;
+			}
+			else {
+				return false;
+			}
+			if (!eat(']')) return false;
+		}
+		pipeline.children.push_back(std::move(node));
+		return true;
+	}
+
+	bool parsePrimary(Node &pipeline)
+	{
+		skip();
+		if (_pos >= _s.size()) return false;
+		char ch = _s[_pos];
+		Node node;
+		if (ch == '.') {
+			_pos++;
+			return parseStep(pipeline);
+		}
+		if (ch == '(') {
+			_pos++;
+			if (!parsePipe(node) || !eat(')')) return false;
+			append(pipeline, std::move(node));
+			return true;
+		}
+		if (ch == '[') {
+			_pos++;
+			if (eat(']')) {
+				node.kind = Node::LITERAL;
+				node.literal = Json(Json::ARRAY);
+			}
+			else {
+				node.kind = Node::COLLECT;
+				node.children.emplace_back();
+				if (!parsePipe(node.children[0]) || !eat(']')) return false;
+			}
+		}
+		else if (ch == '{') {
+			_pos++;
+			node.kind = Node::OBJECT;
+			if (!parseMembers(node)) return false;
+		}
+		else if (ch == '"') {
+			std::string s;
+			if (!string(s)) return false;
+			node.kind = Node::LITERAL;
+			node.literal = Json(std::move(s));
+		}
+		else if (ch == '-' || std::isdigit(static_cast<unsigned char>(ch))) {
+			size_t begin = _pos;
+			while (_pos < _s.size() && std::strchr("+-.eE0123456789", _s[_pos])) _pos++;
+			node.kind = Node::LITERAL;
+			node.literal = Json::parse(_s.substr(begin, _pos - begin));
+			if (node.literal.state() != Json::PARSE_OK) {
+				_pos = begin;
+				return false;
+			}
+		}
+		else if (keyword("null")) {
+			node.kind = Node::LITERAL;
+		}
+		else if (keyword("true")) {
+			node.kind = Node::LITERAL;
+			node.literal = Json(true);
+		}
+		else if (keyword("false")) {
+			node.kind = Node::LITERAL;
+			node.literal = Json(false);
+		}
+		else if (keyword("not")) {
+			node.kind = Node::NOT;
+		}
+		else if (keyword("select")) {
+			node.kind = Node::SELECT;
+			node.children.emplace_back();
+			if (!eat('(') || !parsePipe(node.children[0]) || !single(node.children[0]) || !eat(')')) return false;
+		}
+		else {
+			return false;
+		}
+		pipeline.children.push_back(std::move(node));
+		return true;
+	}
+
+	// After a '{': name, name: value or "name": value, comma separated
+	bool parseMembers(Node &node)
+	{
+		if (eat('}')) return true;
+		do {
+			skip();
+			std::string name;
+			if (_pos < _s.size() && _s[_pos] == '"') {
+				if (!string(name)) return false;
+			}
+			else {
+				name = ident();
+				if (name.empty()) return false;
+			}
+			Node value;
+			if (eat(':')) {
+				if (!parseOr(value) || !single(value)) return false;
+			}
+			else {
+				Node field;
+				field.kind = Node::FIELD;
+				field.name = name;
+				value.children.push_back(std::move(field));
+			}
+			node.keys.push_back(std::move(name));
+			node.children.push_back(std::move(value));
+		} while (eat(','));
+		return eat('}');
+	}
+};
+
+//========================QueryEvaluator=======================================
+// Runs nodes over batches. Values made by the query (objects, slices...)
+// live in _arena, so outputs can point into the input or the arena alike.
+class QueryEvaluator {
+public:
+	// Apply steps [first, last) of pipeline to in
+	void run(const Node &pipeline, size_t first, size_t last, const Batch &in, Batch &out)
+	{
+		Batch cur(in), next;
+		for (size_t i = first; i < last; i++) {
+			next.clear();
+			eval(pipeline.children[i], cur, next);
+			cur.swap(next);
+		}
+		out.swap(cur);
+	}
+
+	void clear()
+	{
+		_arena.clear();
+	}
+private:
+	std::deque<Json> _arena;
+
+	const Json *make(Json &&j)
+	{
+		_arena.push_back(std::move(j));
+		return &_arena.back();
+	}
+
+	// Packed arrays have no element Json to point at
+	const Json *element(const Json &array, size_t i)
+	{
+		if (array.isPackedArray()) return make(Json(array.getNumberArray()[i]));
+		return &array.getArray()[i];
+	}
+
+	void eval(const Node &node, const Batch &in, Batch &out)
+	{
+		switch (node.kind) {
+		case Node::PIPELINE:
+			run(node, 0, node.children.size(), in, out);
+			break;
+		case Node::FIELD:
+			for (const Json *j : in) {
+				const Json *v = &nullValue();
+				if (j->isObject()) {
+					auto it = j->findObjectElement(node.name);
+					if (it != j->getObject().end()) v = &it->second;
+				}
+				out.push_back(v);
+			}
+			break;
+		case Node::INDEX:
+			for (const Json *j : in) {
+				const Json *v = &nullValue();
+				if (j->isArray()) {
+					long i = node.index < 0 ? node.index + static_cast<long>(j->size()) : node.index;
+					if (i >= 0 && static_cast<size_t>(i) < j->size()) v = element(*j, static_cast<size_t>(i));
+				}
+				out.push_back(v);
+			}
+			break;
+		case Node::SLICE:
+			for (const Json *j : in) {
+				if (!j->isArray()) {
+					out.push_back(&nullValue());
+					continue;
+				}
+				long n = static_cast<long>(j->size());
+				long b = node.has_begin ? node.begin : 0, e = node.has_end ? node.end : n;
+				if (b < 0) b += n;
+				if (e < 0) e += n;
+				b = std::max(0L, std::min(b, n));
+				e = std::max(b, std::min(e, n));
+				Json::Array a;
+				a.reserve(static_cast<size_t>(e - b));
+				for (long i = b; i < e; i++) a.push_back(*element(*j, static_cast<size_t>(i)));
+				out.push_back(make(Json(std::move(a))));
+			}
+			break;
+		case Node::ITERATE:
+			for (const Json *j : in) {
+				if (j->isArray()) {
+					for (size_t i = 0; i < j->size(); i++) out.push_back(element(*j, i));
+				}
+				else if (j->isObject()) {
+					for (const auto &kv : j->getObject()) out.push_back(&kv.second);
+				}
+			}
+			break;
+		case Node::SELECT: {
+			Batch cond;
+			eval(node.children[0], in, cond);
+			for (size_t i = 0; i < in.size(); i++) {
+				if (truthy(*cond[i])) out.push_back(in[i]);
+			}
+			break;
+		}
+		case Node::NOT:
+			for (const Json *j : in) out.push_back(&booleanValue(!truthy(*j)));
+			break;
+		case Node::OBJECT: {
+			std::vector<Batch> members(node.children.size());
+			for (size_t k = 0; k < members.size(); k++) eval(node.children[k], in, members[k]);
+			for (size_t i = 0; i < in.size(); i++) {
+				Json::Object o;
+				for (size_t k = 0; k < members.size(); k++) o[node.keys[k]] = *members[k][i];
+				out.push_back(make(Json(std::move(o))));
+			}
+			break;
+		}
+		case Node::COLLECT:
+			for (const Json *j : in) {
+				Batch one(1, j), res;
+				eval(node.children[0], one, res);
+				Json::Array a;
+				a.reserve(res.size());
+				for (const Json *r : res) a.push_back(*r);
+				out.push_back(make(Json(std::move(a))));
+			}
+			break;
+		case Node::LITERAL:
+			out.insert(out.end(), in.size(), &node.literal);
+			break;
+		case Node::COMPARE:
+		case Node::AND:
+		case Node::OR: {
+			Batch l, r;
+			eval(node.children[0], in, l);
+			eval(node.children[1], in, r);
+			for (size_t i = 0; i < in.size(); i++) {
+				bool b = node.kind == Node::COMPARE ? compare(node.op, *l[i], *r[i])
+					: node.kind == Node::AND ? truthy(*l[i]) && truthy(*r[i])
+					: truthy(*l[i]) || truthy(*r[i]);
+				out.push_back(&booleanValue(b));
+			}
+			break;
+		}
+		}
+	}
+};
+
+//========================StreamQuery==========================================
+// Matches the leading .a .[n] .[] steps on parser events and builds only
+// the values they select, which go through the remaining steps per batch
+class StreamQuery : public JsonHandler {
+public:
+	StreamQuery(const Node &root, size_t prefix, Json::Array &out)
+		:_root(root), _prefix(prefix), _out(out)
+	{
+	}
+
+	bool null() override
+	{
+		return scalar(&JsonHandler::null);
+	}
+
+	bool boolean(bool b) override
+	{
+		return scalar([b](JsonHandler &h) { return h.boolean(b); });
+	}
+
+	bool number(double n) override
+	{
+		return scalar([n](JsonHandler &h) { return h.number(n); });
+	}
+
+	bool string(std::string_view s) override
+	{
+		return scalar([s](JsonHandler &h) { return h.string(s); });
+	}
+
+	bool startArray() override
+	{
+		return start(false, &JsonHandler::startArray);
+	}
+
+	bool endArray() override
+	{
+		return end(&JsonHandler::endArray);
+	}
+
+	bool startObject() override
+	{
+		return start(true, &JsonHandler::startObject);
+	}
+
+	bool key(std::string_view k) override
+	{
+		if (_capture_depth > 0) return _builder.key(k);
+		Frame &top = _frames.back();
+		top.member = -1;
+		if (top.step >= 0) {
+			const Node &s = step(top.step);
+			if (s.kind == Node::ITERATE || (s.kind == Node::FIELD && s.name == k)) {
+				top.member = top.step + 1;
+				top.found = true;
+			}
+		}
+		return true;
+	}
+
+	bool endObject() override
+	{
+		return end(&JsonHandler::endObject);
+	}
+
+	void flush()
+	{
+		if (_records.empty()) return;
+		Batch in, res;
+		in.reserve(_records.size());
+		for (const Json &r : _records) in.push_back(&r);
+		_evaluator.run(_root, _prefix, _root.children.size(), in, res);
+		for (const Json *r : res) _out.push_back(*r);
+		_records.clear();
+		_evaluator.clear();
+	}
+private:
+	// an open container, step is the prefix steps matched to reach it or -1
+	struct Frame {
+		int step;
+		bool object;
+		size_t index;
+		int member;		// step of the current member value
+		bool found;		// a member or element was selected
+	};
+
+	const Node &_root;
+	const size_t _prefix;
+	Json::Array &_out;
+	std::vector<Frame> _frames;
+	JsonBuilder _builder;
+	size_t _capture_depth = 0;
+	std::vector<Json> _records;
+	QueryEvaluator _evaluator;
+
+	const Node &step(int i) const
+	{
+		return _root.children[static_cast<size_t>(i)];
+	}
+
+	// Steps matched by the value starting now
+	int next()
+	{
+		if (_frames.empty()) return 0;
+		Frame &top = _frames.back();
+		if (top.step < 0) return -1;
+		if (top.object) return top.member;
+		size_t i = top.index++;
+		const Node &s = step(top.step);
+		if (s.kind == Node::ITERATE || static_cast<long>(i) == s.index) {
+			top.found = true;
+			return top.step + 1;
+		}
+		return -1;
+	}
+
+	// Step i found nothing: .a and .[n] give null, later steps run on it
+	void missing(int i)
+	{
+		const Node &s = step(i);
+		if (s.kind == Node::ITERATE) return;
+		for (size_t j = static_cast<size_t>(i) + 1; j < _prefix; j++) {
+			if (_root.children[j].kind == Node::ITERATE) return;
+		}
+		add(Json());
+	}
+
+	void add(Json &&record)
+	{
+		_records.push_back(std::move(record));
+		if (_records.size() >= STREAM_BATCH) flush();
+	}
+
+	template <typename F>
+	bool scalar(F event)
+	{
+		if (_capture_depth > 0) return std::invoke(event, static_cast<JsonHandler &>(_builder));
+		int k = next();
+		if (k == static_cast<int>(_prefix)) {
+			std::invoke(event, static_cast<JsonHandler &>(_builder));
+			add(std::move(_builder.result()));
+		}
+		else if (k >= 0) {
+			missing(k);
+		}
+		return true;
+	}
+
+	template <typename F>
+	bool start(bool object, F event)
+	{
+		if (_capture_depth == 0) {
+			int k = next();
+			if (k != static_cast<int>(_prefix)) {
+				if (k >= 0) {
+					const Node &s = step(k);
+					if ((s.kind == Node::FIELD && !object) || (s.kind == Node::INDEX && object)) {
+						missing(k);
+						k = -1;
+					}
+				}
+				_frames.push_back(Frame{ k, object, 0, -1, false });
+				return true;
+			}
+		}
+		_capture_depth++;
+		return std::invoke(event, static_cast<JsonHandler &>(_builder));
+	}
+
+	template <typename F>
+	bool end(F event)
+	{
+		if (_capture_depth > 0) {
+			std::invoke(event, static_cast<JsonHandler &>(_builder));
+			if (--_capture_depth == 0) add(std::move(_builder.result()));
+			return true;
+		}
+		Frame top = _frames.back();
+		_frames.pop_back();
+		if (top.step >= 0 && !top.found && step(top.step).kind != Node::ITERATE) missing(top.step);
+		return true;
+	}
+};
+
+//========================JsonQuery============================================
+bool JsonQuery::compile(const std::string & expr, size_t * error_pos)
+{
+	size_t pos;
+	bool ok = QueryCompiler(expr).compile(_root, pos);
+	if (error_pos) *error_pos = pos;
+	if (!ok) _root = Node();
+	_stream_prefix = 0;
+	for (const Node &c : _root.children) {
+		if (c.kind != Node::FIELD && c.kind != Node::ITERATE && !(c.kind == Node::INDEX && c.index >= 0)) break;
+		_stream_prefix++;
+	}
+	return ok;
+}
+
+Json JsonQuery::evaluate(const Json & input) const
+{
+	QueryEvaluator evaluator;
+	Batch in(1, &input), res;
+	evaluator.run(_root, 0, _root.children.size(), in, res);
+	Json::Array out;
+	out.reserve(res.size());
+	for (const Json *r : res) out.push_back(*r);
+	return Json(std::move(out));
+}
+
+Json::State JsonQuery::evaluateStream(const std::string & str, Json & out, const ParseOptions & options) const
+{
+	Json::Array results;
+	StreamQuery query(_root, _stream_prefix, results);
+	Json::State state = Json::parseEvents(str, query, options);
+	if (state != Json::PARSE_OK) {
+		out = Json(Json::NUL, state);
+		return state;
+	}
+	query.flush();
+	out = Json(std::move(results));
+	return state;
+}
+
+} // namespace json
+} // namespace ll
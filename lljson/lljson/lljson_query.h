@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "lljson.h"
+
+namespace ll {
+
+namespace json {
+
+// A jq subset compiled once into a tree of steps:
+//   .  .a  ."a b"  .[0]  .[-1]  .[1:3]  .[]  .a[]    paths, wildcards, slices
+//   f | g                                             pipe
+//   select(.status == 500 and .latency > 100)        filter, == != < <= > >= and or not
+//   {id, latency, t: .timing.total}  [ f ]           projections
+//   null true false 1.5 "s"                           literals
+// A query maps its input to a stream of outputs, returned as an array.
+// Each step takes a whole batch of values at a time, so the interpretive
+// overhead is paid once per batch, not once per array element. Operands of
+// comparisons and object members must give exactly one value per input
+// (no [] or select inside them).
+class JsonQuery {
+public:
+	// Compile expr, false on a syntax error, error_pos gets its offset
+	bool compile(const std::string &expr, size_t *error_pos = nullptr);
+
+	// Evaluate over a tree
+	Json evaluate(const Json &input) const;
+	// Evaluate over input text. The leading run of .a .[n] .[] steps is
+	// matched on the event stream, and only the values it selects are
+	// built, a batch at a time, for the rest of the query. Object members
+	// are iterated in document order here, in key order over a tree.
+	Json::State evaluateStream(const std::string &str, Json &out,
+		const ParseOptions &options = ParseOptions()) const;
+
+	struct Node {
+		enum Kind {
+			PIPELINE, FIELD, INDEX, SLICE, ITERATE, SELECT, NOT,
+			OBJECT, COLLECT, LITERAL, COMPARE, AND, OR
+		};
+		enum Op {
+			EQ, NE, LT, LE, GT, GE
+		};
+		Kind kind = PIPELINE;
+		std::string name;		// FIELD
+		long index = 0;			// INDEX
+		long begin = 0, end = 0;	// SLICE
+		bool has_begin = false, has_end = false;
+		Op op = EQ;				// COMPARE
+		Json literal;			// LITERAL
+		std::vector<std::string> keys;	// OBJECT, one per child
+		std::vector<Node> children;
+	};
+private:
+	Node _root;
+	// _root.children[0, _stream_prefix) are matched on the event stream
+	size_t _stream_prefix = 0;
+};
+
+} // namespace json
+} // namespace ll
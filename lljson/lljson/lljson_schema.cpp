@@ -0,0 +1,438 @@
+#include <cmath>
+#include "lljson_schema.h"
+
+namespace ll {
+
+namespace json {
+
+//========================aux function=========================================
+static bool isCount(const Json &j)
+{
+	return j.isNumber() && j.getNumber() >= 0 && j.getNumber() == std::floor(j.getNumber());
+}
+
+static bool typeBit(const std::string &name, unsigned &bits)
+{
+	static const char *names[] = { "null", "boolean", "number", "string", "array", "object", "integer" };
+	for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (name == names[i]) {
+			bits |= 1u << i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Elements of an array, a packed one only has them as numbers
+static Json::Array elements(const Json &array)
+{
+	if (array.isPackedArray()) {
+		const std::vector<double> &numbers = array.getNumberArray();
+		return Json::Array(numbers.begin(), numbers.end());
+	}
+	return array.getArray();
+}
+
+static size_t codePoints(std::string_view s)
+{
+	size_t n = 0;
+	for (unsigned char ch : s) {
+		n += (ch & 0xC0) != 0x80;
+	}
+	return n;
+}
+
+//========================SchemaValidator======================================
+// Runs the compiled schema over parser events, optionally passing them on
+// to a builder so the tree is made in the same pass
+class SchemaValidator : public JsonHandler {
+public:
+	typedef JsonSchema::Node Node;
+
+	SchemaValidator(const std::vector<Node> &nodes, int root, JsonBuilder *builder)
+		:_nodes(nodes), _root(root), _builder(builder)
+	{
+	}
+
+	bool null() override
+	{
+		int node;
+		return begin(Json::NUL, node) && matchScalar(node, Json()) && forward(&JsonHandler::null);
+	}
+
+	bool boolean(bool b) override
+	{
+		int node;
+		return begin(Json::BOOLEAN, node) && matchScalar(node, Json(b))
+			&& forward([b](JsonHandler &h) { return h.boolean(b); });
+	}
+
+	bool number(double n) override
+	{
+		int node;
+		if (!begin(Json::NUMBER, node, n)) return false;
+		if (node >= 0) {
+			const Node &s = _nodes[node];
+			if (n < s.minimum || n > s.maximum || n <= s.exclusive_minimum || n >= s.exclusive_maximum) {
+				return fail(_depth);
+			}
+		}
+		return matchScalar(node, Json(n)) && forward([n](JsonHandler &h) { return h.number(n); });
+	}
+
+	bool string(std::string_view str) override
+	{
+		int node;
+		if (!begin(Json::STRING, node)) return false;
+		if (node >= 0) {
+			const Node &s = _nodes[node];
+			size_t n = codePoints(str);
+			if (n < s.min_length || n > s.max_length) return fail(_depth);
+			if (s.has_enum && !matchScalar(node, Json(std::string(str)))) return false;
+		}
+		return forward([str](JsonHandler &h) { return h.string(str); });
+	}
+
+	bool startArray() override
+	{
+		int node;
+		if (!begin(Json::ARRAY, node)) return false;
+		push(node, false);
+		return forward(&JsonHandler::startArray);
+	}
+
+	bool endArray() override
+	{
+		Frame &top = _stack[_depth - 1];
+		if (top.node >= 0) {
+			const Node &s = _nodes[top.node];
+			if (top.count < s.min_items || top.count > s.max_items) return fail(_depth - 1);
+		}
+		return forward(&JsonHandler::endArray) && pop();
+	}
+
+	bool startObject() override
+	{
+		int node;
+		if (!begin(Json::OBJECT, node)) return false;
+		push(node, true);
+		return forward(&JsonHandler::startObject);
+	}
+
+	bool key(std::string_view k) override
+	{
+		Frame &top = _stack[_depth - 1];
+		top.count++;
+		top.key.assign(k.data(), k.size());
+		top.child = JsonSchema::ANY;
+		if (top.node >= 0) {
+			const Node &s = _nodes[top.node];
+			auto it = s.properties.find(k);
+			if (it == s.properties.end()) {
+				top.child = s.additional;
+			}
+			else {
+				top.child = it->second.node;
+				if (it->second.required >= 0) {
+					_seen[top.seen + it->second.required] = 1;
+				}
+			}
+			if (top.child == JsonSchema::REJECT) return fail(_depth);
+		}
+		return forward([k](JsonHandler &h) { return h.key(k); });
+	}
+
+	bool endObject() override
+	{
+		Frame &top = _stack[_depth - 1];
+		if (top.node >= 0) {
+			const Node &s = _nodes[top.node];
+			for (int i = 0; i < s.required_count; i++) {
+				if (!_seen[top.seen + i]) return fail(_depth - 1);
+			}
+			_seen.resize(top.seen);
+		}
+		return forward(&JsonHandler::endObject) && pop();
+	}
+
+	bool failed() const
+	{
+		return _failed;
+	}
+
+	const std::string &errorPath() const
+	{
+		return _error_path;
+	}
+private:
+	// open containers, _stack[0, _depth) are in use and the rest keep
+	// their key buffers for reuse
+	struct Frame {
+		int node;
+		bool object;
+		size_t count;		// elements or members seen
+		std::string key;	// member being checked
+		int child;			// schema of that member
+		size_t seen;		// offset of the required flags in _seen
+	};
+	// enum over a container: the value is built, then compared
+	struct Capture {
+		JsonBuilder builder;
+		int node;
+		size_t depth;
+	};
+
+	const std::vector<Node> &_nodes;
+	int _root;
+	JsonBuilder *_builder;
+	std::vector<Frame> _stack;
+	size_t _depth = 0;
+	std::vector<char> _seen;
+	std::vector<Capture> _captures;
+	bool _failed = false;
+	std::string _error_path;
+
+	// Schema of the value starting now, checked against its type
+	bool begin(Json::Type type, int &node, double n = 0)
+	{
+		if (_depth == 0) {
+			node = _root;
+		}
+		else {
+			Frame &top = _stack[_depth - 1];
+			if (top.object) {
+				node = top.child;
+			}
+			else {
+				top.count++;
+				node = top.node >= 0 ? _nodes[top.node].items : JsonSchema::ANY;
+			}
+		}
+		if (node == JsonSchema::ANY) return true;
+		if (node == JsonSchema::REJECT) return fail(_depth);
+		unsigned types = _nodes[node].types;
+		if (types & (1u << type)) return true;
+		if (type == Json::NUMBER && (types & JsonSchema::INTEGER_BIT) && std::floor(n) == n) return true;
+		return fail(_depth);
+	}
+
+	bool matchScalar(int node, const Json &value)
+	{
+		if (node < 0 || !_nodes[node].has_enum) return true;
+		for (const Json &e : _nodes[node].enum_values) {
+			if (e == value) return true;
+		}
+		return fail(_depth);
+	}
+
+	void push(int node, bool object)
+	{
+		if (_depth == _stack.size()) {
+			_stack.emplace_back();
+		}
+		Frame &f = _stack[_depth++];
+		f.node = node;
+		f.object = object;
+		f.count = 0;
+		f.child = JsonSchema::ANY;
+		f.seen = _seen.size();
+		if (node >= 0) {
+			_seen.resize(_seen.size() + _nodes[node].required_count, 0);
+			if (_nodes[node].has_enum) {
+				_captures.push_back(Capture{ JsonBuilder(), node, _depth });
+			}
+		}
+	}
+
+	bool pop()
+	{
+		if (!_captures.empty() && _captures.back().depth == _depth) {
+			Json value = std::move(_captures.back().builder.result());
+			int node = _captures.back().node;
+			_captures.pop_back();
+			_depth--;
+			if (!matchScalar(node, value)) return false;
+		}
+		else {
+			_depth--;
+		}
+		return true;
+	}
+
+	// Pass the event on to the builder and open enum captures
+	template <typename F>
+	bool forward(F event)
+	{
+		for (Capture &c : _captures) {
+			std::invoke(event, static_cast<JsonHandler &>(c.builder));
+		}
+		return _builder == nullptr || std::invoke(event, static_cast<JsonHandler &>(*_builder));
+	}
+
+	// Record the path of the failing value, the first frames containers
+	// and the member or element of the last one
+	bool fail(size_t frames)
+	{
+		_failed = true;
+		_error_path.clear();
+		for (size_t i = 0; i < frames; i++) {
+			_error_path += '/';
+			if (_stack[i].object) {
+				for (char ch : _stack[i].key) {
+					if (ch == '~') _error_path += "~0";
+					else if (ch == '/') _error_path += "~1";
+					else _error_path += ch;
+				}
+			}
+			else {
+				_error_path += std::to_string(_stack[i].count - 1);
+			}
+		}
+		return false;
+	}
+};
+
+//========================JsonSchema===========================================
+bool JsonSchema::compile(const Json & schema)
+{
+	_nodes.clear();
+	bool ok = true;
+	_root = compileNode(schema, ok);
+	if (!ok) {
+		_nodes.clear();
+		_root = ANY;
+	}
+	return ok;
+}
+
+int JsonSchema::compileNode(const Json & schema, bool & ok)
+{
+	if (schema.isBoolean()) {
+		return schema.getBoolean() ? ANY : REJECT;
+	}
+	if (!schema.isObject()) {
+		ok = false;
+		return ANY;
+	}
+	// children are compiled first, _nodes may grow meanwhile
+	int index = static_cast<int>(_nodes.size());
+	_nodes.emplace_back();
+	Node node;
+	const Json::Object &o = schema.getObject();
+	auto keyword = [&o](const char *name) -> const Json * {
+		auto it = o.find(name);
+		return it == o.end() ? nullptr : &it->second;
+	};
+	auto number = [&ok](const Json *j, double &out) {
+		if (j == nullptr) return;
+		if (j->isNumber()) out = j->getNumber();
+		else ok = false;
+	};
+	auto count = [&ok](const Json *j, size_t &out) {
+		if (j == nullptr) return;
+		if (isCount(*j)) out = static_cast<size_t>(j->getNumber());
+		else ok = false;
+	};
+
+	if (const Json *type = keyword("type")) {
+		node.types = 0;
+		if (type->isString()) {
+			ok = typeBit(type->getString(), node.types) && ok;
+		}
+		else if (type->isArray()) {
+			for (const Json &t : elements(*type)) {
+				ok = t.isString() && typeBit(t.getString(), node.types) && ok;
+			}
+		}
+		else {
+			ok = false;
+		}
+	}
+	if (const Json *e = keyword("enum")) {
+		if (e->isArray()) {
+			node.has_enum = true;
+			node.enum_values = elements(*e);
+		}
+		else {
+			ok = false;
+		}
+	}
+	number(keyword("minimum"), node.minimum);
+	number(keyword("maximum"), node.maximum);
+	number(keyword("exclusiveMinimum"), node.exclusive_minimum);
+	number(keyword("exclusiveMaximum"), node.exclusive_maximum);
+	count(keyword("minLength"), node.min_length);
+	count(keyword("maxLength"), node.max_length);
+	count(keyword("minItems"), node.min_items);
+	count(keyword("maxItems"), node.max_items);
+	if (const Json *items = keyword("items")) {
+		node.items = compileNode(*items, ok);
+	}
+	if (const Json *properties = keyword("properties")) {
+		if (properties->isObject()) {
+			for (const auto &kv : properties->getObject()) {
+				node.properties[kv.first] = Node::Property{ compileNode(kv.second, ok), -1 };
+			}
+		}
+		else {
+			ok = false;
+		}
+	}
+	if (const Json *additional = keyword("additionalProperties")) {
+		node.additional = compileNode(*additional, ok);
+	}
+	if (const Json *required = keyword("required")) {
+		if (required->isArray()) {
+			for (const Json &name : elements(*required)) {
+				if (!name.isString()) {
+					ok = false;
+					continue;
+				}
+				auto it = node.properties.find(name.getString());
+				if (it == node.properties.end()) {
+					it = node.properties.emplace(name.getString(), Node::Property{ node.additional, -1 }).first;
+				}
+				if (it->second.required < 0) {
+					it->second.required = node.required_count++;
+				}
+			}
+		}
+		else {
+			ok = false;
+		}
+	}
+	_nodes[index] = std::move(node);
+	return index;
+}
+
+Json::State JsonSchema::validate(const std::string & str, std::string * error_path, const ParseOptions & options) const
+{
+	SchemaValidator validator(_nodes, _root, nullptr);
+	Json::State state = Json::parseEvents(str, validator, options);
+	if (validator.failed()) {
+		if (error_path) *error_path = validator.errorPath();
+		return Json::PARSE_SCHEMA_MISMATCH;
+	}
+	return state;
+}
+
+Json::State JsonSchema::parse(const std::string & str, Json & out, std::string * error_path, const ParseOptions & options) const
+{
+	JsonBuilder builder;
+	SchemaValidator validator(_nodes, _root, &builder);
+	Json::State state = Json::parseEvents(str, validator, options);
+	if (validator.failed()) {
+		if (error_path) *error_path = validator.errorPath();
+		state = Json::PARSE_SCHEMA_MISMATCH;
+	}
+	if (state == Json::PARSE_OK) {
+		out = std::move(builder.result());
+	}
+	else {
+		out = Json(Json::NUL, state);
+	}
+	return state;
+}
+
+} // namespace json
+} // namespace ll
@@ -0,0 +1,65 @@
+#pragma once
+#include <limits>
+#include <string>
+#include <vector>
+#include "lljson.h"
+
+namespace ll {
+
+namespace json {
+
+// A JSON Schema subset compiled into a table of states, one per (sub)schema.
+// Keywords: type, enum, minimum, maximum, exclusiveMinimum, exclusiveMaximum,
+// minLength, maxLength, minItems, maxItems, items, properties, required,
+// additionalProperties. Other keywords are ignored, like unknown keywords in
+// JSON Schema. Validation runs on the parser's event stream, in the same pass
+// as parsing.
+class JsonSchema {
+public:
+	// Compile schema, false if it is not an object/boolean or a supported
+	// keyword has a value of the wrong type
+	bool compile(const Json &schema);
+
+	// Check str without building a tree. error_path gets the JSON Pointer of
+	// the first failing value on PARSE_SCHEMA_MISMATCH
+	Json::State validate(const std::string &str, std::string *error_path = nullptr,
+		const ParseOptions &options = ParseOptions()) const;
+	// Parse str and check it in one pass, out is NUL with the state on failure
+	Json::State parse(const std::string &str, Json &out, std::string *error_path = nullptr,
+		const ParseOptions &options = ParseOptions()) const;
+
+	enum {
+		ANY = -1,		// no constraints
+		REJECT = -2		// schema false, nothing is valid
+	};
+	struct Node {
+		unsigned types = ~0u;	// bit 1 << Json::Type, plus INTEGER_BIT
+		double minimum = -std::numeric_limits<double>::infinity();
+		double maximum = std::numeric_limits<double>::infinity();
+		double exclusive_minimum = -std::numeric_limits<double>::infinity();
+		double exclusive_maximum = std::numeric_limits<double>::infinity();
+		size_t min_length = 0, max_length = static_cast<size_t>(-1);	// in code points
+		size_t min_items = 0, max_items = static_cast<size_t>(-1);
+		int items = ANY;
+		// member schema and its bit among required members, or -1
+		struct Property {
+			int node;
+			int required;
+		};
+		std::map<std::string, Property, std::less<>> properties;
+		int required_count = 0;
+		int additional = ANY;
+		bool has_enum = false;
+		std::vector<Json> enum_values;
+	};
+	static const unsigned INTEGER_BIT = 1u << 6;
+private:
+	// _nodes[0] is the root unless _root is ANY or REJECT
+	std::vector<Node> _nodes;
+	int _root = ANY;
+
+	int compileNode(const Json &schema, bool &ok);
+};
+
+} // namespace json
+} // namespace ll
@@ -0,0 +1,394 @@
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include "lljson_shred.h"
+
+namespace ll {
+
+namespace json {
+
+typedef JsonShredder::Column Column;
+typedef JsonShredder::Field Field;
+
+//========================aux function=========================================
+static void appendBit(std::vector<std::uint8_t> &bits, size_t i, bool b)
+{
+	if ((i & 7) == 0) bits.push_back(0);
+	if (b) bits[i >> 3] |= static_cast<std::uint8_t>(1u << (i & 7));
+}
+
+// Placeholder value of a null row
+static void appendDefault(Column &c, size_t row)
+{
+	switch (c.type) {
+	case Column::INT64: c.ints.push_back(0); break;
+	case Column::DOUBLE: c.doubles.push_back(0); break;
+	case Column::BOOL: appendBit(c.bools, row, false); break;
+	case Column::STRING: c.offsets.push_back(static_cast<std::int64_t>(c.data.size())); break;
+	default: break;
+	}
+}
+
+static void appendNull(Column &c)
+{
+	appendBit(c.validity, c.length, false);
+	appendDefault(c, c.length);
+	c.length++;
+	c.null_count++;
+}
+
+static void clearData(Column &c)
+{
+	c.length = c.null_count = 0;
+	c.validity.clear();
+	c.ints.clear();
+	c.doubles.clear();
+	c.bools.clear();
+	c.offsets.assign(c.type == Column::STRING ? 1 : 0, 0);
+	c.data.clear();
+}
+
+// Type an inferred column, its rows so far stay null
+static void setType(Column &c, Column::Type type)
+{
+	c.type = type;
+	if (type == Column::STRING) c.offsets.assign(1, 0);
+	for (size_t i = 0; i < c.length; i++) appendDefault(c, i);
+}
+
+// Integer value of a number, read from its text when that is a plain
+// integer. Else only the double is known, which is exact up to 2^53
+static bool toInt64(std::string_view text, double n, std::int64_t &v)
+{
+	if (text.find_first_of(".eE") == std::string_view::npos) {
+		// text is inside the NUL terminated input, strtoll stops at its end
+		errno = 0;
+		long long l = std::strtoll(text.data(), nullptr, 10);
+		if (errno == ERANGE) return false;
+		v = l;
+		return true;
+	}
+	if (n != std::floor(n) || std::fabs(n) > 9007199254740992.0) return false;
+	v = static_cast<std::int64_t>(n);
+	return true;
+}
+
+//========================ShredHandler=========================================
+class ShredHandler : public JsonHandler {
+public:
+	ShredHandler(JsonShredder &shredder)
+		:_s(shredder)
+	{
+	}
+
+	bool null() override
+	{
+		int c;
+		return column(Column::NUL, c);
+	}
+
+	bool boolean(bool b) override
+	{
+		int c;
+		if (!column(Column::BOOL, c)) return false;
+		if (c >= 0 && start(c, Column::BOOL)) {
+			Column &col = _s._columns[c];
+			appendBit(col.bools, col.length, b);
+			col.length++;
+		}
+		return !_failed;
+	}
+
+	bool rawNumber(std::string_view text, double n) override
+	{
+		std::int64_t v = 0;
+		Column::Type type = toInt64(text, n, v) ? Column::INT64 : Column::DOUBLE;
+		int c;
+		if (!column(type, c)) return false;
+		if (c >= 0 && start(c, type)) {
+			Column &col = _s._columns[c];
+			if (col.type == Column::INT64) col.ints.push_back(v);
+			else col.doubles.push_back(n);
+			col.length++;
+		}
+		return !_failed;
+	}
+
+	bool string(std::string_view str) override
+	{
+		int c;
+		if (!column(Column::STRING, c)) return false;
+		if (c >= 0 && start(c, Column::STRING)) {
+			Column &col = _s._columns[c];
+			col.data.append(str.data(), str.size());
+			col.offsets.push_back(static_cast<std::int64_t>(col.data.size()));
+			col.length++;
+		}
+		return !_failed;
+	}
+
+	bool startArray() override
+	{
+		if (_skip > 0) {
+			_skip++;
+			return true;
+		}
+		if (_frames.empty()) {
+			if (_in_array) return fail();	// a record that isn't an object
+			_in_array = true;
+			return true;
+		}
+		Frame &top = _frames.back();
+		if (_s._fixed && top.field >= 0) return fail();
+		top.field = -1;
+		_skip = 1;
+		return true;
+	}
+
+	bool endArray() override
+	{
+		if (_skip > 0) _skip--;
+		return true;
+	}
+
+	bool startObject() override
+	{
+		if (_skip > 0) {
+			_skip++;
+			return true;
+		}
+		if (_frames.empty()) {
+			if (!_in_array) return fail();
+			_frames.push_back(Frame{ 0, 0, -1 });
+			return true;
+		}
+		Frame &top = _frames.back();
+		if (top.field < 0) {
+			_skip = 1;
+			return true;
+		}
+		int group = top.group, field = top.field;
+		top.field = -1;
+		int child = _s._groups[group].fields[field].group;
+		if (child < 0) {
+			if (_s._fixed) return fail();
+			child = static_cast<int>(_s._groups.size());
+			_s._groups.emplace_back();
+			_s._groups[group].fields[field].group = child;
+		}
+		_frames.push_back(Frame{ child, 0, -1 });
+		return true;
+	}
+
+	bool key(std::string_view k) override
+	{
+		if (_skip > 0) return true;
+		Frame &top = _frames.back();
+		std::vector<Field> &fields = _s._groups[top.group].fields;
+		// members usually come in the order of the previous record
+		size_t i = top.next;
+		if (i >= fields.size() || fields[i].key != k) {
+			for (i = 0; i < fields.size() && fields[i].key != k; i++);
+		}
+		if (i == fields.size()) {
+			if (_s._fixed) {
+				top.field = -1;
+				return true;
+			}
+			fields.emplace_back();
+			fields.back().key.assign(k.data(), k.size());
+		}
+		top.field = static_cast<int>(i);
+		top.next = i + 1;
+		return true;
+	}
+
+	bool endObject() override
+	{
+		if (_skip > 0) {
+			_skip--;
+			return true;
+		}
+		_frames.pop_back();
+		if (_frames.empty()) {
+			size_t rows = ++_s._rows;
+			for (Column &c : _s._columns) {
+				while (c.length < rows) appendNull(c);
+			}
+		}
+		return true;
+	}
+
+	bool failed() const
+	{
+		return _failed;
+	}
+private:
+	// an open object of a record, field is the member being read or -1
+	struct Frame {
+		int group;
+		size_t next;
+		int field;
+	};
+
+	JsonShredder &_s;
+	std::vector<Frame> _frames;
+	bool _in_array = false;
+	size_t _skip = 0;
+	bool _failed = false;
+
+	bool fail()
+	{
+		_failed = true;
+		return false;
+	}
+
+	// Dotted name of a member of the current object
+	std::string path(const std::string &key) const
+	{
+		std::string name;
+		for (size_t i = 1; i < _frames.size(); i++) {
+			const Frame &parent = _frames[i - 1];
+			for (const Field &f : _s._groups[parent.group].fields) {
+				if (f.group == _frames[i].group) {
+					name += f.key;
+					name += '.';
+					break;
+				}
+			}
+		}
+		return name + key;
+	}
+
+	// Column of the scalar starting now, c is -1 if it isn't shredded
+	bool column(Column::Type type, int &c)
+	{
+		c = -1;
+		if (_skip > 0) return true;
+		if (_frames.empty()) return fail();
+		Frame &top = _frames.back();
+		if (top.field < 0) return true;
+		Field &f = _s._groups[top.group].fields[top.field];
+		top.field = -1;
+		if (f.column < 0) {
+			if (_s._fixed) return type == Column::NUL || fail();
+			if (type == Column::NUL && f.group >= 0) return true;	// null object
+			f.column = static_cast<int>(_s._columns.size());
+			_s._columns.emplace_back();
+			_s._columns.back().name = path(f.key);
+		}
+		c = f.column;
+		return true;
+	}
+
+	// Pad column c to the current row and make it take type, false if
+	// the row already has a value or type doesn't fit
+	bool start(int c, Column::Type type)
+	{
+		Column &col = _s._columns[c];
+		if (col.length > _s._rows) return false;
+		while (col.length < _s._rows) appendNull(col);
+		// integers go to DOUBLE columns as is
+		if (col.type != type && !(col.type == Column::DOUBLE && type == Column::INT64)) {
+			if (col.type == Column::NUL && !_s._fixed) {
+				setType(col, type);
+			}
+			else if (col.type == Column::INT64 && type == Column::DOUBLE && !_s._fixed) {
+				col.doubles.assign(col.ints.begin(), col.ints.end());
+				col.ints.clear();
+				col.type = Column::DOUBLE;
+			}
+			else {
+				return !fail();
+			}
+		}
+		appendBit(col.validity, col.length, true);
+		return true;
+	}
+};
+
+//========================JsonShredder=========================================
+void JsonShredder::addColumn(const std::string & path, Column::Type type)
+{
+	assert(type != Column::NUL);
+	if (_groups.empty()) _groups.emplace_back();
+	_fixed = true;
+	int group = 0;
+	size_t begin = 0;
+	for (;;) {
+		size_t dot = path.find('.', begin);
+		std::string key = path.substr(begin, dot == std::string::npos ? std::string::npos : dot - begin);
+		std::vector<Field> &fields = _groups[group].fields;
+		size_t i = 0;
+		for (; i < fields.size() && fields[i].key != key; i++);
+		if (i == fields.size()) {
+			fields.emplace_back();
+			fields.back().key = key;
+		}
+		if (dot == std::string::npos) {
+			assert(fields[i].column < 0);
+			fields[i].column = static_cast<int>(_columns.size());
+			_columns.emplace_back();
+			_columns.back().name = path;
+			_columns.back().type = type;
+			clearData(_columns.back());
+			return;
+		}
+		if (fields[i].group < 0) {
+			fields[i].group = static_cast<int>(_groups.size());
+			_groups.emplace_back();
+		}
+		group = _groups[group].fields[i].group;
+		begin = dot + 1;
+	}
+}
+
+Json::State JsonShredder::shred(const std::string & str, const ParseOptions & options)
+{
+	if (!_fixed) {
+		_groups.assign(1, Group());
+		_columns.clear();
+	}
+	for (Column &c : _columns) {
+		clearData(c);
+	}
+	_rows = 0;
+	ShredHandler handler(*this);
+	Json::State state = Json::parseEvents(str, handler, options);
+	if (handler.failed()) {
+		state = Json::PARSE_TYPE_MISMATCH;
+	}
+	if (state != Json::PARSE_OK) {
+		if (!_fixed) {
+			_groups.assign(1, Group());
+			_columns.clear();
+		}
+		for (Column &c : _columns) {
+			clearData(c);
+		}
+		_rows = 0;
+	}
+	return state;
+}
+
+size_t JsonShredder::rows() const
+{
+	return _rows;
+}
+
+const std::vector<JsonShredder::Column>& JsonShredder::columns() const
+{
+	return _columns;
+}
+
+const JsonShredder::Column * JsonShredder::column(std::string_view name) const
+{
+	for (const Column &c : _columns) {
+		if (c.name == name) return &c;
+	}
+	return nullptr;
+}
+
+} // namespace json
+} // namespace ll
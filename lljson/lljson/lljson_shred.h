@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "lljson.h"
+
+namespace ll {
+
+namespace json {
+
+// Turns an array of objects into typed columns, laid out like Arrow arrays,
+// straight from parser events without making a Json per value. Members of
+// nested objects become dotted columns ("a.b"), arrays inside records are
+// skipped. Columns come from addColumn(), or are inferred per shred() when
+// none were added: numbers are INT64 while all are integral, then DOUBLE.
+// INT64 values are read exactly from the source text. A number with a
+// fraction or exponent is only taken as an integer up to 2^53.
+// A value of another type than its column is PARSE_TYPE_MISMATCH; absent
+// members and null are null. Of duplicate members the first is kept.
+class JsonShredder {
+public:
+	struct Column {
+		enum Type {
+			NUL,		// inferred column with only nulls so far
+			INT64, DOUBLE, BOOL, STRING
+		};
+		std::string name;
+		Type type = NUL;
+		size_t length = 0;
+		size_t null_count = 0;
+		// bit i (LSB first) is set when row i has a value
+		std::vector<std::uint8_t> validity;
+		std::vector<std::int64_t> ints;
+		std::vector<double> doubles;
+		std::vector<std::uint8_t> bools;	// bitmap like validity
+		// row i is data[offsets[i], offsets[i + 1])
+		std::vector<std::int64_t> offsets;
+		std::string data;
+
+		bool isValid(size_t row) const
+		{
+			return (validity[row >> 3] >> (row & 7)) & 1;
+		}
+		bool getBool(size_t row) const
+		{
+			return (bools[row >> 3] >> (row & 7)) & 1;
+		}
+		std::string_view getString(size_t row) const
+		{
+			return std::string_view(data).substr(static_cast<size_t>(offsets[row]),
+				static_cast<size_t>(offsets[row + 1] - offsets[row]));
+		}
+	};
+
+	// Fix the schema, path is dotted, type must not be NUL
+	void addColumn(const std::string &path, Column::Type type);
+	// Shred str into columns(), which are empty on error
+	Json::State shred(const std::string &str, const ParseOptions &options = ParseOptions());
+
+	size_t rows() const;
+	const std::vector<Column> &columns() const;
+	// nullptr if there is no such column
+	const Column *column(std::string_view name) const;
+
+	// member names of one object path, see ShredHandler
+	struct Field {
+		std::string key;
+		int column = -1;
+		int group = -1;
+	};
+	struct Group {
+		std::vector<Field> fields;
+	};
+private:
+	// _groups[0] is the record
+	std::vector<Group> _groups;
+	std::vector<Column> _columns;
+	size_t _rows = 0;
+	bool _fixed = false;
+
+	friend class ShredHandler;
+};
+
+} // namespace json
+} // namespace ll
@@ -0,0 +1,943 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "lljson.h"
+
+// Compile-time JSON literals: the compiler parses the text into a table of
+// nodes placed in read-only data, nothing is parsed or allocated at startup.
+//
+//	static constexpr ll::json::JsonView defaults = LLJSON_STATIC(R"({"port":8080,"hosts":["a","b"]})");
+//
+//	double port = defaults["port"].getNumber();
+//	static_assert(defaults["hosts"].size() == 2);
+//	Json config = defaults.toJson();	// only when a mutable tree is needed
+//
+// Malformed text is a compile error pointing at the throw that names the
+// problem. Values are those Json::parse gives: numbers are rounded exactly
+// like strtod, a duplicated key keeps its last value and members are in
+// key order. Large literals may need the compiler's constexpr limits raised
+// (/constexpr:steps on MSVC, -fconstexpr-ops-limit and
+// -fconstexpr-loop-limit on GCC).
+
+#define LLJSON_STATIC(literal)\
+	([] {\
+		struct LLJsonStaticText {\
+			static constexpr std::string_view lljsonText() { return literal; }\
+		};\
+		return ::ll::json::detail::staticView<LLJsonStaticText>();\
+	}())
+
+namespace ll {
+
+namespace json {
+
+struct StaticNode {
+	Json::Type type = Json::NUL;
+	bool boolean = false;
+	double number = 0;
+	size_t first = 0;		// STRING: offset in chars, ARRAY / OBJECT: first child node
+	size_t size = 0;		// STRING: bytes, ARRAY / OBJECT: children
+	size_t key = 0;			// member of an object: key offset in chars
+	size_t key_size = 0;
+};
+
+class JsonView;
+
+namespace detail {
+template <class T>
+constexpr JsonView staticView();
+}
+
+// Read-only value of a LLJSON_STATIC literal with the const accessors of
+// Json. A view is three pointers into the literal's table and is passed by
+// value. find and getIf give an empty view, false in a condition, where
+// Json gives nullptr.
+class JsonView {
+	template <class T>
+	friend constexpr JsonView detail::staticView();
+public:
+	class iterator;
+
+	constexpr JsonView() = default;
+
+	constexpr explicit operator bool() const { return _node != nullptr; }
+
+	constexpr Json::Type type() const { return _node->type; }
+	constexpr bool isNull() const { return type() == Json::NUL; }
+	constexpr bool isBoolean() const { return type() == Json::BOOLEAN; }
+	constexpr bool isNumber() const { return type() == Json::NUMBER; }
+	constexpr bool isString() const { return type() == Json::STRING; }
+	constexpr bool isArray() const { return type() == Json::ARRAY; }
+	constexpr bool isObject() const { return type() == Json::OBJECT; }
+
+	constexpr bool getBoolean() const
+	{
+		assert(isBoolean());
+		return _node->boolean;
+	}
+	constexpr double getNumber() const
+	{
+		assert(isNumber());
+		return _node->number;
+	}
+	constexpr std::string_view getString() const
+	{
+		assert(isString());
+		return std::string_view(_chars + _node->first, _node->size);
+	}
+
+	// Array and Object, members are counted and indexed in key order
+	constexpr size_t size() const
+	{
+		assert(isArray() || isObject());
+		return _node->size;
+	}
+	constexpr JsonView operator[](size_t i) const
+	{
+		assert((isArray() || isObject()) && i < _node->size);
+		return child(_node->first + i);
+	}
+	constexpr iterator begin() const;
+	constexpr iterator end() const;
+	// Key of an object member, empty for other values
+	constexpr std::string_view key() const { return std::string_view(_chars + _node->key, _node->key_size); }
+
+	// =================Object=================
+	// Throws std::out_of_range on a missing key, like Json
+	constexpr JsonView operator[](std::string_view key) const
+	{
+		JsonView v = find(key);
+		if (!v) throw std::out_of_range("JsonView::operator[]: no such member");
+		return v;
+	}
+	constexpr JsonView find(std::string_view key) const
+	{
+		if (!isObject()) return JsonView();
+		// members are sorted, binary search
+		size_t lo = _node->first, hi = _node->first + _node->size;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			JsonView m = child(mid);
+			int c = m.key().compare(key);
+			if (c == 0) return m;
+			if (c < 0) lo = mid + 1;
+			else hi = mid;
+		}
+		return JsonView();
+	}
+	constexpr JsonView getIf(std::string_view key, Json::Type type) const
+	{
+		JsonView v = find(key);
+		return v && v.type() == type ? v : JsonView();
+	}
+	constexpr bool getBooleanOr(std::string_view key, bool def) const
+	{
+		JsonView v = getIf(key, Json::BOOLEAN);
+		return v ? v.getBoolean() : def;
+	}
+	constexpr double getNumberOr(std::string_view key, double def) const
+	{
+		JsonView v = getIf(key, Json::NUMBER);
+		return v ? v.getNumber() : def;
+	}
+	constexpr std::string_view getStringOr(std::string_view key, std::string_view def) const
+	{
+		JsonView v = getIf(key, Json::STRING);
+		return v ? v.getString() : def;
+	}
+
+	// A mutable copy, equal to Json::parse of the literal
+	Json toJson() const;
+private:
+	const StaticNode *_nodes = nullptr;
+	const char *_chars = nullptr;
+	const StaticNode *_node = nullptr;
+
+	constexpr JsonView(const StaticNode *nodes, const char *chars, const StaticNode *node)
+		:_nodes(nodes), _chars(chars), _node(node)
+	{
+	}
+
+	constexpr JsonView child(size_t i) const
+	{
+		return JsonView(_nodes, _chars, _nodes + i);
+	}
+};
+
+class JsonView::iterator {
+	friend class JsonView;
+public:
+	constexpr JsonView operator*() const { return _view; }
+	constexpr iterator &operator++()
+	{
+		_view._node++;
+		return *this;
+	}
+	constexpr bool operator==(const iterator &rhs) const { return _view._node == rhs._view._node; }
+	constexpr bool operator!=(const iterator &rhs) const { return _view._node != rhs._view._node; }
+private:
+	JsonView _view;
+
+	constexpr explicit iterator(JsonView view) :_view(view) {}
+};
+
+constexpr JsonView::iterator JsonView::begin() const
+{
+	return iterator(child(_node->first));
+}
+
+constexpr JsonView::iterator JsonView::end() const
+{
+	return iterator(child(_node->first + _node->size));
+}
+
+inline Json JsonView::toJson() const
+{
+	switch (type()) {
+	case Json::NUL:
+		return Json();
+	case Json::BOOLEAN:
+		return Json(getBoolean());
+	case Json::NUMBER:
+		return Json(getNumber());
+	case Json::STRING:
+		return Json(std::string(getString()));
+	case Json::ARRAY: {
+		Json::Array a;
+		a.reserve(size());
+		for (JsonView e : *this) a.push_back(e.toJson());
+		return Json(std::move(a));
+	}
+	default: {
+		// already in key order, every insert is at the end
+		Json::Object o;
+		for (JsonView m : *this) o.emplace_hint(o.end(), std::string(m.key()), m.toJson());
+		return Json(std::move(o));
+	}
+	}
+}
+
+namespace detail {
+
+//========================number conversion====================================
+// Unsigned integer of up to 4096 bits, enough for any number that isn't
+// out of range once digits past the 780th are folded into one
+struct StaticBig {
+	static constexpr size_t WORDS = 128;
+	uint32_t w[WORDS] = {};
+	size_t n = 0;	// words in use
+
+	constexpr void mulAdd(uint32_t m, uint32_t a)
+	{
+		uint64_t carry = a;
+		for (size_t i = 0; i < n; i++) {
+			uint64_t t = uint64_t(w[i]) * m + carry;
+			w[i] = uint32_t(t);
+			carry = t >> 32;
+		}
+		if (carry != 0) push(uint32_t(carry));
+	}
+
+	constexpr void mulPow10(size_t e)
+	{
+		for (; e >= 9; e -= 9) mulAdd(1000000000u, 0);
+		uint32_t m = 1;
+		for (; e > 0; e--) m *= 10;
+		mulAdd(m, 0);
+	}
+
+	constexpr size_t bits() const
+	{
+		if (n == 0) return 0;
+		size_t b = (n - 1) * 32;
+		for (uint32_t top = w[n - 1]; top != 0; top >>= 1) b++;
+		return b;
+	}
+
+	constexpr void shiftLeft(size_t s)
+	{
+		if (n == 0) return;
+		size_t words = s / 32, r = s % 32;
+		if (n + words + 1 > WORDS) throw "LLJSON_STATIC: number out of conversion range";
+		w[n + words] = 0;
+		for (size_t i = n; i-- > 0;) {
+			uint64_t t = uint64_t(w[i]) << r;
+			w[i + words + 1] |= uint32_t(t >> 32);
+			w[i + words] = uint32_t(t);
+		}
+		for (size_t i = 0; i < words; i++) w[i] = 0;
+		n += words + 1;
+		trim();
+	}
+
+	constexpr void shiftRight1()
+	{
+		for (size_t i = 0; i < n; i++) {
+			w[i] = (w[i] >> 1) | (i + 1 < n ? w[i + 1] << 31 : 0);
+		}
+		trim();
+	}
+
+	constexpr int compare(const StaticBig &o) const
+	{
+		if (n != o.n) return n < o.n ? -1 : 1;
+		for (size_t i = n; i-- > 0;) {
+			if (w[i] != o.w[i]) return w[i] < o.w[i] ? -1 : 1;
+		}
+		return 0;
+	}
+
+	// this -= o, o <= this
+	constexpr void subtract(const StaticBig &o)
+	{
+		uint64_t borrow = 0;
+		for (size_t i = 0; i < n; i++) {
+			uint64_t t = uint64_t(w[i]) - (i < o.n ? o.w[i] : 0) - borrow;
+			w[i] = uint32_t(t);
+			borrow = (t >> 32) & 1;
+		}
+		trim();
+	}
+private:
+	constexpr void push(uint32_t v)
+	{
+		if (n == WORDS) throw "LLJSON_STATIC: number out of conversion range";
+		w[n++] = v;
+	}
+
+	constexpr void trim()
+	{
+		while (n > 0 && w[n - 1] == 0) n--;
+	}
+};
+
+// 128-bit mantissa with the top bit set and a binary exponent, value is
+// (w[3]..w[0]) * 2^e
+struct StaticWide {
+	uint32_t w[4] = {};
+	long e = 0;
+};
+
+constexpr void wideNormalize(StaticWide &a)
+{
+	while (a.w[3] == 0) {
+		a.w[3] = a.w[2];
+		a.w[2] = a.w[1];
+		a.w[1] = a.w[0];
+		a.w[0] = 0;
+		a.e -= 32;
+	}
+	while (!(a.w[3] & 0x80000000u)) {
+		for (size_t i = 3; i > 0; i--) a.w[i] = (a.w[i] << 1) | (a.w[i - 1] >> 31);
+		a.w[0] <<= 1;
+		a.e--;
+	}
+}
+
+// Product truncated to 128 bits
+constexpr StaticWide wideMul(const StaticWide &a, const StaticWide &b)
+{
+	uint32_t p[8] = {};
+	for (size_t i = 0; i < 4; i++) {
+		uint64_t carry = 0;
+		for (size_t j = 0; j < 4; j++) {
+			uint64_t t = uint64_t(a.w[i]) * b.w[j] + p[i + j] + carry;
+			p[i + j] = uint32_t(t);
+			carry = t >> 32;
+		}
+		p[i + 4] = uint32_t(carry);
+	}
+	StaticWide r;
+	r.e = a.e + b.e + 128;
+	if (!(p[7] & 0x80000000u)) {
+		for (size_t i = 7; i > 0; i--) p[i] = (p[i] << 1) | (p[i - 1] >> 31);
+		p[0] <<= 1;
+		r.e--;
+	}
+	for (size_t i = 0; i < 4; i++) r.w[i] = p[i + 4];
+	return r;
+}
+
+// 5^(2^i) and 5^-(2^i), computed once for all numbers
+struct StaticPow5 {
+	StaticWide pos[9], neg[9];
+
+	constexpr StaticPow5()
+	{
+		pos[0].w[3] = 0xA0000000u;
+		pos[0].e = -125;
+		// 1/5 rounded
+		neg[0].w[0] = 0xCCCCCCCDu;
+		neg[0].w[1] = neg[0].w[2] = neg[0].w[3] = 0xCCCCCCCCu;
+		neg[0].e = -130;
+		for (size_t i = 1; i < 9; i++) {
+			pos[i] = wideMul(pos[i - 1], pos[i - 1]);
+			neg[i] = wideMul(neg[i - 1], neg[i - 1]);
+		}
+	}
+};
+
+inline constexpr StaticPow5 STATIC_POW5{};
+
+// 5^k within 2^-118 for |k| < 512
+constexpr StaticWide widePow5(long k)
+{
+	const StaticWide *table = k >= 0 ? STATIC_POW5.pos : STATIC_POW5.neg;
+	if (k < 0) k = -k;
+	StaticWide r;
+	r.w[3] = 0x80000000u;
+	r.e = -127;
+	for (size_t i = 0; k > 0; i++, k >>= 1) {
+		if (k & 1) r = wideMul(r, table[i]);
+	}
+	return r;
+}
+
+// q * 2^t, exact at every step as the result is representable
+constexpr double staticScale(uint64_t q, long t)
+{
+	double r = double(q);
+	for (; t >= 32; t -= 32) r *= 4294967296.0;
+	for (; t <= -32; t += 32) r /= 4294967296.0;
+	for (; t > 0; t--) r *= 2;
+	for (; t < 0; t++) r /= 2;
+	return r;
+}
+
+// digits * 10^exp10 correctly rounded by big integer division
+constexpr double staticExact(const char *digits, size_t nd, long exp10)
+{
+	StaticBig num, den;
+	num.w[num.n++] = uint32_t(digits[0] - '0');
+	for (size_t k = 1; k < nd; k++) num.mulAdd(10, uint32_t(digits[k] - '0'));
+	den.w[den.n++] = 1;
+	if (exp10 >= 0) num.mulPow10(size_t(exp10));
+	else den.mulPow10(size_t(-exp10));
+
+	// num / den / 2^t is in (2^54, 2^56), keeping 2 bits past a subnormal's last
+	long t = long(num.bits()) - long(den.bits()) - 55;
+	if (t < -1078) t = -1078;
+	if (t >= 0) den.shiftLeft(size_t(t));
+	else num.shiftLeft(size_t(-t));
+	StaticBig d = den;
+	d.shiftLeft(56);
+	uint64_t q = 0;
+	for (int bit = 56; bit >= 0; bit--) {
+		if (num.compare(d) >= 0) {
+			num.subtract(d);
+			q |= uint64_t(1) << bit;
+		}
+		d.shiftRight1();
+	}
+	// drop the bits past 53, or past 2^-1074, rounding half to even with
+	// the remainder in num as sticky bit
+	size_t len = 0;
+	for (uint64_t v = q; v != 0; v >>= 1) len++;
+	long last = t + long(len) - 53;
+	if (last < -1074) last = -1074;
+	long s = last - t;
+	uint64_t low = q & ((uint64_t(1) << s) - 1), half = uint64_t(1) << (s - 1);
+	q >>= s;
+	if (low > half || (low == half && (num.n != 0 || (q & 1)))) q++;
+	if (q == (uint64_t(1) << 53)) {
+		q >>= 1;
+		last++;
+	}
+	if (last > 971) throw "LLJSON_STATIC: number too big";
+	return staticScale(q, last);
+}
+
+// Validated number text to the double strtod gives. Up to 15 digits with
+// a small exponent is one exact operation, otherwise a 128-bit product
+// decides the rounding unless it is too close to halfway between two
+// doubles, and only then big integers are used
+
+constexpr double staticNumber(std::string_view s)
+{
+	constexpr double POW10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	constexpr size_t MAX_DIGITS = 780;	// a halfway point between doubles has at most 767
+
+	// value is digits * 10^exp10
+	char digits[MAX_DIGITS + 1] = {};
+	size_t nd = 0;
+	long exp10 = 0;
+	bool tail = false;	// nonzero digits dropped past MAX_DIGITS
+	size_t i = 0;
+	bool negative = s[0] == '-';
+	if (negative) i++;
+	bool frac = false;
+	for (; i < s.size() && s[i] != 'e' && s[i] != 'E'; i++) {
+		char ch = s[i];
+		if (ch == '.') {
+			frac = true;
+		}
+		else if (nd == 0 && ch == '0') {
+			if (frac) exp10--;
+		}
+		else if (nd < MAX_DIGITS) {
+			digits[nd++] = ch;
+			if (frac) exp10--;
+		}
+		else {
+			if (!frac) exp10++;
+			if (ch != '0') tail = true;
+		}
+	}
+	if (i < s.size()) {
+		i++;
+		bool negative_exp = s[i] == '-';
+		if (s[i] == '-' || s[i] == '+') i++;
+		long e = 0;
+		for (; i < s.size(); i++) {
+			if (e < 100000) e = e * 10 + (s[i] - '0');
+		}
+		exp10 += negative_exp ? -e : e;
+	}
+	if (tail) {
+		// strictly between the kept digits and the next, rounds the same
+		digits[nd++] = '1';
+		exp10--;
+	}
+	else {
+		while (nd > 0 && digits[nd - 1] == '0') {
+			nd--;
+			exp10++;
+		}
+	}
+	double zero = negative ? -0.0 : 0.0;
+	if (nd == 0) return zero;
+	long mag = long(nd) + exp10;	// value is in [10^(mag-1), 10^mag)
+	if (mag > 310) throw "LLJSON_STATIC: number too big";
+	if (mag < -330) return zero;
+
+	if (nd <= 15 && exp10 >= -22 && exp10 <= 22) {
+		double d = 0;
+		for (size_t k = 0; k < nd; k++) d = d * 10 + (digits[k] - '0');
+		d = exp10 >= 0 ? d * POW10[exp10] : d / POW10[-exp10];
+		return negative ? -d : d;
+	}
+
+	// the first 38 digits fit 128 bits, the rest only moves the value by 2^-123
+	size_t nm = nd < 38 ? nd : 38;
+	StaticWide m;
+	for (size_t k = 0; k < nm; k++) {
+		uint64_t carry = uint64_t(digits[k] - '0');
+		for (size_t i = 0; i < 4; i++) {
+			uint64_t t = uint64_t(m.w[i]) * 10 + carry;
+			m.w[i] = uint32_t(t);
+			carry = t >> 32;
+		}
+	}
+	long e10 = exp10 + long(nd - nm);
+	wideNormalize(m);
+	StaticWide r = wideMul(m, widePow5(e10));
+	r.e += e10;
+	// r is off by less than 2^10 units of its last bit, keep 53 bits or
+	// stop at 2^-1074
+	long drop = 75;
+	if (r.e + drop < -1074) drop = -1074 - r.e;
+	if (drop <= 120) {
+		uint64_t hi = (uint64_t(r.w[3]) << 32) | r.w[2], lo = (uint64_t(r.w[1]) << 32) | r.w[0];
+		uint64_t half = uint64_t(1) << (drop - 65);
+		uint64_t low = hi & ((half << 1) - 1);
+		const uint64_t MARGIN = 1 << 14;
+		bool near = (low == half && lo <= MARGIN) || (low + 1 == half && lo >= ~MARGIN);
+		if (!near) {
+			uint64_t q = hi >> (drop - 64);
+			if (low >= half) q++;
+			long t = r.e + drop;
+			if (q == (uint64_t(1) << 53)) {
+				q >>= 1;
+				t++;
+			}
+			if (t > 971) throw "LLJSON_STATIC: number too big";
+			double d = staticScale(q, t);
+			return negative ? -d : d;
+		}
+	}
+	double d = staticExact(digits, nd, exp10);
+	return negative ? -d : d;
+}
+
+//========================parser===============================================
+struct StaticSizes {
+	size_t nodes = 0;
+	size_t chars = 0;
+};
+
+template <size_t N, size_t C>
+struct StaticDocument {
+	StaticNode nodes[N] = {};
+	char chars[C] = {};
+};
+
+constexpr bool staticBlank(char ch)
+{
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+// Measures the text (Doc is StaticSizes) or fills a StaticDocument of the
+// measured size. Children of a container take consecutive nodes, so it is
+// counted before its elements are parsed. Errors are throws, which are
+// compile errors in a constant expression
+template <class Doc>
+class StaticParser {
+public:
+	constexpr explicit StaticParser(std::string_view text) :_text(text) {}
+
+	constexpr Doc parse()
+	{
+		skipBlank();
+		parseValue(_nodes++);
+		skipBlank();
+		if (_i != _text.size()) throw "LLJSON_STATIC: root not singular";
+		if constexpr (BUILD) {
+			return _doc;
+		}
+		else {
+			return StaticSizes{ _nodes, _chars };
+		}
+	}
+private:
+	static constexpr bool BUILD = !std::is_same<Doc, StaticSizes>::value;
+
+	std::string_view _text;
+	size_t _i = 0;
+	size_t _nodes = 0;
+	size_t _chars = 0;
+	Doc _doc{};
+
+	constexpr char peek() const
+	{
+		return _i < _text.size() ? _text[_i] : '\0';
+	}
+
+	constexpr void skipBlank()
+	{
+		while (_i < _text.size() && staticBlank(_text[_i])) _i++;
+	}
+
+	constexpr void putChar(char ch)
+	{
+		if constexpr (BUILD) _doc.chars[_chars] = ch;
+		_chars++;
+	}
+
+	constexpr void parseValue(size_t n)
+	{
+		switch (peek()) {
+		case 'n':
+			parseLiteral("null");
+			break;
+		case 't':
+			parseLiteral("true");
+			if constexpr (BUILD) {
+				_doc.nodes[n].type = Json::BOOLEAN;
+				_doc.nodes[n].boolean = true;
+			}
+			break;
+		case 'f':
+			parseLiteral("false");
+			if constexpr (BUILD) _doc.nodes[n].type = Json::BOOLEAN;
+			break;
+		case '"': {
+			size_t first = _chars;
+			parseString();
+			if constexpr (BUILD) {
+				_doc.nodes[n].type = Json::STRING;
+				_doc.nodes[n].first = first;
+				_doc.nodes[n].size = _chars - first;
+			}
+			break;
+		}
+		case '[':
+			parseArray(n);
+			break;
+		case '{':
+			parseObject(n);
+			break;
+		case '\0':
+			throw "LLJSON_STATIC: expect value";
+		default:
+			parseNumber(n);
+			break;
+		}
+	}
+
+	constexpr void parseLiteral(std::string_view lit)
+	{
+		if (_text.substr(_i, lit.size()) != lit) throw "LLJSON_STATIC: invalid value";
+		_i += lit.size();
+	}
+
+	constexpr void parseNumber(size_t n)
+	{
+		size_t begin = _i;
+		if (peek() == '-') _i++;
+		if (peek() == '0') {
+			_i++;
+		}
+		else {
+			if (peek() < '1' || peek() > '9') throw "LLJSON_STATIC: invalid value";
+			while (peek() >= '0' && peek() <= '9') _i++;
+		}
+		if (peek() == '.') {
+			_i++;
+			if (peek() < '0' || peek() > '9') throw "LLJSON_STATIC: invalid value";
+			while (peek() >= '0' && peek() <= '9') _i++;
+		}
+		if (peek() == 'e' || peek() == 'E') {
+			_i++;
+			if (peek() == '-' || peek() == '+') _i++;
+			if (peek() < '0' || peek() > '9') throw "LLJSON_STATIC: invalid value";
+			while (peek() >= '0' && peek() <= '9') _i++;
+		}
+		if constexpr (BUILD) {
+			_doc.nodes[n].type = Json::NUMBER;
+			_doc.nodes[n].number = staticNumber(_text.substr(begin, _i - begin));
+		}
+	}
+
+	constexpr uint32_t parseHex4()
+	{
+		uint32_t v = 0;
+		for (int k = 0; k < 4; k++) {
+			char ch = peek();
+			_i++;
+			v <<= 4;
+			if (ch >= '0' && ch <= '9') v |= uint32_t(ch - '0');
+			else if (ch >= 'a' && ch <= 'f') v |= uint32_t(ch - 'a' + 10);
+			else if (ch >= 'A' && ch <= 'F') v |= uint32_t(ch - 'A' + 10);
+			else throw "LLJSON_STATIC: invalid unicode hex";
+		}
+		return v;
+	}
+
+	constexpr void putUtf8(uint32_t cp)
+	{
+		if (cp <= 0x7F) {
+			putChar(char(cp));
+		}
+		else if (cp <= 0x7FF) {
+			putChar(char(0xC0 | (cp >> 6)));
+			putChar(char(0x80 | (cp & 0x3F)));
+		}
+		else if (cp <= 0xFFFF) {
+			putChar(char(0xE0 | (cp >> 12)));
+			putChar(char(0x80 | ((cp >> 6) & 0x3F)));
+			putChar(char(0x80 | (cp & 0x3F)));
+		}
+		else {
+			putChar(char(0xF0 | (cp >> 18)));
+			putChar(char(0x80 | ((cp >> 12) & 0x3F)));
+			putChar(char(0x80 | ((cp >> 6) & 0x3F)));
+			putChar(char(0x80 | (cp & 0x3F)));
+		}
+	}
+
+	// Decoded bytes go to chars
+	constexpr void parseString()
+	{
+		_i++;
+		for (;;) {
+			if (_i >= _text.size()) throw "LLJSON_STATIC: miss quotation mark";
+			char ch = _text[_i++];
+			if (ch == '"') return;
+			if (static_cast<unsigned char>(ch) < 0x20) throw "LLJSON_STATIC: invalid string char";
+			if (ch != '\\') {
+				putChar(ch);
+				continue;
+			}
+			ch = peek();
+			_i++;
+			switch (ch) {
+			case '"':	putChar('"'); break;
+			case '\\':	putChar('\\'); break;
+			case '/':	putChar('/'); break;
+			case 'b':	putChar('\b'); break;
+			case 'f':	putChar('\f'); break;
+			case 'n':	putChar('\n'); break;
+			case 'r':	putChar('\r'); break;
+			case 't':	putChar('\t'); break;
+			case 'u': {
+				uint32_t cp = parseHex4();
+				if (cp >= 0xD800 && cp <= 0xDBFF) {
+					if (peek() != '\\' || _text.substr(_i + 1, 1) != "u") {
+						throw "LLJSON_STATIC: invalid unicode surrogate";
+					}
+					_i += 2;
+					uint32_t low = parseHex4();
+					if (low < 0xDC00 || low > 0xDFFF) throw "LLJSON_STATIC: invalid unicode surrogate";
+					cp = (((cp - 0xD800) << 10) | (low - 0xDC00)) + 0x10000;
+				}
+				putUtf8(cp);
+				break;
+			}
+			default:
+				throw "LLJSON_STATIC: invalid string escape";
+			}
+		}
+	}
+
+	// Elements of the validated container opened before _i
+	constexpr size_t countChildren() const
+	{
+		size_t depth = 0, commas = 0;
+		bool any = false;
+		for (size_t j = _i;; j++) {
+			char ch = _text[j];
+			if (ch == '"') {
+				for (j++; _text[j] != '"'; j++) {
+					if (_text[j] == '\\') j++;
+				}
+				any = true;
+			}
+			else if (ch == '[' || ch == '{') {
+				depth++;
+				any = true;
+			}
+			else if (ch == ']' || ch == '}') {
+				if (depth == 0) return any ? commas + 1 : 0;
+				depth--;
+			}
+			else if (ch == ',') {
+				if (depth == 0) commas++;
+			}
+			else if (!staticBlank(ch)) {
+				any = true;
+			}
+		}
+	}
+
+	// Node of child k of a container whose children start at first
+	constexpr size_t childNode(size_t first, size_t k)
+	{
+		if constexpr (BUILD) return first + k;
+		else return _nodes++;
+	}
+
+	constexpr void parseArray(size_t n)
+	{
+		_i++;
+		size_t first = _nodes;
+		if constexpr (BUILD) _nodes += countChildren();
+		size_t k = 0;
+		skipBlank();
+		if (peek() == ']') {
+			_i++;
+		}
+		else {
+			for (;;) {
+				parseValue(childNode(first, k++));
+				skipBlank();
+				if (peek() == ']') {
+					_i++;
+					break;
+				}
+				if (peek() != ',') throw "LLJSON_STATIC: miss comma or square bracket";
+				_i++;
+				skipBlank();
+			}
+		}
+		if constexpr (BUILD) {
+			_doc.nodes[n].type = Json::ARRAY;
+			_doc.nodes[n].first = first;
+			_doc.nodes[n].size = k;
+		}
+	}
+
+	constexpr void parseObject(size_t n)
+	{
+		_i++;
+		size_t first = _nodes;
+		if constexpr (BUILD) _nodes += countChildren();
+		size_t k = 0;
+		skipBlank();
+		if (peek() == '}') {
+			_i++;
+		}
+		else {
+			for (;;) {
+				if (peek() != '"') throw "LLJSON_STATIC: miss key";
+				size_t key = _chars;
+				parseString();
+				size_t key_size = _chars - key;
+				skipBlank();
+				if (peek() != ':') throw "LLJSON_STATIC: miss colon";
+				_i++;
+				skipBlank();
+				size_t child = childNode(first, k++);
+				parseValue(child);
+				if constexpr (BUILD) {
+					_doc.nodes[child].key = key;
+					_doc.nodes[child].key_size = key_size;
+				}
+				skipBlank();
+				if (peek() == '}') {
+					_i++;
+					break;
+				}
+				if (peek() != ',') throw "LLJSON_STATIC: miss comma or curly bracket";
+				_i++;
+				skipBlank();
+			}
+		}
+		if constexpr (BUILD) {
+			_doc.nodes[n].type = Json::OBJECT;
+			_doc.nodes[n].first = first;
+			_doc.nodes[n].size = sortMembers(first, k);
+		}
+	}
+
+	constexpr std::string_view keyOf(const StaticNode &node) const
+	{
+		return std::string_view(_doc.chars + node.key, node.key_size);
+	}
+
+	// Stable sort by key, then keep the last of equal keys as Json::parse
+	// does, return the members left
+	constexpr size_t sortMembers(size_t first, size_t count)
+	{
+		StaticNode *m = _doc.nodes + first;
+		for (size_t a = 1; a < count; a++) {
+			StaticNode x = m[a];
+			size_t b = a;
+			for (; b > 0 && keyOf(x) < keyOf(m[b - 1]); b--) m[b] = m[b - 1];
+			m[b] = x;
+		}
+		size_t kept = 0;
+		for (size_t a = 0; a < count; a++) {
+			if (a + 1 < count && keyOf(m[a]) == keyOf(m[a + 1])) continue;
+			m[kept++] = m[a];
+		}
+		return kept;
+	}
+};
+
+template <class T>
+struct StaticStorage {
+	static constexpr StaticSizes sizes = StaticParser<StaticSizes>(T::lljsonText()).parse();
+	using Document = StaticDocument<sizes.nodes, sizes.chars + 1>;
+	static constexpr Document doc = StaticParser<Document>(T::lljsonText()).parse();
+};
+
+template <class T>
+constexpr JsonView staticView()
+{
+	using Storage = StaticStorage<T>;
+	return JsonView(Storage::doc.nodes, Storage::doc.chars, Storage::doc.nodes);
+}
+
+} // namespace detail
+
+} // namespace json
+} // namespace ll
@@ -1,7 +1,22 @@
 #include<iostream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <map>
+#include <stdexcept>
+#include <unordered_set>
 #include<gtest\gtest.h>
+#include <zlib.h>
 #include "lljson.h"
+#include "lljson_bind.h"
+#include "lljson_gzip.h"
+#include "lljson_parallel.h"
+#include "lljson_patch.h"
+#include "lljson_query.h"
+#include "lljson_schema.h"
+#include "lljson_shred.h"
+#include "lljson_static.h"
 
 using namespace std;
 using namespace ll::json;
@@ -123,6 +138,43 @@ TEST(BasicPropertyTest, Object) {
 	EXPECT_EQ(0, j.size());
 }
 
+TEST(BasicPropertyTest, ObjectLookup) {
+	Json j = Json::parse(R"({"id":7,"ok":true,"name":"n","sub":{"k":1}})");
+	string buffer = "xxidxx";
+	string_view key = string_view(buffer).substr(2, 2);
+	EXPECT_EQ(7, j[key].getNumber());
+	EXPECT_EQ(7, j.findObjectElement(key)->second.getNumber());
+	EXPECT_EQ(j.getObject().end(), j.findObjectElement("nope"));
+	const Json &c = j;
+	EXPECT_EQ(1, c["sub"]["k"].getNumber());
+	EXPECT_THROW(c["nope"], std::out_of_range);
+
+	ASSERT_NE(nullptr, j.find("sub"));
+	EXPECT_EQ(nullptr, j.find("nope"));
+	EXPECT_EQ(nullptr, j["id"].find("id"));
+	EXPECT_NE(nullptr, j.getIf("ok", Json::BOOLEAN));
+	EXPECT_EQ(nullptr, j.getIf("ok", Json::NUMBER));
+	EXPECT_EQ(7, j.getNumberOr("id", -1));
+	EXPECT_EQ(-1, j.getNumberOr("name", -1));
+	EXPECT_TRUE(j.getBooleanOr("ok", false));
+	EXPECT_TRUE(j.getBooleanOr("nope", true));
+	EXPECT_EQ("n", j.getStringOr("name", "d"));
+	EXPECT_EQ("d", j.getStringOr("id", "d"));
+	EXPECT_EQ("d", Json(1).getStringOr("id", "d"));
+
+	// the non-const operator[] inserts, a found member drops the cached hash
+	j[string_view("new")] = 1;
+	EXPECT_EQ(5, j.size());
+	j.cacheHash();
+	size_t h = j.hash();
+	*j.find("new") = 2;
+	EXPECT_NE(h, j.hash());
+
+	// maps with the default comparator are still accepted
+	std::map<string, Json> legacy{ { "a", 1 } };
+	EXPECT_EQ(Json::parse(R"({"a":1})"), Json(legacy));
+}
+
 TEST(BasicPropertyTest, Copy) {
 	Json j(1.0);
 	EXPECT_TRUE(j.isNumber());
@@ -241,6 +293,22 @@ TEST(ParseStringTest, ParseString) {
 	TEST_STRING("\xE2\x82\xAC", "\"\\u20AC\""); /* Euro sign U+20AC */
 	TEST_STRING("\xF0\x9D\x84\x9E", "\"\\uD834\\uDD1E\"");  /* G clef sign U+1D11E */
 	TEST_STRING("\xF0\x9D\x84\x9E", "\"\\ud834\\udd1e\"");  /* G clef sign U+1D11E */
+
+	// runs and escapes crossing 16 byte blocks
+	for (size_t n = 0; n < 40; n++) {
+		string run(n, 'a');
+		Json j = Json::parse("\"" + run + "\\n" + run + "\\u4e2D" + run + "\"");
+		EXPECT_EQ(run + "\n" + run + "\xE4\xB8\xAD" + run, j.getString());
+		EXPECT_EQ(Json::PARSE_INVALID_STRING_CHAR, Json::parse("\"" + run + "\x01\"").state());
+		EXPECT_EQ(Json::PARSE_MISS_QUOTATION_MARK, Json::parse("\"" + run).state());
+		EXPECT_EQ(Json::PARSE_INVALID_UNICODE_HEX, Json::parse("\"" + run + "\\u12").state());
+	}
+	string escaped = "\"", expect;
+	for (int i = 0; i < 1000; i++) {
+		escaped += "\\u00e9\\uD83D\\uDE00\\t";
+		expect += "\xC3\xA9\xF0\x9F\x98\x80\t";
+	}
+	EXPECT_EQ(expect, Json::parse(escaped + "\"").getString());
 }
 
 
@@ -386,6 +454,186 @@ TEST(ParseMissColonTest, ParseMissColon) {
 	TEST_PARSE_ERROR(Json::PARSE_MISS_COLON, "{\"a\",\"b\"}");
 }
 
+TEST(ParseDepthExceededTest, ParseDepthExceeded) {
+	// deep input must not overflow the stack
+	string deep(100000, '[');
+	TEST_PARSE_ERROR(Json::PARSE_DEPTH_EXCEEDED, deep);
+	deep += string(100000, ']');
+	TEST_PARSE_ERROR(Json::PARSE_DEPTH_EXCEEDED, deep);
+	string deep_object;
+	for (int i = 0; i < 100000; i++) {
+		deep_object += R"({"a":)";
+	}
+	TEST_PARSE_ERROR(Json::PARSE_DEPTH_EXCEEDED, deep_object);
+
+	ParseOptions options;
+	options.max_depth = 2;
+	EXPECT_EQ(Json::PARSE_OK, Json::parse("[[1],{\"a\":2}]", options).state());
+	EXPECT_EQ(Json::PARSE_DEPTH_EXCEEDED, Json::parse("[[[]]]", options).state());
+	EXPECT_EQ(Json::PARSE_DEPTH_EXCEEDED, Json::parse("{\"a\":{\"b\":{}}}", options).state());
+	options.max_depth = 0;
+	EXPECT_EQ(Json::PARSE_OK, Json::parse("1", options).state());
+	EXPECT_EQ(Json::PARSE_DEPTH_EXCEEDED, Json::parse("[]", options).state());
+
+	options.max_depth = 100000;
+	Json j = Json::parse(string(5000, '[') + string(5000, ']'), options);
+	EXPECT_EQ(Json::PARSE_OK, j.state());
+	EXPECT_EQ(string(5000, '[') + string(5000, ']'), Json::stringify(j));
+}
+
+TEST(ParseLimitsTest, ParseLimits) {
+	const string doc = R"({"a":[1,2,3],"b":"hello"})";
+	ParseOptions options;
+	size_t offset = 0;
+	options.error_offset = &offset;
+	EXPECT_EQ(Json::PARSE_OK, Json::parse(doc, options).state());
+
+	options.limits.max_input = doc.size() - 1;
+	EXPECT_EQ(Json::PARSE_INPUT_TOO_LARGE, Json::parse(doc, options).state());
+	EXPECT_EQ(doc.size() - 1, offset);
+	options.limits = ParseLimits();
+
+	options.limits.max_string = 4;
+	EXPECT_EQ(Json::PARSE_STRING_TOO_LONG, Json::parse(doc, options).state());
+	EXPECT_EQ(doc.find("hello"), offset);
+	EXPECT_EQ(Json::PARSE_STRING_TOO_LONG, Json::parse(R"(["a\tbcd"])", options).state());
+	options.limits.max_string = 5;
+	EXPECT_EQ(Json::PARSE_OK, Json::parse(doc, options).state());
+	options.limits = ParseLimits();
+
+	options.limits.max_members = 2;
+	EXPECT_EQ(Json::PARSE_TOO_MANY_MEMBERS, Json::parse(doc, options).state());
+	EXPECT_EQ(doc.find('3'), offset);
+	options.limits.max_members = 3;
+	EXPECT_EQ(Json::PARSE_OK, Json::parse(doc, options).state());
+	options.limits = ParseLimits();
+
+	// the object, the array, its three numbers and the string
+	options.limits.max_nodes = 6;
+	EXPECT_EQ(Json::PARSE_OK, Json::parse(doc, options).state());
+	options.limits.max_nodes = 5;
+	EXPECT_EQ(Json::PARSE_TOO_MANY_NODES, Json::parse(doc, options).state());
+	// every walker stops with the limit, not with the syntax error it leads to
+	JsonHandler handler;
+	EXPECT_EQ(Json::PARSE_TOO_MANY_NODES, Json::parseEvents(doc, handler, options));
+	string out;
+	EXPECT_EQ(Json::PARSE_TOO_MANY_NODES, Json::minify(doc, out, options));
+	EXPECT_TRUE(out.empty());
+	Json target = Json::parse(doc);
+	EXPECT_EQ(Json::PARSE_TOO_MANY_NODES, Json::parseInto(target, doc, options));
+	EXPECT_EQ(Json::PARSE_TOO_MANY_NODES, target.state());
+	options.limits = ParseLimits();
+
+	size_t memory = 6 * sizeof(Json) + 2 * (4 * sizeof(void *) + sizeof(string)) + 7;
+	options.limits.max_memory = memory;
+	EXPECT_EQ(Json::PARSE_OK, Json::parse(doc, options).state());
+	options.limits.max_memory = memory - 1;
+	EXPECT_EQ(Json::PARSE_MEMORY_EXCEEDED, Json::parse(doc, options).state());
+	// the same with escapes, which decode through a buffer
+	const string escaped = R"({"\u0061":[1,2,3],"b":"hel\u006co"})";
+	EXPECT_EQ(Json::PARSE_MEMORY_EXCEEDED, Json::parse(escaped, options).state());
+	options.limits.max_memory = memory;
+	EXPECT_EQ(Json::PARSE_OK, Json::parse(escaped, options).state());
+	options.limits = ParseLimits();
+
+	// a huge string fails where it passes the limit, not after decoding it
+	const string huge = "[\"\\n" + string(1 << 24, 'x') + "\\n\"]";
+	options.limits.max_string = 16;
+	EXPECT_EQ(Json::PARSE_STRING_TOO_LONG, Json::parse(huge, options).state());
+	EXPECT_EQ(4u, offset);
+	options.limits = ParseLimits();
+	options.limits.max_memory = 1024;
+	EXPECT_EQ(Json::PARSE_MEMORY_EXCEEDED, Json::parse(huge, options).state());
+	EXPECT_EQ(4u, offset);
+	options.limits = ParseLimits();
+
+	// syntax errors report their offset too
+	EXPECT_EQ(Json::PARSE_INVALID_VALUE, Json::parse("[1,x]", options).state());
+	EXPECT_EQ(3u, offset);
+
+	// budget
+	string big = "[";
+	for (int i = 0; i < 100000; i++) {
+		big += "1,";
+	}
+	big += "1]";
+	options.limits.check_interval = 1024;
+	size_t calls = 0;
+	options.limits.yield = [&calls](size_t) { calls++; return true; };
+	EXPECT_EQ(Json::PARSE_OK, Json::parse(big, options).state());
+	EXPECT_EQ(big.size() / 1024, calls);
+	options.limits.yield = [](size_t reached) { return reached < 50000; };
+	EXPECT_EQ(Json::PARSE_ABORTED, Json::parse(big, options).state());
+	EXPECT_GE(offset, 50000u);
+	EXPECT_LT(offset, 51100u);
+	options.limits.yield = nullptr;
+	options.limits.deadline = chrono::steady_clock::now();
+	EXPECT_EQ(Json::PARSE_TIMEOUT, Json::parse(big, options).state());
+	EXPECT_EQ(Json::PARSE_OK, Json::parse("[1]", options).state());
+}
+
+static bool isUtf8Reference(const string& s) {
+	size_t i = 0;
+	while (i < s.size()) {
+		unsigned long c = (unsigned char)s[i];
+		size_t len = c < 0x80 ? 1 : c >> 5 == 6 ? 2 : c >> 4 == 14 ? 3 : c >> 3 == 30 ? 4 : 0;
+		if (len == 0 || i + len > s.size()) return false;
+		unsigned long cp = len == 1 ? c : c & (0x7F >> len);
+		for (size_t k = 1; k < len; k++) {
+			unsigned char b = s[i + k];
+			if ((b & 0xC0) != 0x80) return false;
+			cp = cp << 6 | (b & 0x3F);
+		}
+		static const unsigned long min_cp[] = { 0, 0, 0x80, 0x800, 0x10000 };
+		if (cp < min_cp[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+		i += len;
+	}
+	return true;
+}
+
+TEST(ParseInvalidUtf8Test, ParseInvalidUtf8) {
+	ParseOptions options;
+	options.validate_utf8 = true;
+	const char* invalid[] = {
+		"\"\x80\"",					// stray continuation
+		"\"\xC0\xAF\"",				// overlong
+		"\"\xE0\x80\xAF\"",
+		"\"\xED\xA0\x80\"",			// surrogate
+		"\"\xF4\x90\x80\x80\"",		// > U+10FFFF
+		"\"\xF5\x80\x80\x80\"",
+		"\"\xE4\xB8\"",				// truncated
+		"\"abcdefghijklmnopqrstuvwxyz\xE4\xB8\"",
+		"\"\\n\xFF\"",				// slow path with escape
+		"{\"\xC3\":1}",
+	};
+	for (const char* str : invalid) {
+		EXPECT_EQ(Json::PARSE_INVALID_UTF8, Json::parse(str, options).state()) << str;
+		EXPECT_EQ(Json::PARSE_OK, Json::parse(str).state()) << str;
+	}
+	// nor through an escape: a lone low surrogate, still accepted without the option
+	EXPECT_EQ(Json::PARSE_INVALID_UNICODE_SURROGATE, Json::parse("[\"\\uDC00\"]", options).state());
+	EXPECT_EQ(Json::PARSE_INVALID_UNICODE_SURROGATE, Json::parse("{\"a\\uDFFFb\":1}", options).state());
+	EXPECT_EQ("\xED\xB0\x80", Json::parse("[\"\\uDC00\"]")[0].getString());
+	Json j = Json::parse("[\"\xE4\xB8\xAD\xE6\x96\x87\\t\xF0\x9F\x98\x80\",\"\xC2\xA2\xF4\x8F\xBF\xBF\"]", options);
+	EXPECT_EQ(Json::PARSE_OK, j.state());
+	EXPECT_EQ("\xE4\xB8\xAD\xE6\x96\x87\t\xF0\x9F\x98\x80", j[0].getString());
+
+	// random strings around the 16 byte block size against a reference decoder
+	const unsigned char pool[] = { 'a', 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC2,
+		0xDF, 0xE0, 0xED, 0xEF, 0xF0, 0xF4, 0xF5, 0xFF };
+	unsigned int seed = 1;
+	for (int n = 0; n < 20000; n++) {
+		string s;
+		size_t len = n % 48;
+		for (size_t k = 0; k < len; k++) {
+			seed = seed * 1103515245 + 12345;
+			s += (char)pool[(seed >> 16) % sizeof(pool)];
+		}
+		Json::State expect = isUtf8Reference(s) ? Json::PARSE_OK : Json::PARSE_INVALID_UTF8;
+		ASSERT_EQ(expect, Json::parse("\"" + s + "\"", options).state()) << n;
+	}
+}
+
 TEST(ParseMissCommaOrCurlyBracketTest, ParseMissCommaOrCurlyBracket) {
 	TEST_PARSE_ERROR(Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1");
 	TEST_PARSE_ERROR(Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1]");
@@ -393,6 +641,205 @@ TEST(ParseMissCommaOrCurlyBracketTest, ParseMissCommaOrCurlyBracket) {
 	TEST_PARSE_ERROR(Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
 }
 
+TEST(PackedArrayTest, PackedArray) {
+	ParseOptions options;
+	options.pack_numbers = true;
+	string input = R"({"c":[[1.5,-2,3e2],[],[1,"x",2],[4,[5]]]})";
+	Json j = Json::parse(input, options);
+	Json plain = Json::parse(input);
+	ASSERT_EQ(Json::PARSE_OK, j.state());
+	Json &c = j["c"];
+	EXPECT_FALSE(c.isPackedArray());
+	EXPECT_TRUE(c[0].isPackedArray());
+	EXPECT_EQ(vector<double>({ 1.5, -2, 300 }), c[0].getNumberArray());
+	EXPECT_FALSE(c[1].isPackedArray());
+	EXPECT_FALSE(c[2].isPackedArray());
+	EXPECT_EQ(3, c[2].size());
+	EXPECT_FALSE(c[3].isPackedArray());
+	EXPECT_TRUE(c[3][1].isPackedArray());
+	EXPECT_EQ(plain, j);
+	EXPECT_EQ(j, plain);
+	EXPECT_EQ(plain.hash(), j.hash());
+	EXPECT_EQ(Json::stringify(plain), Json::stringify(j));
+	JsonChunkStringify chunks(j);
+	string chunked;
+	char buf[3];
+	for (size_t n; (n = chunks.nextChunk(buf, sizeof buf)) != 0; ) {
+		chunked.append(buf, n);
+	}
+	EXPECT_EQ(Json::stringify(plain), chunked);
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, Json::parse("[1 2]", options).state());
+	EXPECT_EQ(Json::PARSE_INVALID_VALUE, Json::parse("[1,-]", options).state());
+
+	// numbers keep it packed, anything else unpacks
+	Json copy = c[0];
+	EXPECT_TRUE(copy.isPackedArray());
+	copy.pushbackArrayElement(Json(4));
+	copy.insertArrayElement(0, Json(0));
+	copy.eraseArrayElement(1);
+	copy.popbackArrayElement();
+	EXPECT_TRUE(copy.isPackedArray());
+	EXPECT_EQ(vector<double>({ 0, -2, 300 }), copy.getNumberArray());
+	copy.pushbackArrayElement(Json("s"));
+	EXPECT_FALSE(copy.isPackedArray());
+	EXPECT_EQ(Json::parse(R"([0,-2,300,"s"])"), copy);
+	copy.popbackArrayElement();
+	EXPECT_TRUE(copy.packArray());
+	copy[1] = true;
+	EXPECT_FALSE(copy.isPackedArray());
+	EXPECT_FALSE(copy.packArray());
+
+	EXPECT_EQ(Json::parse(R"([{"op":"replace","path":"/c/0/1","value":2}])"),
+		diff(j, Json::parse(R"({"c":[[1.5,2,3e2],[],[1,"x",2],[4,[5]]]})", options)));
+
+	// parseInto keeps packed buffers
+	Json reused;
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(reused, input, options));
+	EXPECT_EQ(plain, reused);
+	const double *data = reused["c"][0].getNumberArray().data();
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(reused, R"({"c":[[7,8],["a"],[1,2,3],4]})", options));
+	EXPECT_EQ(data, reused["c"][0].getNumberArray().data());
+	EXPECT_EQ(Json::parse(R"({"c":[[7,8],["a"],[1,2,3],4]})"), reused);
+}
+
+TEST(LazyNumberTest, LazyNumber) {
+	ParseOptions options;
+	options.lazy_numbers = true;
+	string input = R"({"big":12345678901234567891,"d":1.50,"e":-2.5E+2,"l":[0,-0.0,1e-400,7]})";
+	Json j = Json::parse(input, options);
+	Json plain = Json::parse(input);
+	ASSERT_EQ(Json::PARSE_OK, j.state());
+	EXPECT_EQ("1.50", *j["d"].getRawNumber());
+	EXPECT_EQ(nullptr, plain["d"].getRawNumber());
+
+	// source text is written back verbatim, values compare and hash as numbers
+	string expect = R"({"big":12345678901234567891,"d":1.50,"e":-2.5E+2,"l":[0,-0.0,1e-400,7]})";
+	EXPECT_EQ(expect, Json::stringify(j));
+	JsonChunkStringify chunks(j);
+	string chunked;
+	char buf[3];
+	for (size_t n; (n = chunks.nextChunk(buf, sizeof buf)) != 0; ) {
+		chunked.append(buf, n);
+	}
+	EXPECT_EQ(expect, chunked);
+	EXPECT_EQ(plain, j);
+	EXPECT_EQ(plain.hash(), j.hash());
+	EXPECT_EQ(1.5, j["d"].getNumber());
+	EXPECT_EQ(-250, j["e"].getNumber());
+	Json copy = j;
+	EXPECT_EQ(expect, Json::stringify(copy));
+
+	int64_t n;
+	EXPECT_FALSE(j["big"].getInt64(n));
+	EXPECT_TRUE(j["l"][3].getInt64(n));
+	EXPECT_EQ(7, n);
+	EXPECT_FALSE(j["d"].getInt64(n));
+	EXPECT_TRUE(Json::parse("-9223372036854775807", options).getInt64(n));
+	EXPECT_EQ(INT64_MAX * -1, n);
+	EXPECT_TRUE(Json::parse("2e3", options).getInt64(n));
+	EXPECT_EQ(2000, n);
+
+	// reassigned numbers lose their text
+	j["d"] = 1.5;
+	EXPECT_EQ(nullptr, j["d"].getRawNumber());
+	EXPECT_EQ(R"({"big":12345678901234567891,"d":1.5,"e":-2.5E+2,"l":[0,-0.0,1e-400,7]})", Json::stringify(j));
+
+	// range is still checked, numbers read for packing are converted
+	EXPECT_EQ(Json::PARSE_NUMBER_TOO_BIG, Json::parse("1e309", options).state());
+	EXPECT_EQ(Json::PARSE_NUMBER_TOO_BIG, Json::parse("1" + string(309, '0'), options).state());
+	options.pack_numbers = true;
+	EXPECT_EQ(R"({"a":[1,2],"b":[1,"x",2.0]})",
+		Json::stringify(Json::parse(R"({"a":[1.0,2],"b":[1.0,"x",2.0]})", options)));
+	options.pack_numbers = false;
+
+	// parseInto reuses the text buffers
+	Json reused;
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(reused, "[1.0,true,3]", options));
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(reused, "[2.00,3,4.0]", options));
+	EXPECT_EQ("[2.00,3,4.0]", Json::stringify(reused));
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(reused, "[2.00,3,4.0]"));
+	EXPECT_EQ("[2,3,4]", Json::stringify(reused));
+}
+
+TEST(ParseIntoTest, ParseInto) {
+	const char *inputs[] = {
+		R"({"id":1,"name":"a long enough name to live on the heap","tags":["x","y","z"],"pos":{"x":1,"y":2}})",
+		R"({"id":2,"name":"short","tags":["x"],"pos":{"x":3,"y":4}})",
+		R"({"id":"3","tags":[1,[2],{"a":null}],"extra":true})",
+		R"([1,2,3])",
+		R"({"a":1,"a":2,"b":3})",
+		R"("str")",
+		R"({})",
+	};
+	Json j;
+	for (const char *input : inputs) {
+		EXPECT_EQ(Json::PARSE_OK, Json::parseInto(j, input));
+		EXPECT_EQ(Json::parse(input), j) << input;
+		EXPECT_EQ(Json::parse(input).hash(), j.hash()) << input;
+	}
+
+	// same shape reuses strings, array capacity and object nodes
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(j, inputs[0]));
+	const char *name = j["name"].getString().data();
+	const Json *tags = &j["tags"][0];
+	const Json *pos = &j["pos"];
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(j, inputs[1]));
+	EXPECT_EQ(name, j["name"].getString().data());
+	EXPECT_EQ(tags, &j["tags"][0]);
+	EXPECT_EQ(pos, &j["pos"]);
+	EXPECT_EQ(1, j["tags"].size());
+	EXPECT_DOUBLE_EQ(4.0, j["pos"]["y"].getNumber());
+
+	j.cacheHash();
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(j, inputs[2]));
+	EXPECT_EQ(Json::parse(inputs[2]).hash(), j.hash());
+
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, Json::parseInto(j, R"({"id":1 "name":2})"));
+	EXPECT_TRUE(j.isNull());
+	EXPECT_EQ(Json::PARSE_ROOT_NOT_SINGULAR, Json::parseInto(j, "1 2"));
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(j, "2"));
+	EXPECT_DOUBLE_EQ(2.0, j.getNumber());
+}
+
+TEST(ParseProjectionTest, ParseProjection) {
+	string input = R"({"id":7,"user":{"name":"n","email":"e","geo":{"lat":1,"lon":2}},
+		"items":[{"sku":"a","qty":1,"meta":{"x":[1,{"y":2}]}},{"sku":"b"},3],
+		"a/b":1,"m~n":2,"big":[[[{"deep":"skipped"}]]]})";
+	JsonProjection projection{ "/id", "/user/geo", "/user/name", "/items/sku", "/a~1b", "/m~0n", "/missing/x" };
+	ParseOptions options;
+	options.projection = &projection;
+	Json expect = Json::parse(R"({"id":7,"user":{"name":"n","geo":{"lat":1,"lon":2}},
+		"items":[{"sku":"a"},{"sku":"b"},3],"a/b":1,"m~n":2})");
+	Json j = Json::parse(input, options);
+	EXPECT_EQ(Json::PARSE_OK, j.state());
+	EXPECT_EQ(expect, j);
+	Json reused = Json::parse(input);
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(reused, input, options));
+	EXPECT_EQ(expect, reused);
+
+	// the whole document, or nothing of it
+	JsonProjection all{ "" };
+	options.projection = &all;
+	EXPECT_EQ(Json::parse(input), Json::parse(input, options));
+	JsonProjection none;
+	options.projection = &none;
+	EXPECT_EQ(Json::Object(), Json::parse(input, options));
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(reused, input, options));
+	EXPECT_EQ(Json::Object(), reused);
+	EXPECT_DOUBLE_EQ(1.0, Json::parse("1", options).getNumber());
+
+	// skipped members are still checked
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, Json::parse(R"({"x":1 "id":2})", options).state());
+	EXPECT_EQ(Json::PARSE_INVALID_VALUE, Json::parse(R"({"x":[tru]})", options).state());
+	EXPECT_EQ(Json::PARSE_MISS_KEY, Json::parse(R"({"x":1,})", options).state());
+
+	JsonProjection invalid;
+	EXPECT_FALSE(invalid.add("a"));
+	EXPECT_FALSE(invalid.add("/a~2"));
+	EXPECT_FALSE(invalid.add("/a~"));
+	EXPECT_TRUE(invalid.root().children.empty());
+}
+
 TEST(StringifyTest, Object) {
 	Json j(Json::Object{
 		{ "0", Json() },
@@ -455,6 +902,80 @@ TEST(StringifyTest, Roundtrip) {
 	TEST_ROUNDTRIP("{\"a\":[1,2,3],\"f\":false,\"i\":123,\"n\":null,\"o\":{\"1\":1,\"2\":2,\"3\":3},\"s\":\"abc\",\"t\":true}");
 }
 
+#define TEST_CHUNK_STRINGIFY(json, cap)\
+	do {\
+		JsonChunkStringify cs(json);\
+		string out;\
+		char buf[cap];\
+		size_t n;\
+		while ((n = cs.nextChunk(buf, cap)) != 0) {\
+			EXPECT_LE(n, cap);\
+			out.append(buf, n);\
+		}\
+		EXPECT_TRUE(cs.finished());\
+		EXPECT_EQ(Json::stringify(json), out);\
+	} while(0)
+
+TEST(StringifyTest, Transcode) {
+	string input = " {\"z\" : [1.50, -0e+1, \"a\\u00e9 \\\"\"] ,\n\t\"a\":{ },\"m\":[ ],\"b\" : {\"c\":true,\"d\":null}} ";
+	string out;
+	EXPECT_EQ(Json::PARSE_OK, Json::minify(input, out));
+	EXPECT_EQ(R"({"z":[1.50,-0e+1,"a\u00e9 \""],"a":{},"m":[],"b":{"c":true,"d":null}})", out);
+	EXPECT_EQ(Json::PARSE_OK, Json::prettify(input, out, "  "));
+	EXPECT_EQ("{\n"
+		"  \"z\": [\n"
+		"    1.50,\n"
+		"    -0e+1,\n"
+		"    \"a\\u00e9 \\\"\"\n"
+		"  ],\n"
+		"  \"a\": {},\n"
+		"  \"m\": [],\n"
+		"  \"b\": {\n"
+		"    \"c\": true,\n"
+		"    \"d\": null\n"
+		"  }\n"
+		"}", out);
+	string pretty = out;
+	EXPECT_EQ(Json::PARSE_OK, Json::minify(pretty, out));
+	EXPECT_EQ(R"({"z":[1.50,-0e+1,"a\u00e9 \""],"a":{},"m":[],"b":{"c":true,"d":null}})", out);
+	EXPECT_EQ(Json::PARSE_OK, Json::minify(" \"s\" ", out));
+	EXPECT_EQ("\"s\"", out);
+
+	// long whitespace runs
+	string spaced = "[" + string(100, ' ') + "1," + string(37, '\n') + "2" + string(16, '\t') + "]";
+	EXPECT_EQ(Json::PARSE_OK, Json::minify(spaced, out));
+	EXPECT_EQ("[1,2]", out);
+
+	EXPECT_EQ(Json::PARSE_MISS_COLON, Json::minify(R"({"a" 1})", out));
+	EXPECT_TRUE(out.empty());
+	EXPECT_EQ(Json::PARSE_MISS_KEY, Json::minify(R"({1:1})", out));
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, Json::minify("[1 2]", out));
+	EXPECT_EQ(Json::PARSE_INVALID_VALUE, Json::minify("[-]", out));
+	EXPECT_EQ(Json::PARSE_ROOT_NOT_SINGULAR, Json::minify("1 2", out));
+	EXPECT_EQ(Json::PARSE_EXPECT_VALUE, Json::prettify("[", out));
+}
+
+TEST(StringifyTest, Chunk) {
+	Json j = Json::parse(R"({"a":[null,true,false,-1.5e-300,"x\"\\\b\f\n\r\t\u0001y"],)"
+		R"("b":{},"c":[],"d":{"e":[[[]]],"f":{"g":"h"}},"long":"0123456789abcdefghij0123456789abcdefghij"})");
+	TEST_CHUNK_STRINGIFY(j, 1);
+	TEST_CHUNK_STRINGIFY(j, 2);
+	TEST_CHUNK_STRINGIFY(j, 3);
+	TEST_CHUNK_STRINGIFY(j, 7);
+	TEST_CHUNK_STRINGIFY(j, 64);
+	TEST_CHUNK_STRINGIFY(j, 4096);
+	Json scalars[] = { Json(), Json(3.25), Json(""), Json(Json::Array{}) };
+	for (const auto &scalar : scalars) {
+		TEST_CHUNK_STRINGIFY(scalar, 1);
+		TEST_CHUNK_STRINGIFY(scalar, 2);
+	}
+
+	JsonChunkStringify cs(j);
+	char buf[4];
+	EXPECT_EQ(0, cs.nextChunk(buf, 0));
+	EXPECT_FALSE(cs.finished());
+}
+
 #define TEST_EQUAL(json1, json2, equality)\
 	do {\
 		Json j1 = Json::parse(json1);\
@@ -491,6 +1012,1088 @@ TEST(EqualTest, Equal) {
 	TEST_EQUAL("{\"a\":{\"b\":{\"c\":{}}}}", "{\"a\":{\"b\":{\"c\":[]}}}", 0);
 }
 
+TEST(HashTest, Hash) {
+	Json j1 = Json::parse(R"({"a":[1,2,{"b":null}],"c":"str","d":true})");
+	Json j2 = Json::parse(R"({"d":true,"c":"str","a":[1,2,{"b":null}]})");
+	EXPECT_EQ(j1.hash(), j2.hash());
+	EXPECT_EQ(Json::parse("0").hash(), Json::parse("-0").hash());
+	EXPECT_NE(Json::parse("[]").hash(), Json::parse("{}").hash());
+	EXPECT_NE(Json::parse("null").hash(), Json::parse("false").hash());
+	EXPECT_NE(Json::parse("[1,2]").hash(), Json::parse("[2,1]").hash());
+	EXPECT_NE(Json::parse(R"({"a":"b"})").hash(), Json::parse(R"({"b":"a"})").hash());
+	EXPECT_EQ(std::hash<Json>()(j1), j1.hash());
+
+	// cached hash must match the uncached one and be dropped by mutation
+	size_t h = j1.cacheHash();
+	EXPECT_EQ(h, j2.hash());
+	j1["a"][2]["b"] = 3;
+	EXPECT_EQ(Json::parse(R"({"a":[1,2,{"b":3}],"c":"str","d":true})").hash(), j1.hash());
+	EXPECT_NE(h, j1.hash());
+	j2.cacheHash();
+	EXPECT_TRUE(j1 != j2);
+	j1["a"][2]["b"] = Json();
+	EXPECT_EQ(h, j1.cacheHash());
+	EXPECT_TRUE(j1 == j2);
+	j2["a"].pushbackArrayElement(Json());
+	EXPECT_TRUE(j1 != j2);
+	EXPECT_EQ(Json::parse(R"({"a":[1,2,{"b":null},null],"c":"str","d":true})").hash(), j2.hash());
+
+	Json copy = j1;
+	EXPECT_EQ(j1.hash(), copy.hash());
+	EXPECT_TRUE(copy == j1);
+
+	// a reference held across cacheHash() still reaches the ancestors
+	Json a = Json::parse(R"({"k":{"v":[1,2]}})");
+	Json b = Json::parse(R"({"k":{"v":[1,2,3]}})");
+	Json &v = a["k"]["v"];
+	a.cacheHash();
+	b.cacheHash();
+	v.pushbackArrayElement(Json(3));
+	EXPECT_TRUE(a == b);
+	EXPECT_EQ(b.hash(), a.hash());
+	EXPECT_EQ(b.hash(), a.cacheHash());
+	a = Json::parse(R"({"k":{"v":[1,2]}})");
+	a.cacheHash();
+	EXPECT_TRUE(a != b);
+}
+
+TEST(HashTest, UnorderedSet) {
+	unordered_set<Json> set;
+	set.insert(Json::parse(R"({"id":1,"tags":["x","y"]})"));
+	set.insert(Json::parse(R"({"tags":["x","y"],"id":1})"));
+	set.insert(Json::parse(R"({"id":2,"tags":["x","y"]})"));
+	set.insert(Json::parse(R"([1,2,3])"));
+	set.insert(Json::parse(R"([1,2,3])"));
+	EXPECT_EQ(3, set.size());
+	EXPECT_EQ(1, set.count(Json::parse(R"({"id":2,"tags":["x","y"]})")));
+	EXPECT_EQ(0, set.count(Json::parse(R"({"id":3,"tags":["x","y"]})")));
+}
+
+TEST(MemoryTest, Compact) {
+	EXPECT_EQ(sizeof(Json), Json(1).memoryUsage());
+	EXPECT_EQ(sizeof(Json), Json("short").memoryUsage());
+
+	// grown one element at a time, with spare capacity everywhere
+	Json j(Json::OBJECT);
+	for (int i = 0; i < 50; i++) {
+		Json row(Json::ARRAY);
+		for (int k = 0; k < 5; k++) {
+			row.pushbackArrayElement(Json(string(40, 'a' + k)));
+		}
+		row.insertArrayElement(0, Json(Json::Object{ { "i", i } }));
+		j["row" + to_string(i)] = row;
+		j["row" + to_string(i)].pushbackArrayElement(Json(i));
+	}
+	ParseOptions packed;
+	packed.pack_numbers = true;
+	Json numbers = Json::parse("[1,2,3]", packed);
+	j["numbers"] = numbers;
+	j.cacheHash();
+	Json before = j;
+	size_t hash = j.hash();
+	size_t used = j.memoryUsage();
+
+	j.compact();
+	EXPECT_EQ(before, j);
+	EXPECT_EQ(hash, j.hash());
+	EXPECT_TRUE(j["numbers"].isPackedArray());
+	EXPECT_LT(j.memoryUsage(), used);
+
+	// exact capacities: usage is what the sizes alone account for
+	Json a(Json::ARRAY);
+	for (int i = 0; i < 9; i++) {
+		a.pushbackArrayElement(Json(i));
+	}
+	EXPECT_LT(sizeof(Json) * 10, a.memoryUsage());
+	a.compact();
+	EXPECT_EQ(sizeof(Json) * 10, a.memoryUsage());
+	a.compact();
+	EXPECT_EQ(sizeof(Json) * 10, a.memoryUsage());
+}
+
+TEST(StringifyTest, Cache) {
+	Json j = Json::parse(R"({"a":[1,{"b":"x"},[true,null]],"c":{"d":2.5,"e":[]},"f":"s"})");
+	Json plain = j;
+	EXPECT_EQ(Json::stringify(plain), j.cacheStringify());
+	EXPECT_EQ(Json::stringify(plain), Json::stringify(j));
+
+	j["a"][1]["b"] = "y\n";
+	plain["a"][1]["b"] = "y\n";
+	EXPECT_EQ(Json::stringify(plain), Json::stringify(j));
+	EXPECT_EQ(Json::stringify(plain), j.cacheStringify());
+
+	j["c"]["e"].pushbackArrayElement(Json(3));
+	plain["c"]["e"].pushbackArrayElement(Json(3));
+	j["a"].eraseArrayElement(0);
+	plain["a"].eraseArrayElement(0);
+	ParseOptions packed;
+	packed.pack_numbers = true;
+	j["g"] = Json::parse("[1,2]", packed);
+	plain["g"] = Json::parse("[1,2]");
+	EXPECT_EQ(Json::stringify(plain), j.cacheStringify());
+
+	// copies drop the text, moves keep it
+	Json copy = j;
+	EXPECT_EQ(Json::stringify(plain), Json::stringify(copy));
+	Json moved = std::move(j);
+	EXPECT_EQ(Json::stringify(plain), Json::stringify(moved));
+
+	// reused by parseInto
+	EXPECT_EQ(Json::PARSE_OK, Json::parseInto(moved, R"({"a":[{"b":"z"}],"f":1})"));
+	EXPECT_EQ(R"({"a":[{"b":"z"}],"f":1})", Json::stringify(moved));
+	EXPECT_EQ(R"({"a":[{"b":"z"}],"f":1})", moved.cacheStringify());
+
+	// a reference held across cacheStringify() still reaches the ancestors
+	Json c = Json::parse(R"({"k":{"v":[1,2]},"x":{"y":[3]}})");
+	Json &w = c["k"]["v"];
+	c.cacheStringify();
+	w.pushbackArrayElement(Json(3));
+	EXPECT_EQ(R"({"k":{"v":[1,2,3]},"x":{"y":[3]}})", Json::stringify(c));
+	EXPECT_EQ(R"({"k":{"v":[1,2,3]},"x":{"y":[3]}})", c.cacheStringify());
+	w.popbackArrayElement();
+	EXPECT_EQ(R"({"k":{"v":[1,2]},"x":{"y":[3]}})", Json::stringify(c));
+
+	// packing writes lazy numbers as doubles, cached text or not
+	ParseOptions lazy;
+	lazy.lazy_numbers = true;
+	Json text = Json::parse("[1.50,2e0]", lazy);
+	EXPECT_EQ("[1.50,2e0]", text.cacheStringify());
+	size_t text_hash = text.cacheHash();
+	EXPECT_TRUE(text.packArray());
+	EXPECT_EQ("[1.5,2]", Json::stringify(text));
+	EXPECT_EQ("[1.5,2]", text.cacheStringify());
+	EXPECT_EQ("[1.5,2]", parallelStringify(text));
+	EXPECT_EQ(text_hash, text.hash());
+
+	Json s("text");
+	EXPECT_EQ("\"text\"", s.cacheStringify());
+	s = 1;
+	EXPECT_EQ("1", Json::stringify(s));
+}
+
+#define TEST_PATCH(expect, doc, patch, state)\
+	do {\
+		Json j = Json::parse(doc);\
+		EXPECT_EQ(state, applyPatch(j, Json::parse(patch)));\
+		if (state == PATCH_OK) {\
+			EXPECT_EQ(Json::parse(expect), j);\
+		}\
+	} while(0)
+
+TEST(PatchTest, ApplyPatch) {
+	TEST_PATCH(R"({"a":1,"b":2})", R"({"a":1})", R"([{"op":"add","path":"/b","value":2}])", PATCH_OK);
+	TEST_PATCH(R"([1,"x",2])", R"([1,2])", R"([{"op":"add","path":"/1","value":"x"}])", PATCH_OK);
+	TEST_PATCH(R"([1,2,3])", R"([1,2])", R"([{"op":"add","path":"/-","value":3}])", PATCH_OK);
+	TEST_PATCH(R"({"a":[]})", R"({"a":[1]})", R"([{"op":"remove","path":"/a/0"}])", PATCH_OK);
+	TEST_PATCH(R"({"a":{"c":1}})", R"({"a":{"b":1}})", R"([{"op":"move","from":"/a/b","path":"/a/c"}])", PATCH_OK);
+	TEST_PATCH(R"({"a":[1],"b":[1]})", R"({"a":[1]})", R"([{"op":"copy","from":"/a","path":"/b"}])", PATCH_OK);
+	TEST_PATCH(R"({"a/b":3,"m~n":4})", R"({"a/b":1,"m~n":2})",
+		R"([{"op":"replace","path":"/a~1b","value":3},{"op":"replace","path":"/m~0n","value":4}])", PATCH_OK);
+	TEST_PATCH(R"(["r"])", R"({"a":1})", R"([{"op":"replace","path":"","value":["r"]}])", PATCH_OK);
+	TEST_PATCH(R"({"a":"x"})", R"({"a":"x"})", R"([{"op":"test","path":"/a","value":"x"}])", PATCH_OK);
+
+	TEST_PATCH("", R"({"a":"x"})", R"([{"op":"test","path":"/a","value":"y"}])", PATCH_TEST_FAILED);
+	TEST_PATCH("", R"({"a":1})", R"([{"op":"remove","path":"/b"}])", PATCH_PATH_NOT_FOUND);
+	TEST_PATCH("", R"({"a":1})", R"([{"op":"add","path":"/x/y","value":1}])", PATCH_PATH_NOT_FOUND);
+	TEST_PATCH("", R"([1])", R"([{"op":"add","path":"/01","value":1}])", PATCH_INVALID_POINTER);
+	TEST_PATCH("", R"([1])", R"([{"op":"add","path":"/5","value":1}])", PATCH_INVALID_POINTER);
+	TEST_PATCH("", R"({"a":{}})", R"([{"op":"move","from":"/a","path":"/a/b"}])", PATCH_INVALID_POINTER);
+	TEST_PATCH("", R"({})", R"([{"op":"add","path":"a","value":1}])", PATCH_INVALID_POINTER);
+	TEST_PATCH("", R"({})", R"([{"op":"frob","path":"/a"}])", PATCH_INVALID_OPERATION);
+	TEST_PATCH("", R"({})", R"([{"op":"add","path":"/a"}])", PATCH_INVALID_OPERATION);
+	TEST_PATCH("", R"({})", R"({"op":"add","path":"/a","value":1})", PATCH_INVALID_PATCH);
+
+	ParseOptions packed;
+	packed.pack_numbers = true;
+	Json j = Json::parse(R"({"a":1})");
+	EXPECT_EQ(PATCH_INVALID_PATCH, applyPatch(j, Json::parse("[1,2]", packed)));
+	EXPECT_EQ(PATCH_OK, applyPatch(j, Json::parse("[]", packed)));
+	EXPECT_EQ(Json::parse(R"({"a":1})"), j);
+}
+
+TEST(PatchTest, ApplyMergePatch) {
+	Json j = Json::parse(R"({"title":"Goodbye!","author":{"givenName":"John","familyName":"Doe"},"tags":["example","sample"],"content":"This will be unchanged"})");
+	applyMergePatch(j, Json::parse(R"({"title":"Hello!","phoneNumber":"+01-123-456-7890","author":{"familyName":null},"tags":["example"]})"));
+	EXPECT_EQ(Json::parse(R"({"title":"Hello!","author":{"givenName":"John"},"tags":["example"],"content":"This will be unchanged","phoneNumber":"+01-123-456-7890"})"), j);
+
+	j = Json::parse(R"({"a":"b"})");
+	applyMergePatch(j, Json::parse(R"({"a":{"bb":{"ccc":null}}})"));
+	EXPECT_EQ(Json::parse(R"({"a":{"bb":{}}})"), j);
+	applyMergePatch(j, Json::parse(R"(["c"])"));
+	EXPECT_EQ(Json::parse(R"(["c"])"), j);
+}
+
+#define TEST_DIFF(from, to)\
+	do {\
+		Json f = Json::parse(from);\
+		Json t = Json::parse(to);\
+		Json p = diff(f, t);\
+		EXPECT_EQ(PATCH_OK, applyPatch(f, p));\
+		EXPECT_EQ(t, f);\
+	} while(0)
+
+TEST(PatchTest, Diff) {
+	TEST_DIFF("null", "1");
+	TEST_DIFF("[1,2,3]", "[1,2,3]");
+	TEST_DIFF("[1,2,3]", "[1,4,3]");
+	TEST_DIFF("[1,2,3]", "[1,3]");
+	TEST_DIFF("[1,2,3]", "[0,1,2,3,4]");
+	TEST_DIFF("[1,2,3,4,5]", "[5]");
+	TEST_DIFF("[]", "[[1],{}]");
+	TEST_DIFF(R"({"a":1,"b":[1,{"c":2}],"d/e":"x"})", R"({"b":[1,{"c":3,"z":null}],"d/e":"y","f~":[]})");
+	TEST_DIFF(R"({"a":{"b":{"c":[1,2]}}})", R"([{"a":{"b":{"c":[1,2]}}}])");
+
+	Json f = Json::parse(R"({"big":[1,2,3,4,5,6,7,8,9],"x":{"y":1}})");
+	Json t = Json::parse(R"({"big":[1,2,3,4,5,6,7,8,9],"x":{"y":2}})");
+	f.cacheHash(), t.cacheHash();
+	EXPECT_EQ(Json::parse(R"([{"op":"replace","path":"/x/y","value":2}])"), diff(f, t));
+	EXPECT_EQ(Json::parse(R"([{"op":"remove","path":"/1"},{"op":"remove","path":"/1"}])"),
+		diff(Json::parse("[1,2,3,4]"), Json::parse("[1,4]")));
+	EXPECT_EQ(0, diff(f, f).size());
+}
+
+TEST(EventTest, Events) {
+	string input = R"({"a":[1,true,null,"s\n"],"b":{"c":{}},"d":[]})";
+	JsonBuilder builder;
+	EXPECT_EQ(Json::PARSE_OK, Json::parseEvents(input, builder));
+	EXPECT_EQ(Json::parse(input), builder.result());
+
+	// stop at the first string
+	struct StopAtString : JsonHandler {
+		int values = 0;
+		bool number(double) override { values++; return true; }
+		bool boolean(bool) override { values++; return true; }
+		bool string(string_view) override { return false; }
+	} stop;
+	EXPECT_EQ(Json::PARSE_ABORTED, Json::parseEvents(input, stop));
+	EXPECT_EQ(2, stop.values);
+
+	JsonBuilder broken;
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, Json::parseEvents("[1 2]", broken));
+	EXPECT_EQ(Json::PARSE_ROOT_NOT_SINGULAR, Json::parseEvents("1 2", broken));
+
+	JsonProjection projection{ "/a" };
+	ParseOptions options;
+	options.projection = &projection;
+	JsonBuilder projected;
+	EXPECT_EQ(Json::PARSE_OK, Json::parseEvents(input, projected, options));
+	EXPECT_EQ(Json::parse(R"({"a":[1,true,null,"s\n"]})"), projected.result());
+}
+
+TEST(ReaderTest, Tokens) {
+	string input = R"( {"a":[1,true,null,"s\n"],"b":{},"c":false} )";
+	JsonReader r(input);
+	string seen;
+	while (r.next()) {
+		switch (r.token()) {
+		case JsonReader::NUL: seen += "n"; break;
+		case JsonReader::BOOLEAN: seen += r.getBoolean() ? "t" : "f"; break;
+		case JsonReader::NUMBER: seen += to_string(static_cast<int>(r.getNumber())); break;
+		case JsonReader::STRING: seen += "'" + string(r.getString()) + "'"; break;
+		case JsonReader::KEY: seen += string(r.getString()) + ":"; break;
+		case JsonReader::START_ARRAY: seen += "["; break;
+		case JsonReader::END_ARRAY: seen += "]"; break;
+		case JsonReader::START_OBJECT: seen += "{"; break;
+		case JsonReader::END_OBJECT: seen += "}"; break;
+		default: break;
+		}
+	}
+	EXPECT_EQ(Json::PARSE_OK, r.state());
+	EXPECT_EQ("{a:[1tn's\n']b:{}c:f}", seen);
+	EXPECT_FALSE(r.next());
+
+	string number = "  12.5 ";
+	JsonReader scalar(number);
+	EXPECT_EQ(JsonReader::NONE, scalar.token());
+	EXPECT_TRUE(scalar.next());
+	EXPECT_EQ(12.5, scalar.getNumber());
+	EXPECT_FALSE(scalar.next());
+	EXPECT_EQ(Json::PARSE_OK, scalar.state());
+
+	const char *broken[] = { "", "[1 2]", "{\"a\" 1}", "{1:2}", "[1,]", "1 2", "[1}" };
+	Json::State states[] = { Json::PARSE_EXPECT_VALUE, Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
+		Json::PARSE_MISS_COLON, Json::PARSE_MISS_KEY, Json::PARSE_INVALID_VALUE,
+		Json::PARSE_ROOT_NOT_SINGULAR, Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET };
+	for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++) {
+		string input = broken[i];
+		JsonReader b(input);
+		while (b.next());
+		EXPECT_EQ(states[i], b.state()) << input;
+	}
+}
+
+TEST(ReaderTest, SkipValue) {
+	// walk records one at a time, skipping what isn't needed
+	string input = R"([{"id":1,"big":{"x":[1,{"y":"]"}]},"name":"a"},[2,[3]],{"id":2,"name":"b\u00e9"},7])";
+	JsonReader r(input);
+	vector<string> names;
+	double ids = 0;
+	ASSERT_TRUE(r.next());
+	EXPECT_EQ(JsonReader::START_ARRAY, r.token());
+	while (r.next() && r.token() != JsonReader::END_ARRAY) {
+		if (r.token() != JsonReader::START_OBJECT) {
+			EXPECT_TRUE(r.skipValue());
+			EXPECT_EQ(1u, r.depth());
+			continue;
+		}
+		while (r.next() && r.token() == JsonReader::KEY) {
+			if (r.getString() == "id") {
+				r.next();
+				ids += r.getNumber();
+			}
+			else if (r.getString() == "name") {
+				r.next();
+				names.emplace_back(r.getString());
+			}
+			else {
+				EXPECT_TRUE(r.skipValue());
+			}
+		}
+		EXPECT_EQ(JsonReader::END_OBJECT, r.token());
+	}
+	EXPECT_EQ(Json::PARSE_OK, r.state());
+	EXPECT_EQ(3, ids);
+	EXPECT_EQ(vector<string>({ "a", "b\xc3\xa9" }), names);
+	EXPECT_FALSE(r.next());
+	EXPECT_EQ(Json::PARSE_OK, r.state());
+
+	string object = R"({"a":[1,2],"b":{}})";
+	JsonReader whole(object);
+	EXPECT_TRUE(whole.next());
+	EXPECT_TRUE(whole.skipValue());
+	EXPECT_EQ(JsonReader::END_OBJECT, whole.token());
+	EXPECT_EQ(0u, whole.depth());
+	EXPECT_FALSE(whole.next());
+	EXPECT_EQ(Json::PARSE_OK, whole.state());
+
+	string mismatched = "[[1,2},3]";
+	JsonReader bad(mismatched);
+	EXPECT_TRUE(bad.next());
+	EXPECT_TRUE(bad.next());
+	EXPECT_FALSE(bad.skipValue());
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, bad.state());
+	EXPECT_FALSE(bad.next());
+}
+
+TEST(SchemaTest, Validate) {
+	JsonSchema schema;
+	ASSERT_TRUE(schema.compile(Json::parse(R"({
+		"type": "object",
+		"required": ["id", "name", "tags"],
+		"properties": {
+			"id": {"type": "integer", "minimum": 1},
+			"name": {"type": "string", "minLength": 1, "maxLength": 4},
+			"score": {"type": ["number", "null"], "exclusiveMaximum": 100},
+			"tags": {"type": "array", "maxItems": 2, "items": {"enum": ["a", "b", [1, {"x": null}]]}},
+			"meta": {"type": "object", "additionalProperties": {"type": "boolean"}}
+		},
+		"additionalProperties": false
+	})")));
+	struct Case {
+		const char *input;
+		Json::State state;
+		const char *path;
+	} cases[] = {
+		{ R"({"id":1,"name":")" "\xE4\xB8\xAD\xE6\x96\x87" R"(ab","tags":["a",[1,{"x":null}]],"score":null,"meta":{"k":true}})", Json::PARSE_OK, "" },
+		{ R"({"id":1.5,"name":"n","tags":[]})", Json::PARSE_SCHEMA_MISMATCH, "/id" },
+		{ R"({"id":0,"name":"n","tags":[]})", Json::PARSE_SCHEMA_MISMATCH, "/id" },
+		{ R"({"id":1,"name":"","tags":[]})", Json::PARSE_SCHEMA_MISMATCH, "/name" },
+		{ R"({"id":1,"name":"abcde","tags":[]})", Json::PARSE_SCHEMA_MISMATCH, "/name" },
+		{ R"({"id":1,"name":"n","tags":[],"score":100})", Json::PARSE_SCHEMA_MISMATCH, "/score" },
+		{ R"({"id":1,"name":"n","tags":["a","c"]})", Json::PARSE_SCHEMA_MISMATCH, "/tags/1" },
+		{ R"({"id":1,"name":"n","tags":[[1,{"x":0}]]})", Json::PARSE_SCHEMA_MISMATCH, "/tags/0" },
+		{ R"({"id":1,"name":"n","tags":["a","a","a"]})", Json::PARSE_SCHEMA_MISMATCH, "/tags" },
+		{ R"({"id":1,"name":"n"})", Json::PARSE_SCHEMA_MISMATCH, "" },
+		{ R"({"id":1,"name":"n","tags":[],"x/y":1})", Json::PARSE_SCHEMA_MISMATCH, "/x~1y" },
+		{ R"({"id":1,"name":"n","tags":[],"meta":{"k":1}})", Json::PARSE_SCHEMA_MISMATCH, "/meta/k" },
+		{ R"([])", Json::PARSE_SCHEMA_MISMATCH, "" },
+		{ R"({"id":1,"name":"n","tags":[] )", Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "" },
+	};
+	for (const Case &c : cases) {
+		string path;
+		EXPECT_EQ(c.state, schema.validate(c.input, &path)) << c.input;
+		EXPECT_EQ(c.path, path) << c.input;
+		Json j;
+		EXPECT_EQ(c.state, schema.parse(c.input, j)) << c.input;
+		if (c.state == Json::PARSE_OK) {
+			EXPECT_EQ(Json::parse(c.input), j);
+		}
+		else {
+			EXPECT_TRUE(j.isNull());
+			EXPECT_EQ(c.state, j.state());
+		}
+	}
+}
+
+TEST(SchemaTest, Compile) {
+	JsonSchema schema;
+	EXPECT_TRUE(schema.compile(Json(true)));
+	EXPECT_EQ(Json::PARSE_OK, schema.validate("[1,{}]"));
+	EXPECT_TRUE(schema.compile(Json(false)));
+	EXPECT_EQ(Json::PARSE_SCHEMA_MISMATCH, schema.validate("null"));
+	EXPECT_TRUE(schema.compile(Json::parse(R"({"items":false,"title":"ignored"})")));
+	EXPECT_EQ(Json::PARSE_OK, schema.validate("[]"));
+	EXPECT_EQ(Json::PARSE_SCHEMA_MISMATCH, schema.validate("[1]"));
+	EXPECT_EQ(Json::PARSE_OK, schema.validate("{\"a\":1}"));
+
+	EXPECT_FALSE(schema.compile(Json(1)));
+	EXPECT_FALSE(schema.compile(Json::parse(R"({"type":"float"})")));
+	EXPECT_FALSE(schema.compile(Json::parse(R"({"minLength":-1})")));
+	EXPECT_FALSE(schema.compile(Json::parse(R"({"properties":{"a":1}})")));
+	EXPECT_FALSE(schema.compile(Json::parse(R"({"required":"a"})")));
+	EXPECT_EQ(Json::PARSE_OK, schema.validate("1"));
+
+	// keyword arrays of only numbers may come packed
+	ParseOptions packed;
+	packed.pack_numbers = true;
+	Json numbers = Json::parse(R"({"enum":[1,2,3]})", packed);
+	ASSERT_TRUE(numbers["enum"].isPackedArray());
+	EXPECT_TRUE(schema.compile(numbers));
+	EXPECT_EQ(Json::PARSE_OK, schema.validate("2"));
+	EXPECT_EQ(Json::PARSE_SCHEMA_MISMATCH, schema.validate("4"));
+	EXPECT_FALSE(schema.compile(Json::parse(R"({"type":[1]})", packed)));
+	EXPECT_FALSE(schema.compile(Json::parse(R"({"required":[1]})", packed)));
+	EXPECT_TRUE(schema.compile(Json::parse(R"({"type":[],"required":[]})", packed)));
+	EXPECT_EQ(Json::PARSE_SCHEMA_MISMATCH, schema.validate("1"));
+}
+
+// Evaluate over the tree and over the text, both must agree
+static Json query(const char *expr, const Json &input) {
+	JsonQuery q;
+	EXPECT_TRUE(q.compile(expr)) << expr;
+	Json dom = q.evaluate(input);
+	Json streamed;
+	EXPECT_EQ(Json::PARSE_OK, q.evaluateStream(Json::stringify(input), streamed)) << expr;
+	EXPECT_EQ(dom, streamed) << expr;
+	return dom;
+}
+
+TEST(QueryTest, Evaluate) {
+	Json logs = Json::parse(R"({"logs":[
+		{"id":1,"status":200,"latency":12,"tags":["a","b"]},
+		{"id":2,"status":500,"latency":340,"tags":[]},
+		{"id":3,"status":500,"latency":80},
+		{"id":4,"status":404,"latency":5,"note":"x y"}]})");
+	EXPECT_EQ(Json::parse("[1,2,3,4]"), query(".logs[].id", logs));
+	EXPECT_EQ(Json::parse("[[1,2,3,4]]"), query("[.logs[].id]", logs));
+	EXPECT_EQ(Json::parse("[4]"), query(".logs[-1].id", logs));
+	EXPECT_EQ(Json::parse("[2]"), query(".logs.[1] | .id", logs));
+	EXPECT_EQ(Json::parse("[[2,3]]"), query("[.logs[1:3][] | .id]", logs));
+	EXPECT_EQ(Json::parse("[[3,4]]"), query("[.logs[-2:][].id]", logs));
+	EXPECT_EQ(Json::parse(R"([{"id":2,"latency":340},{"id":3,"latency":80}])"),
+		query(".logs[] | select(.status == 500) | {id, latency}", logs));
+	EXPECT_EQ(Json::parse(R"([{"i":2,"t":null,"n":1}])"),
+		query(".logs[] | select(.status >= 500 and .latency > 100) | {i: .id, \"t\": .tags[0], n: 1}", logs));
+	EXPECT_EQ(Json::parse("[1,3,4]"), query(".logs[] | select(.status != 500 or .latency < 100) | .id", logs));
+	EXPECT_EQ(Json::parse("[4]"), query(".logs[] | select(.\"note\" == \"x y\") | .id", logs));
+	EXPECT_EQ(Json::parse("[2,3]"), query(".logs[] | select(.note | not) | select(.latency >= 80) | .id", logs));
+	EXPECT_EQ(Json::parse(R"(["a","b"])"), query(".logs[0].tags[]", logs));
+	EXPECT_EQ(Json::parse("[null]"), query(".logs[0].x", logs));
+	EXPECT_EQ(Json::parse("[null]"), query(".logs[7].x", logs));
+	EXPECT_EQ(Json::parse("[null]"), query(".logs.x", logs));
+	EXPECT_EQ(Json::parse("[]"), query(".logs[0].x[]", logs));
+	EXPECT_EQ(Json::parse("[true]"), query("1 < \"a\" and null < false and [1] != [2]", logs));
+	EXPECT_EQ(Json::parse("[4]"), query("[.logs[] | .latency] | .[-1:] | .[0] | select(. < 10) | 4", logs));
+
+	// packed arrays are read like any other
+	ParseOptions packed;
+	packed.pack_numbers = true;
+	Json numbers = Json::parse("[3,1,4,1,5]", packed);
+	JsonQuery q;
+	EXPECT_TRUE(q.compile(".[] | select(. > 2)"));
+	EXPECT_EQ(Json::parse("[3,4,5]"), q.evaluate(numbers));
+	EXPECT_TRUE(q.compile("[.[1:3][]] | {a: ., b: .[1]}"));
+	EXPECT_EQ(Json::parse(R"([{"a":[1,4],"b":4}])"), q.evaluate(numbers));
+
+	// streamed records are evaluated a batch at a time
+	std::string big = "[";
+	for (int i = 0; i < 3000; i++) big += (i ? ",{\"v\":" : "{\"v\":") + std::to_string(i) + "}";
+	big += "]";
+	EXPECT_TRUE(q.compile(".[] | select(.v > 1022 and .v < 1026 or .v >= 2998) | .v"));
+	EXPECT_EQ(Json::parse("[1023,1024,1025,2998,2999]"), q.evaluate(Json::parse(big)));
+	Json streamed;
+	EXPECT_EQ(Json::PARSE_OK, q.evaluateStream(big, streamed));
+	EXPECT_EQ(Json::parse("[1023,1024,1025,2998,2999]"), streamed);
+
+	size_t pos = 0;
+	EXPECT_FALSE(q.compile(".a | select(.b[] == 1)", &pos));
+	EXPECT_FALSE(q.compile("{a: .b[]}", &pos));
+	EXPECT_FALSE(q.compile(".a[", &pos));
+	EXPECT_FALSE(q.compile(".a ]", &pos));
+	EXPECT_EQ(3u, pos);
+	EXPECT_FALSE(q.compile(".a[99999999999999999999999]", &pos));
+	EXPECT_EQ(3u, pos);
+	EXPECT_FALSE(q.compile(".a[1:-99999999999999999999999]", &pos));
+	EXPECT_EQ(5u, pos);
+	EXPECT_TRUE(q.compile("."));
+	EXPECT_EQ(Json::parse("[[1]]"), q.evaluate(Json::parse("[1]")));
+	Json out;
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, q.evaluateStream("[1", out));
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, out.state());
+}
+
+TEST(ShredTest, Infer) {
+	JsonShredder shredder;
+	EXPECT_EQ(Json::PARSE_OK, shredder.shred(R"([
+		{"id":1,"ok":true,"name":"a","pos":{"x":1,"y":2},"tags":[1,2]},
+		{"name":"","ok":false,"id":2,"pos":{"x":1.5},"extra":null},
+		{"id":3,"pos":null,"late":"z"}])"));
+	EXPECT_EQ(3u, shredder.rows());
+	ASSERT_EQ(7u, shredder.columns().size());
+
+	const JsonShredder::Column *id = shredder.column("id");
+	ASSERT_NE(nullptr, id);
+	EXPECT_EQ(JsonShredder::Column::INT64, id->type);
+	EXPECT_EQ(std::vector<int64_t>({ 1, 2, 3 }), id->ints);
+	EXPECT_EQ(0u, id->null_count);
+
+	const JsonShredder::Column *ok = shredder.column("ok");
+	EXPECT_EQ(JsonShredder::Column::BOOL, ok->type);
+	EXPECT_TRUE(ok->getBool(0));
+	EXPECT_FALSE(ok->getBool(1));
+	EXPECT_FALSE(ok->isValid(2));
+
+	const JsonShredder::Column *name = shredder.column("name");
+	EXPECT_EQ(JsonShredder::Column::STRING, name->type);
+	EXPECT_EQ(std::vector<int64_t>({ 0, 1, 1, 1 }), name->offsets);
+	EXPECT_EQ("a", name->getString(0));
+	EXPECT_TRUE(name->isValid(1));
+	EXPECT_FALSE(name->isValid(2));
+
+	// promoted to DOUBLE by the second row
+	const JsonShredder::Column *x = shredder.column("pos.x");
+	EXPECT_EQ(JsonShredder::Column::DOUBLE, x->type);
+	EXPECT_EQ(std::vector<double>({ 1, 1.5, 0 }), x->doubles);
+	EXPECT_EQ(1u, x->null_count);
+	EXPECT_EQ(2u, shredder.column("pos.y")->null_count);
+
+	// first seen in a later row
+	const JsonShredder::Column *late = shredder.column("late");
+	EXPECT_EQ(2u, late->null_count);
+	EXPECT_EQ(std::vector<int64_t>({ 0, 0, 0, 1 }), late->offsets);
+	EXPECT_EQ(0x04, late->validity[0]);
+	EXPECT_EQ(JsonShredder::Column::NUL, shredder.column("extra")->type);
+	EXPECT_EQ(nullptr, shredder.column("tags"));
+
+	EXPECT_EQ(Json::PARSE_TYPE_MISMATCH, shredder.shred(R"([{"a":1},{"a":"s"}])"));
+	EXPECT_EQ(0u, shredder.rows());
+	EXPECT_TRUE(shredder.columns().empty());
+	EXPECT_EQ(Json::PARSE_TYPE_MISMATCH, shredder.shred(R"({"a":1})"));
+	EXPECT_EQ(Json::PARSE_TYPE_MISMATCH, shredder.shred(R"([{"a":1},2])"));
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, shredder.shred(R"([{"a":1})"));
+	EXPECT_EQ(Json::PARSE_OK, shredder.shred("[]"));
+	EXPECT_EQ(0u, shredder.rows());
+
+	// integers beyond 2^53 stay exact, past int64 the column is DOUBLE
+	EXPECT_EQ(Json::PARSE_OK, shredder.shred(R"([{"id":9007199254740993,"n":-9223372036854775808,)"
+		R"("e":9007199254740992e0,"f":9007199254740994.0,"big":9223372036854775808}])"));
+	EXPECT_EQ(std::vector<int64_t>({ 9007199254740993 }), shredder.column("id")->ints);
+	EXPECT_EQ(std::vector<int64_t>({ INT64_MIN }), shredder.column("n")->ints);
+	EXPECT_EQ(std::vector<int64_t>({ 9007199254740992 }), shredder.column("e")->ints);
+	EXPECT_EQ(JsonShredder::Column::DOUBLE, shredder.column("f")->type);
+	EXPECT_EQ(JsonShredder::Column::DOUBLE, shredder.column("big")->type);
+}
+
+TEST(ShredTest, Schema) {
+	JsonShredder shredder;
+	shredder.addColumn("t", JsonShredder::Column::DOUBLE);
+	shredder.addColumn("user.id", JsonShredder::Column::INT64);
+	shredder.addColumn("user.name", JsonShredder::Column::STRING);
+	for (int pass = 0; pass < 2; pass++) {
+		EXPECT_EQ(Json::PARSE_OK, shredder.shred(R"([
+			{"t":1,"user":{"id":7,"name":"ann","age":3},"skip":[{}]},
+			{"user":null,"t":2.5,"other":{"id":1}}])"));
+		EXPECT_EQ(2u, shredder.rows());
+		ASSERT_EQ(3u, shredder.columns().size());
+		EXPECT_EQ(std::vector<double>({ 1, 2.5 }), shredder.column("t")->doubles);
+		EXPECT_EQ(std::vector<int64_t>({ 7, 0 }), shredder.column("user.id")->ints);
+		EXPECT_EQ("ann", shredder.column("user.name")->getString(0));
+		EXPECT_FALSE(shredder.column("user.name")->isValid(1));
+	}
+	EXPECT_EQ(Json::PARSE_TYPE_MISMATCH, shredder.shred(R"([{"user":{"id":1.5}}])"));
+	EXPECT_EQ(Json::PARSE_TYPE_MISMATCH, shredder.shred(R"([{"user":{"id":9007199254740994.0}}])"));
+	EXPECT_EQ(Json::PARSE_TYPE_MISMATCH, shredder.shred(R"([{"t":"1"}])"));
+	EXPECT_EQ(Json::PARSE_TYPE_MISMATCH, shredder.shred(R"([{"t":{}}])"));
+	EXPECT_EQ(Json::PARSE_TYPE_MISMATCH, shredder.shred(R"([{"user":1}])"));
+	EXPECT_EQ(3u, shredder.columns().size());
+	EXPECT_EQ(0u, shredder.column("t")->length);
+}
+
+static void writeGzip(const char *path, const std::string &content) {
+	gzFile f = gzopen(path, "wb");
+	ASSERT_NE(nullptr, f);
+	EXPECT_EQ(static_cast<int>(content.size()), gzwrite(f, content.data(), static_cast<unsigned>(content.size())));
+	gzclose(f);
+}
+
+TEST(GzipTest, Read) {
+	const char *path = "lljson_gzip_test.json.gz";
+	// tiny chunks so records span several of them
+	JsonGzipReader reader(7, 2);
+	std::vector<Json> records;
+	auto collect = [&records](Json &&j) { records.push_back(std::move(j)); return true; };
+
+	writeGzip(path, "{\"a\":[1,2,3],\"s\":\"x\\ny\"}\r\n\n  \n\"second line\"\nnull");
+	EXPECT_EQ(Json::PARSE_OK, reader.read(path, JsonGzipReader::NDJSON, collect));
+	ASSERT_EQ(3u, records.size());
+	EXPECT_EQ(Json::parse(R"({"a":[1,2,3],"s":"x\ny"})"), records[0]);
+	EXPECT_EQ(Json("second line"), records[1]);
+	EXPECT_TRUE(records[2].isNull());
+
+	std::string array = R"( [ {"k":"],\"[{"}, [1,[2]], "" ,3.5,{"o":{"p":[]}} ] )";
+	writeGzip(path, array);
+	records.clear();
+	EXPECT_EQ(Json::PARSE_OK, reader.read(path, JsonGzipReader::ARRAY, collect));
+	EXPECT_EQ(Json::parse(array), Json(records));
+
+	records.clear();
+	EXPECT_EQ(Json::PARSE_OK, reader.read(path, JsonGzipReader::DOCUMENT, collect));
+	ASSERT_EQ(1u, records.size());
+	EXPECT_EQ(Json::parse(array), records[0]);
+
+	writeGzip(path, " [ ] ");
+	records.clear();
+	EXPECT_EQ(Json::PARSE_OK, reader.read(path, JsonGzipReader::ARRAY, collect));
+	EXPECT_TRUE(records.empty());
+
+	// plain files are read as is
+	{
+		std::ofstream plain(path, std::ios::binary);
+		plain << "[1,2]";
+	}
+	records.clear();
+	EXPECT_EQ(Json::PARSE_OK, JsonGzipReader().read(path, JsonGzipReader::ARRAY, collect));
+	EXPECT_EQ(2u, records.size());
+
+	auto count = [](Json &&) { return true; };
+	writeGzip(path, "1\n2\n[3,\n");
+	EXPECT_EQ(Json::PARSE_EXPECT_VALUE, reader.read(path, JsonGzipReader::NDJSON, count));
+	int seen = 0;
+	EXPECT_EQ(Json::PARSE_ABORTED, reader.read(path, JsonGzipReader::NDJSON, [&seen](Json &&) { return ++seen < 2; }));
+	EXPECT_EQ(2, seen);
+	writeGzip(path, "[1,]");
+	EXPECT_EQ(Json::PARSE_EXPECT_VALUE, reader.read(path, JsonGzipReader::ARRAY, count));
+	writeGzip(path, "[1,2] 3");
+	EXPECT_EQ(Json::PARSE_ROOT_NOT_SINGULAR, reader.read(path, JsonGzipReader::ARRAY, count));
+	writeGzip(path, "[1,2");
+	EXPECT_EQ(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, reader.read(path, JsonGzipReader::ARRAY, count));
+	writeGzip(path, "{\"a\":1}");
+	EXPECT_EQ(Json::PARSE_TYPE_MISMATCH, reader.read(path, JsonGzipReader::ARRAY, count));
+	writeGzip(path, "");
+	EXPECT_EQ(Json::PARSE_EXPECT_VALUE, reader.read(path, JsonGzipReader::DOCUMENT, count));
+	std::remove(path);
+	EXPECT_EQ(Json::PARSE_INPUT_ERROR, reader.read(path, JsonGzipReader::NDJSON, count));
+}
+
+TEST(ParallelTest, Algorithms) {
+	JsonThreadPool pool(4);
+	ParallelOptions options;
+	options.pool = &pool;
+	Json::Array elements;
+	for (int i = 0; i < 10000; i++) {
+		elements.push_back(Json(Json::Object{ { "id", i }, { "group", i % 7 }, { "name", "n" + to_string(i % 13) } }));
+	}
+	const Json array(std::move(elements));
+
+	atomic<long long> sum(0);
+	atomic<int> misplaced(0);
+	parallelForEach(array, [&](const Json &e, size_t i) {
+		sum += static_cast<long long>(e["id"].getNumber());
+		if (e["id"].getNumber() != i) misplaced++;
+	}, options);
+	EXPECT_EQ(49995000, sum);
+	EXPECT_EQ(0, misplaced);
+
+	Json ids = parallelTransform(array, [](const Json &e) { return e["id"]; }, options);
+	ASSERT_EQ(10000u, ids.size());
+	EXPECT_EQ(1234, ids[1234].getNumber());
+	Json odd = parallelFilter(array, [](const Json &e) { return static_cast<int>(e["id"].getNumber()) % 2 == 1; }, options);
+	ASSERT_EQ(5000u, odd.size());
+	EXPECT_EQ(array[1], odd[0]);
+	EXPECT_EQ(array[9999], odd[4999]);
+
+	double total = parallelReduce(array, 0.0, [](const Json &e) { return e["id"].getNumber(); },
+		[](double a, double b) { return a + b; }, options);
+	EXPECT_EQ(49995000, total);
+	// chunks are combined in order
+	string serial;
+	for (int i = 0; i < 2000; i++) {
+		serial += to_string(i) + ",";
+	}
+	ParallelOptions fine = options;
+	fine.grain = 7;
+	string joined = parallelReduce(array, string(), [](const Json &e) {
+		return e["id"].getNumber() < 2000 ? to_string(static_cast<int>(e["id"].getNumber())) + "," : string();
+	}, [](string a, const string &b) { return a + b; }, fine);
+	EXPECT_EQ(serial, joined);
+
+	// stable: equal groups keep id order
+	Json sorted = array;
+	EXPECT_TRUE(parallelSort(sorted, "/group", options));
+	ASSERT_EQ(10000u, sorted.size());
+	for (size_t i = 1; i < sorted.size(); i++) {
+		const Json &a = sorted[i - 1], &b = sorted[i];
+		ASSERT_TRUE(a["group"].getNumber() < b["group"].getNumber()
+			|| (a["group"] == b["group"] && a["id"].getNumber() < b["id"].getNumber())) << i;
+	}
+	EXPECT_TRUE(parallelSort(sorted, "/name", options));
+	for (size_t i = 1; i < sorted.size(); i++) {
+		ASSERT_LE(sorted[i - 1]["name"].getString(), sorted[i]["name"].getString());
+	}
+	EXPECT_FALSE(parallelSort(sorted, "name", options));
+	Json mixed = Json::parse(R"([{"k":"b"},{"k":2},{},{"k":true},{"k":null},{"k":[1]},{"k":1}])");
+	EXPECT_TRUE(parallelSort(mixed, "/k", options));
+	EXPECT_EQ(R"([{},{"k":null},{"k":true},{"k":1},{"k":2},{"k":"b"},{"k":[1]}])", Json::stringify(mixed));
+
+	// packed arrays and objects
+	ParseOptions packed;
+	packed.pack_numbers = true;
+	Json numbers = Json::parse("[5,3,9,1,3]", packed);
+	EXPECT_TRUE(parallelSort(numbers, "", options));
+	EXPECT_TRUE(numbers.isPackedArray());
+	EXPECT_EQ("[1,3,3,5,9]", Json::stringify(numbers));
+	EXPECT_EQ("[2,6,6,10,18]", Json::stringify(parallelTransform(numbers,
+		[](const Json &e) { return Json(e.getNumber() * 2); }, options)));
+	Json object = Json::parse(R"({"a":1,"b":2,"c":3})");
+	EXPECT_EQ(Json::parse(R"({"a":2,"b":4,"c":6})"), parallelTransform(object,
+		[](const Json &e) { return Json(e.getNumber() * 2); }, options));
+	atomic<int> members(0);
+	parallelForEachMember(object, [&](const string &key, const Json &value) {
+		if (value.getNumber() == key[0] - 'a' + 1) members++;
+	}, options);
+	EXPECT_EQ(3, members);
+
+	// a loop inside a body runs serially, exceptions reach the caller
+	atomic<int> inner(0);
+	parallelForEach(ids, [&](const Json &, size_t) {
+		parallelForEach(numbers, [&](const Json &, size_t) { inner++; }, options);
+	}, options);
+	EXPECT_EQ(50000, inner);
+	EXPECT_THROW(parallelForEach(array, [](const Json &, size_t i) {
+		if (i == 5000) throw runtime_error("element");
+	}, options), runtime_error);
+	EXPECT_EQ(49995000, parallelReduce(array, 0.0, [](const Json &e) { return e["id"].getNumber(); },
+		[](double a, double b) { return a + b; }, options));
+}
+
+TEST(ParallelTest, Stringify) {
+	JsonThreadPool pool(4);
+	ParallelOptions options;
+	options.pool = &pool;
+	ParseOptions lazy;
+	lazy.lazy_numbers = true;
+	ParseOptions packed;
+	packed.pack_numbers = true;
+	Json::Array records;
+	for (int i = 0; i < 3000; i++) {
+		records.push_back(Json(Json::Object{ { "id", i }, { "name", "\"n\"\t" + to_string(i) },
+			{ "tags", Json::Array{ Json("a"), Json(), Json(i % 2 == 0) } }, { "empty", Json::Object{} } }));
+	}
+	Json cached = Json::parse(R"({"x":[1,2,{"y":"z"}]})");
+	cached.cacheStringify();
+	Json doc(Json::Object{ { "records", Json(std::move(records)) },
+		{ "numbers", Json::parse("[1.5,-0,1e300,3,0.1]", packed) },
+		{ "raw", Json::parse("[1.000,2e0,12345678901234567890]", lazy) },
+		{ "cached", cached }, { "deep", Json::parse(string(100, '[') + "1" + string(100, ']')) },
+		{ "meta", Json::Object{ { "\xc3\xa9", "\xe6\x97\xa5" } } } });
+	string serial = Json::stringify(doc);
+	EXPECT_EQ(serial, parallelStringify(doc, options));
+	ParallelOptions fine = options;
+	fine.grain = 1;
+	vector<string> pieces = parallelStringifyPieces(doc, fine);
+	EXPECT_LT(1u, pieces.size());
+	string joined;
+	for (const string &p : pieces) joined += p;
+	EXPECT_EQ(serial, joined);
+
+	// one large member holds all the work
+	string data = "[0";
+	for (int i = 1; i < 20000; i++) {
+		data += "," + to_string(i);
+	}
+	Json wide(Json::Object{ { "data", Json::parse(data + "]", packed) } });
+	EXPECT_EQ(Json::stringify(wide), parallelStringify(wide, fine));
+	for (const char *text : { "1", "\"s\"", "[]", "{}", "[[]]", "{\"a\":{}}" }) {
+		EXPECT_EQ(text, parallelStringify(Json::parse(text), options));
+	}
+}
+
+struct BindPoint {
+	double x;
+	double y;
+	optional<string> label;
+};
+LLJSON_BIND(BindPoint, x, y, label)
+
+struct BindShape {
+	string name;
+	int64_t id;
+	unsigned short layer;
+	bool visible;
+	vector<BindPoint> points;
+	map<string, vector<int>> groups;
+	optional<BindPoint> center;
+	Json extra;
+};
+LLJSON_BIND(BindShape, name, id, layer, visible, points, groups, center, extra)
+
+TEST(BindTest, Parse) {
+	BindShape shape;
+	string input = R"({
+		"name":"tri\u0041", "id":-9223372036854775808, "layer":3.0, "visible":true,
+		"unknown":{"deep":[1,{"x":[]}]},
+		"points":[{"x":1,"y":2.5,"label":"a"},{"y":-1,"x":0,"label":null}],
+		"groups":{"g1":[1,2],"g2":[]},
+		"extra":{"any":["thing"]}
+	})";
+	EXPECT_EQ(Json::PARSE_OK, bindParse(input, shape));
+	EXPECT_EQ("triA", shape.name);
+	EXPECT_EQ(INT64_MIN, shape.id);
+	EXPECT_EQ(3, shape.layer);
+	EXPECT_TRUE(shape.visible);
+	ASSERT_EQ(2, shape.points.size());
+	EXPECT_DOUBLE_EQ(2.5, shape.points[0].y);
+	EXPECT_EQ("a", *shape.points[0].label);
+	EXPECT_FALSE(shape.points[1].label.has_value());
+	EXPECT_EQ(2, shape.groups["g1"].size());
+	EXPECT_EQ(0, shape.groups["g2"].size());
+	EXPECT_FALSE(shape.center.has_value());
+	EXPECT_EQ(Json::parse(R"({"any":["thing"]})"), shape.extra);
+
+	// a reused struct doesn't keep optionals absent from the input
+	BindPoint p{ 1, 2, string("a") };
+	EXPECT_EQ(Json::PARSE_OK, bindParse(R"({"x":3,"y":4})", p));
+	EXPECT_DOUBLE_EQ(3, p.x);
+	EXPECT_FALSE(p.label.has_value());
+	shape.center = BindPoint{ 0, 0, nullopt };
+	EXPECT_EQ(Json::PARSE_OK, bindParse(input, shape));
+	EXPECT_FALSE(shape.center.has_value());
+}
+
+TEST(BindTest, Stringify) {
+	BindShape shape;
+	shape.name = "s\"q";
+	shape.id = 9007199254740993;
+	shape.layer = 1;
+	shape.visible = false;
+	shape.points = { { 1.5, 2, string("p") }, { 0, 0, nullopt } };
+	shape.groups["g"] = { 1, 2 };
+	shape.center = BindPoint{ 3, 4, nullopt };
+	shape.extra = Json::Array{ 1.0, "x" };
+	string s = bindStringify(shape);
+	EXPECT_EQ(R"({"name":"s\"q","id":9007199254740993,"layer":1,"visible":false,)"
+		R"("points":[{"x":1.5,"y":2,"label":"p"},{"x":0,"y":0,"label":null}],)"
+		R"("groups":{"g":[1,2]},"center":{"x":3,"y":4,"label":null},"extra":[1,"x"]})", s);
+
+	BindShape back;
+	EXPECT_EQ(Json::PARSE_OK, bindParse(s, back));
+	EXPECT_EQ(9007199254740993, back.id);
+	EXPECT_EQ(s, bindStringify(back));
+	EXPECT_EQ(Json::parse(s), Json::parse(bindStringify(back)));
+}
+
+#define TEST_BIND_ERROR(error, path, json)\
+	do {\
+		BindShape shape;\
+		string error_path;\
+		EXPECT_EQ(error, bindParse(json, shape, &error_path));\
+		EXPECT_EQ(path, error_path);\
+	} while(0)
+
+TEST(BindTest, Error) {
+	const char *head = R"({"name":"n","id":1,"layer":1,"visible":true,"groups":{},"extra":null)";
+	TEST_BIND_ERROR(Json::PARSE_TYPE_MISMATCH, "", "[]");
+	TEST_BIND_ERROR(Json::PARSE_TYPE_MISMATCH, "/name", R"({"name":1})");
+	TEST_BIND_ERROR(Json::PARSE_TYPE_MISMATCH, "/id", R"({"id":1.5})");
+	TEST_BIND_ERROR(Json::PARSE_TYPE_MISMATCH, "/id", R"({"id":9223372036854775808})");
+	TEST_BIND_ERROR(Json::PARSE_TYPE_MISMATCH, "/layer", R"({"layer":-1})");
+	TEST_BIND_ERROR(Json::PARSE_TYPE_MISMATCH, "/layer", R"({"layer":65536})");
+	TEST_BIND_ERROR(Json::PARSE_TYPE_MISMATCH, "/visible", R"({"visible":"yes"})");
+	TEST_BIND_ERROR(Json::PARSE_TYPE_MISMATCH, "/points/1/y", string(head) + R"(,"points":[{"x":1,"y":2},{"x":1,"y":"2"}]})");
+	TEST_BIND_ERROR(Json::PARSE_TYPE_MISMATCH, "/groups/a~1b/0", R"({"groups":{"a/b":[true]}})");
+	TEST_BIND_ERROR(Json::PARSE_MISS_FIELD, "/points", string(head) + "}");
+	TEST_BIND_ERROR(Json::PARSE_MISS_FIELD, "/points/0/y", string(head) + R"(,"points":[{"x":1}]})");
+	TEST_BIND_ERROR(Json::PARSE_OK, "", string(head) + R"(,"points":[]})");
+	TEST_BIND_ERROR(Json::PARSE_ROOT_NOT_SINGULAR, "", string(head) + R"(,"points":[]} x)");
+	TEST_BIND_ERROR(Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "", string(head) + R"(,"points":[] x)");
+	TEST_BIND_ERROR(Json::PARSE_INVALID_VALUE, "", string(head) + R"(,"skipped":[nul],"points":[]})");
+	TEST_BIND_ERROR(Json::PARSE_EXPECT_VALUE, "", "");
+	TEST_BIND_ERROR(Json::PARSE_DEPTH_EXCEEDED, "", string(head) + R"(,"skipped":)" + string(100000, '['));
+	TEST_BIND_ERROR(Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "", string(head) + R"(,"skipped":[[1}]})");
+	TEST_BIND_ERROR(Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "", string(head) + R"(,"skipped":{"a":[]]})");
+	TEST_BIND_ERROR(Json::PARSE_MISS_KEY, "", string(head) + R"(,"skipped":{"a":{},}})");
+	TEST_BIND_ERROR(Json::PARSE_OK, "", string(head) + R"(,"skipped":{"a":[{},[[]],{"b":"c"}]},"points":[]})");
+}
+
+struct BindEvent {
+	int a, b, ab, ba, aa, bb, abc, acb, bac;
+	string type;
+	Json rest;
+};
+LLJSON_BIND(BindEvent, a, b, ab, ba, aa, bb, abc, acb, bac, type)
+LLJSON_BIND_REST(BindEvent, rest)
+
+TEST(BindTest, KeyDispatch) {
+	using Dispatch = detail::FieldDispatch<BindEvent>;
+	for (size_t i = 0; i < Dispatch::count; i++) {
+		EXPECT_EQ(i, Dispatch::find(Dispatch::names[i]));
+	}
+	EXPECT_EQ(Dispatch::count, Dispatch::find(""));
+	EXPECT_EQ(Dispatch::count, Dispatch::find("abcd"));
+	EXPECT_EQ(Dispatch::count, Dispatch::find("rest"));
+
+	BindEvent e;
+	string input = R"({"bac":9,"acb":8,"abc":7,"bb":6,"aa":5,"ba":4,"ab":3,"b":2,"\u0061":1,)"
+		R"("type":"click","x":[1,{"y":null}],"cb":"z"})";
+	EXPECT_EQ(Json::PARSE_OK, bindParse(input, e));
+	EXPECT_EQ(1, e.a);
+	EXPECT_EQ(5, e.aa);
+	EXPECT_EQ(9, e.bac);
+	EXPECT_EQ("click", e.type);
+	EXPECT_EQ(Json::parse(R"({"x":[1,{"y":null}],"cb":"z"})"), e.rest);
+	EXPECT_EQ(Json::parse(input), Json::parse(bindStringify(e)));
+
+	// rest is reset on every parse
+	EXPECT_EQ(Json::PARSE_OK, bindParse(R"({"a":1,"b":2,"ab":3,"ba":4,"aa":5,"bb":6,"abc":7,"acb":8,"bac":9,"type":""})", e));
+	EXPECT_EQ(0, e.rest.size());
+}
+
+// the most fields LLJSON_BIND takes
+struct BindWide {
+	int f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15;
+	int f16, f17, f18, f19, f20, f21, f22, f23, f24, f25, f26, f27, f28, f29, f30, f31;
+	int f32, f33, f34, f35, f36, f37, f38, f39, f40, f41, f42, f43, f44, f45, f46, f47;
+	int f48, f49, f50, f51, f52, f53, f54, f55, f56, f57, f58, f59, f60, f61, f62, f63;
+};
+LLJSON_BIND(BindWide,
+	f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15,
+	f16, f17, f18, f19, f20, f21, f22, f23, f24, f25, f26, f27, f28, f29, f30, f31,
+	f32, f33, f34, f35, f36, f37, f38, f39, f40, f41, f42, f43, f44, f45, f46, f47,
+	f48, f49, f50, f51, f52, f53, f54, f55, f56, f57, f58, f59, f60, f61, f62, f63)
+
+TEST(BindTest, Wide) {
+	string input = "{";
+	for (int i = 63; i >= 0; i--) {
+		input += "\"f" + to_string(i) + "\":" + to_string(i) + (i != 0 ? "," : "}");
+	}
+	BindWide w;
+	EXPECT_EQ(Json::PARSE_OK, bindParse(input, w));
+	EXPECT_EQ(0, w.f0);
+	EXPECT_EQ(32, w.f32);
+	EXPECT_EQ(63, w.f63);
+	EXPECT_EQ(Json::parse(input), Json::parse(bindStringify(w)));
+
+	string error_path;
+	EXPECT_EQ(Json::PARSE_MISS_FIELD, bindParse("{" + input.substr(10), w, &error_path));
+	EXPECT_EQ("/f63", error_path);
+}
+
+// Parse and stringify throughput, for shallow-wide and deep-narrow input.
+// Disabled, run with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+static void benchmark(const char *name, const string &input, int rounds, const ParseOptions &options)
+{
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++) {
+		Json j = Json::parse(input, options);
+		EXPECT_EQ(Json::PARSE_OK, j.state());
+	}
+	auto parsed = chrono::steady_clock::now();
+	Json j = Json::parse(input, options);
+	for (int i = 0; i < rounds; i++) {
+		EXPECT_EQ(input.size(), Json::stringify(j).size());
+	}
+	auto stringified = chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++) {
+		EXPECT_EQ(Json::PARSE_OK, Json::parseInto(j, input, options));
+	}
+	auto reparsed = chrono::steady_clock::now();
+	string pretty, minified;
+	EXPECT_EQ(Json::PARSE_OK, Json::prettify(input, pretty, "    ", options));
+	auto minify_start = chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++) {
+		EXPECT_EQ(Json::PARSE_OK, Json::minify(pretty, minified, options));
+	}
+	auto minified_end = chrono::steady_clock::now();
+	double pretty_mb = static_cast<double>(pretty.size()) * rounds / (1 << 20);
+	double mb = static_cast<double>(input.size()) * rounds / (1 << 20);
+	cout << name << ": parse " << mb / chrono::duration<double>(parsed - start).count() << " MB/s, "
+		<< "stringify " << mb / chrono::duration<double>(stringified - parsed).count() << " MB/s, "
+		<< "parseInto " << mb / chrono::duration<double>(reparsed - stringified).count() << " MB/s, "
+		<< "minify " << pretty_mb / chrono::duration<double>(minified_end - minify_start).count() << " MB/s" << endl;
+	EXPECT_EQ(input, minified);
+}
+
+TEST(StaticTest, Literal) {
+	static constexpr JsonView config = LLJSON_STATIC(R"({"port":8080,"name":"svc","debug":false,)"
+		R"("hosts":["a","b"],"port":9090,"limits":{"rate":0.1,"burst":null}})");
+	static_assert(config.isObject() && config.size() == 5);
+	static_assert(config["port"].getNumber() == 9090);
+	static_assert(config["hosts"][1].getString() == "b");
+	static_assert(config.getNumberOr("timeout", 30) == 30);
+	static_assert(!config.find("timeout"));
+	EXPECT_EQ("svc", config.getStringOr("name", ""));
+	EXPECT_FALSE(config.getBooleanOr("debug", true));
+	EXPECT_TRUE(config["limits"]["burst"].isNull());
+	EXPECT_FALSE(config.getIf("limits", Json::ARRAY));
+	EXPECT_THROW(config["timeout"], out_of_range);
+	vector<string> keys;
+	for (JsonView m : config) keys.emplace_back(m.key());
+	EXPECT_EQ((vector<string>{ "debug", "hosts", "limits", "name", "port" }), keys);
+	EXPECT_EQ(Json::parse(Json::stringify(config.toJson())), config.toJson());
+
+	// the values Json::parse gives, numbers to the last bit
+	static constexpr char text[] = R"([0.1, 1e23, -0, 2.2250738585072011e-308, 4.9e-324, 2.4703282292062328e-324,)"
+		R"( 9007199254740993, 123456789012345678901234567890, 1.7976931348623157e308, 3.14159265358979323846,)"
+		R"( "\u00e9\ud83d\ude00\n\/", true, [], {"a":1, "a":[2]}])";
+	JsonView literal = LLJSON_STATIC(text);
+	Json parsed = Json::parse(text);
+	EXPECT_EQ(parsed, literal.toJson());
+	for (size_t i = 0; i < 10; i++) {
+		double a = literal[i].getNumber(), b = parsed[i].getNumber();
+		EXPECT_EQ(0, memcmp(&a, &b, sizeof(a))) << i;
+	}
+	EXPECT_EQ("\xc3\xa9\xf0\x9f\x98\x80\n/", literal[10].getString());
+	EXPECT_EQ(0u, literal[12].size());
+	EXPECT_EQ(2, literal[13]["a"][0].getNumber());
+}
+
+TEST(BenchmarkTest, DISABLED_ShallowWide) {
+	string input = "[";
+	for (int i = 0; i < 100000; i++) {
+		if (i != 0) { input += ','; }
+		input += R"({"id":)" + to_string(i) + R"(,"name":"item","ok":true,"v":[1,2]})";
+	}
+	input += "]";
+	benchmark("shallow-wide", input, 3, ParseOptions());
+}
+
+TEST(BenchmarkTest, DISABLED_NumberArray) {
+	string input = "[";
+	for (int i = 0; i < 100000; i++) {
+		if (i != 0) { input += ','; }
+		input += "[" + to_string(i - 50000) + ".25," + to_string(i * 3) + ".5]";
+	}
+	input += "]";
+	benchmark("number-array", input, 3, ParseOptions());
+	ParseOptions options;
+	options.pack_numbers = true;
+	benchmark("number-array packed", input, 3, options);
+}
+
+TEST(BenchmarkTest, DISABLED_DeepNarrow) {
+	string input;
+	for (int i = 0; i < 1000; i++) {
+		input += R"({"a":[)";
+	}
+	input += "1";
+	for (int i = 0; i < 1000; i++) {
+		input += "]}";
+	}
+	ParseOptions options;
+	options.max_depth = 2000;
+	benchmark("deep-narrow", input, 300, options);
+}
+
 } // namespace
 
 int main(int argc, char **argv)